@@ -1,5 +1,6 @@
 #include "QnCorrectionTask.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 
@@ -181,6 +182,12 @@ void QnCorrectionTask::InitVariables() {
   }
 
   for (const auto &event_var : analysis_setup_->GetEventVars()) {
+    /* correlations may read event variables from the original AnalysisTree instead */
+    if (!write_event_variables_ &&
+        std::find(kept_event_variables_.begin(), kept_event_variables_.end(), event_var.GetName())
+            == kept_event_variables_.end()) {
+      continue;
+    }
     manager_.AddEventVariable(event_var.GetName());
   }
 }
@@ -265,7 +272,11 @@ boost::program_options::options_description QnCorrectionTask::GetBoostOptions()
        "Input calibration file")
       ("yaml-config-file", value(&yaml_config_file_)->default_value("analysis-config.yml"), "Path to YAML config")
       ("yaml-config-name", value(&yaml_config_node_)->required(), "Name of YAML node")
-      ("qa-file", value(&qa_file_name_)->default_value(""), "Produce dedicated file with QA");
+      ("qa-file", value(&qa_file_name_)->default_value(""), "Produce dedicated file with QA")
+      ("write-event-variables", value(&write_event_variables_)->default_value(true),
+       "Write event variables to the output tree, correlations can read them from the AnalysisTree with --friend-file")
+      ("keep-event-variable", value(&kept_event_variables_)->composing(),
+       "Event variable written even with --write-event-variables=0, e.g. event id for the friend index");
   return desc;
 }
 
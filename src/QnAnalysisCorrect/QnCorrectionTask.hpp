@@ -59,6 +59,8 @@ class QnCorrectionTask : public UserFillTask {
   std::string yaml_config_node_;
 
   std::string qa_file_name_;
+  bool write_event_variables_{true};
+  std::vector<std::string> kept_event_variables_;
   std::shared_ptr<TFile> out_file_;
   std::string in_calibration_file_name_{"correction_in.root"};
 
@@ -0,0 +1,248 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_BOOTSTRAP_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_BOOTSTRAP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Qn::Analysis::Correlate::Bootstrap {
+
+/**
+ * @brief SplitMix64 finalizer, good enough to decorrelate seeds of neighbouring entries
+ */
+inline std::uint64_t Mix(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Poisson(1) variate by inversion of the tabulated CDF.
+ * Unlike std::poisson_distribution, whose algorithm is up to the standard library,
+ * the same generator state gives the same value with any compiler and floating point flags.
+ */
+inline int Poisson1(std::mt19937_64 &generator) {
+  /* P(k' <= k) for k = 0..17, the next value rounds to 1 */
+  static constexpr double CDF[] = {
+      0.36787944117144233, 0.7357588823428847, 0.9196986029286058, 0.9810118431238462,
+      0.9963401531726563, 0.9994058151824183, 0.999916758850712, 0.9999897508033253,
+      0.999998874797402, 0.9999998885745217, 0.9999999899522336, 0.9999999991683892,
+      0.9999999999364022, 0.9999999999954802, 0.9999999999997, 0.9999999999999813,
+      0.9999999999999989, 0.9999999999999999};
+  /* uniform in [0, 1) with 53 bits */
+  const double u = double(generator() >> 11) * 0x1.0p-53;
+  return int(std::upper_bound(std::begin(CDF), std::end(CDF), u) - std::begin(CDF));
+}
+
+/**
+ * @brief Poisson(1) multiplicities of the entry in each of bootstrap samples.
+ *
+ * Multiplicities depend only on (seed, global entry), not on the order in which entries are processed
+ * nor on the platform. This makes results of the sharded run identical to the single run over all inputs.
+ */
+class Resampler {
+ public:
+  /* changes whenever multiplicities of the same (seed, entry) change, kept in the output meta */
+  static constexpr int VERSION = 1;
+
+  Resampler(std::size_t n_samples, std::uint64_t seed) : n_samples_(n_samples), seed_(seed) {}
+
+  template<typename Int = unsigned long long>
+  std::vector<Int> operator()(std::uint64_t global_entry) const {
+    std::mt19937_64 generator(Mix(seed_ ^ Mix(global_entry)));
+    std::vector<Int> result(n_samples_);
+    for (auto &multiplicity : result) {
+      multiplicity = Int(Poisson1(generator));
+    }
+    return result;
+  }
+
+  [[nodiscard]] std::size_t GetNSamples() const { return n_samples_; }
+  [[nodiscard]] std::uint64_t GetSeed() const { return seed_; }
+
+ private:
+  std::size_t n_samples_{0};
+  std::uint64_t seed_{0};
+};
+
+/**
+ * @brief Deterministic selection of a fraction of entries for preview runs.
+ *
+ * Decision depends only on (seed, global entry), so the same entries are selected by all shards and reruns.
+ * Entries selected with a smaller fraction are selected with any larger one.
+ */
+class EntrySampler {
+ public:
+  EntrySampler(double fraction, std::uint64_t seed) : fraction_(fraction), seed_(seed) {}
+
+  bool operator()(std::uint64_t global_entry) const {
+    /* stream constant decorrelates selection from the bootstrap multiplicities of the same entry */
+    const auto hash = Mix(Mix(seed_ ^ 0x5eed5a3b1e000000ULL) ^ Mix(global_entry));
+    /* uniform in [0, 1) with 53 bits */
+    return double(hash >> 11) * 0x1.0p-53 < fraction_;
+  }
+
+  [[nodiscard]] double GetFraction() const { return fraction_; }
+
+ private:
+  double fraction_{1.};
+  std::uint64_t seed_{0};
+};
+
+/**
+ * @brief Maps entry of the processed (sharded) chain to the entry in the chain of all input files
+ */
+class GlobalEntryMap {
+ public:
+  /* consecutive entries starting from local_first correspond to entries starting from global_first */
+  void AddSegment(std::uint64_t local_first, std::uint64_t global_first) {
+    segments_.emplace_back(local_first, global_first);
+    std::sort(segments_.begin(), segments_.end());
+  }
+
+  std::uint64_t operator()(std::uint64_t local_entry) const {
+    if (segments_.empty()) {
+      return local_entry;
+    }
+    auto segment_it = std::upper_bound(segments_.begin(), segments_.end(),
+                                       std::make_pair(local_entry, UINT64_MAX));
+    if (segment_it == segments_.begin()) {
+      return local_entry;
+    }
+    --segment_it;
+    return segment_it->second + (local_entry - segment_it->first);
+  }
+
+ private:
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> segments_;
+};
+
+/**
+ * @brief Weighted means of each bootstrap sample in each bin,
+ * used to study how the bootstrap error converges with the number of samples
+ */
+class ConvergenceAccumulator {
+ public:
+  ConvergenceAccumulator() = default;
+  ConvergenceAccumulator(std::size_t n_bins, std::size_t n_samples) :
+      n_bins_(n_bins),
+      n_samples_(n_samples),
+      entries_(n_bins),
+      sum_w_(n_bins * n_samples),
+      sum_wv_(n_bins * n_samples) {}
+
+  template<typename Int>
+  void Fill(std::size_t bin, double value, double weight, const std::vector<Int> &multiplicities) {
+    ++entries_[bin];
+    const auto offset = bin * n_samples_;
+    const auto n = std::min(n_samples_, multiplicities.size());
+    for (std::size_t i = 0; i < n; ++i) {
+      const double w = weight * double(multiplicities[i]);
+      sum_w_[offset + i] += w;
+      sum_wv_[offset + i] += w * value;
+    }
+  }
+
+  void Merge(const ConvergenceAccumulator &other) {
+    if (other.n_bins_ != n_bins_ || other.n_samples_ != n_samples_) {
+      throw std::logic_error("Accumulators of different size");
+    }
+    for (std::size_t i = 0; i < entries_.size(); ++i) {
+      entries_[i] += other.entries_[i];
+    }
+    for (std::size_t i = 0; i < sum_w_.size(); ++i) {
+      sum_w_[i] += other.sum_w_[i];
+      sum_wv_[i] += other.sum_wv_[i];
+    }
+  }
+
+  [[nodiscard]] std::size_t GetNBins() const { return n_bins_; }
+  [[nodiscard]] std::size_t GetNSamples() const { return n_samples_; }
+  [[nodiscard]] std::uint64_t GetEntries(std::size_t bin) const { return entries_[bin]; }
+
+  /**
+   * @brief Bootstrap error of the mean in the bin evaluated with the first n_samples samples
+   * @return negative if undefined
+   */
+  [[nodiscard]] double ErrorEstimate(std::size_t bin, std::size_t n_samples) const {
+    n_samples = std::min(n_samples, n_samples_);
+    const auto offset = bin * n_samples_;
+    double sum = 0.;
+    double sum2 = 0.;
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      if (!(sum_w_[offset + i] > 0.)) {
+        continue;
+      }
+      const double mean = sum_wv_[offset + i] / sum_w_[offset + i];
+      sum += mean;
+      sum2 += mean * mean;
+      ++n;
+    }
+    if (n < 2) {
+      return -1.;
+    }
+    const double variance = (sum2 - sum * sum / double(n)) / double(n - 1);
+    return std::sqrt(std::max(variance, 0.));
+  }
+
+  /**
+   * @brief Median over bins with at least min_entries of |err(n_samples) - err(all)| / err(all)
+   * @return negative if no bin is usable
+   */
+  [[nodiscard]] double RelativeDeviation(std::size_t n_samples, std::uint64_t min_entries) const {
+    std::vector<double> deviations;
+    for (std::size_t bin = 0; bin < n_bins_; ++bin) {
+      if (entries_[bin] < min_entries) {
+        continue;
+      }
+      const double reference = ErrorEstimate(bin, n_samples_);
+      const double estimate = ErrorEstimate(bin, n_samples);
+      if (!(reference > 0.) || estimate < 0.) {
+        continue;
+      }
+      deviations.emplace_back(std::abs(estimate - reference) / reference);
+    }
+    if (deviations.empty()) {
+      return -1.;
+    }
+    auto median_it = deviations.begin() + deviations.size() / 2;
+    std::nth_element(deviations.begin(), median_it, deviations.end());
+    return *median_it;
+  }
+
+  /**
+   * @brief Smallest of candidates (sorted ascending) with RelativeDeviation not exceeding precision,
+   * total number of samples if none of candidates does or if there is not enough entries
+   */
+  [[nodiscard]] std::size_t RequiredSamples(const std::vector<std::size_t> &candidates,
+                                            double precision, std::uint64_t min_entries) const {
+    for (auto n_samples : candidates) {
+      if (n_samples >= n_samples_) {
+        break;
+      }
+      const double deviation = RelativeDeviation(n_samples, min_entries);
+      if (deviation >= 0. && deviation <= precision) {
+        return n_samples;
+      }
+    }
+    return n_samples_;
+  }
+
+ private:
+  std::size_t n_bins_{0};
+  std::size_t n_samples_{0};
+  std::vector<std::uint64_t> entries_;
+  std::vector<double> sum_w_;
+  std::vector<double> sum_wv_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_BOOTSTRAP_HPP
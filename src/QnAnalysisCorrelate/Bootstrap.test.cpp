@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include "Bootstrap.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate::Bootstrap;
+
+TEST(Bootstrap, Deterministic) {
+  Resampler r1(50, 42);
+  Resampler r2(50, 42);
+  /* the same entry gives the same multiplicities regardless of the processing order */
+  auto e100 = r1(100);
+  r1(7);
+  EXPECT_EQ(r1(100), e100);
+  EXPECT_EQ(r2(100), e100);
+  EXPECT_EQ(e100.size(), 50);
+
+  Resampler other_seed(50, 43);
+  EXPECT_NE(other_seed(100), e100);
+}
+
+TEST(Bootstrap, PoissonMean) {
+  Resampler r(100, 1);
+  double sum = 0.;
+  const std::size_t n_entries = 2000;
+  for (std::size_t i = 0; i < n_entries; ++i) {
+    auto m = r(i);
+    sum += std::accumulate(m.begin(), m.end(), 0.);
+  }
+  EXPECT_NEAR(sum / (n_entries * 100), 1., 0.02);
+}
+
+TEST(Bootstrap, Poisson1) {
+  std::mt19937_64 generator(11);
+  const std::size_t n = 200000;
+  std::vector<std::size_t> counts(8);
+  double sum2 = 0.;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto k = Poisson1(generator);
+    ASSERT_GE(k, 0);
+    ++counts[std::min<std::size_t>(k, counts.size() - 1)];
+    sum2 += double(k) * k;
+  }
+  EXPECT_NEAR(double(counts[0]) / n, std::exp(-1.), 0.005);
+  EXPECT_NEAR(double(counts[1]) / n, std::exp(-1.), 0.005);
+  EXPECT_NEAR(double(counts[2]) / n, std::exp(-1.) / 2, 0.005);
+  /* E[k^2] = var + mean^2 = 2 */
+  EXPECT_NEAR(sum2 / n, 2., 0.03);
+}
+
+TEST(Bootstrap, PortableMultiplicities) {
+  /* fixed by mt19937_64 and the inversion, must not change between platforms and releases */
+  EXPECT_EQ(Resampler(10, 42)(100), std::vector<unsigned long long>({1, 0, 2, 2, 1, 1, 0, 2, 0, 1}));
+}
+
+TEST(Bootstrap, GlobalEntryMap) {
+  GlobalEntryMap identity;
+  EXPECT_EQ(identity(123), 123);
+
+  /* files 1 and 3 of [0,100), [100,250), [250,300), [300,400) */
+  GlobalEntryMap map;
+  map.AddSegment(0, 100);
+  map.AddSegment(150, 300);
+  EXPECT_EQ(map(0), 100);
+  EXPECT_EQ(map(149), 249);
+  EXPECT_EQ(map(150), 300);
+  EXPECT_EQ(map(249), 399);
+}
+
+TEST(Bootstrap, SamplesPrefix) {
+  /* task with fewer samples gets the same multiplicities as a run with --n-samples equal to its count */
+  auto all = Resampler(100, 7)(12345);
+  auto prefix = Resampler(20, 7)(12345);
+  EXPECT_TRUE(std::equal(prefix.begin(), prefix.end(), all.begin()));
+}
+
+TEST(Bootstrap, ConvergenceAccumulator) {
+  const std::size_t n_samples = 200;
+  Resampler resampler(n_samples, 3);
+  std::mt19937 rng(5);
+  std::normal_distribution<double> value(0., 1.);
+
+  ConvergenceAccumulator acc(2, n_samples);
+  ConvergenceAccumulator other(2, n_samples);
+  for (std::size_t entry = 0; entry < 4000; ++entry) {
+    (entry % 2 ? acc : other).Fill(0, value(rng), 1., resampler(entry));
+  }
+  acc.Merge(other);
+  EXPECT_EQ(acc.GetEntries(0), 4000);
+
+  /* error of the mean of N(0,1) from 4000 entries */
+  EXPECT_NEAR(acc.ErrorEstimate(0, n_samples), 1. / std::sqrt(4000.), 0.003);
+  EXPECT_DOUBLE_EQ(acc.RelativeDeviation(n_samples, 1), 0.);
+  /* empty bin is not usable */
+  EXPECT_LT(acc.ErrorEstimate(1, n_samples), 0.);
+
+  std::vector<std::size_t> candidates{10, 50, 100};
+  auto loose = acc.RequiredSamples(candidates, 0.5, 1);
+  auto tight = acc.RequiredSamples(candidates, 1e-6, 1);
+  EXPECT_LE(loose, tight);
+  EXPECT_EQ(tight, n_samples);
+  /* not enough entries */
+  EXPECT_EQ(acc.RequiredSamples(candidates, 0.5, 100000), n_samples);
+}
+
+TEST(Bootstrap, EntrySampler) {
+  EntrySampler sampler(0.1, 5);
+  EntrySampler larger(0.3, 5);
+  const std::uint64_t n_entries = 100000;
+  std::uint64_t n_selected = 0;
+  for (std::uint64_t entry = 0; entry < n_entries; ++entry) {
+    if (sampler(entry)) {
+      ++n_selected;
+      EXPECT_TRUE(larger(entry));
+    }
+  }
+  /* binomial, 0.1 * n_entries +- 5 sigma */
+  EXPECT_NEAR(double(n_selected), 0.1 * n_entries, 5 * std::sqrt(0.09 * n_entries));
+  EXPECT_EQ(sampler(12345), EntrySampler(0.1, 5)(12345));
+
+  EXPECT_TRUE(EntrySampler(1., 0)(42));
+  EXPECT_FALSE(EntrySampler(0., 0)(42));
+}
+
+}
@@ -114,6 +114,7 @@ namespace Qn::Analysis::Correlate {
 
 BETTER_ENUM(EQnWeight, int, OBSERVABLE, REFERENCE)
 BETTER_ENUM(EQnCorrectionStep, int, PLAIN, RECENTERED, TWIST, RESCALED, ALIGNED)
+BETTER_ENUM(ECorrelationTaskType, int, CORRELATION, CUMULANT)
 
 struct AxisConfig {
   enum EAxisType {
@@ -148,7 +149,11 @@ struct CorrelationTaskArgument {
 
 /* list of arguments, list of actions to apply */
 struct CorrelationTask {
+  ECorrelationTaskType type{ECorrelationTaskType::CORRELATION};
   std::vector<CorrelationTaskArgument> arguments;
+  /* CUMULANT options: harmonics and orders of multi-particle correlators */
+  std::vector<unsigned int> harmonics;
+  std::vector<unsigned int> orders;
   std::vector<std::string> actions;
   std::vector<AxisConfig> axes;
   EQnWeight weight_type{EQnWeight::REFERENCE};
@@ -311,7 +316,8 @@ struct convert<Qn::Analysis::Correlate::CorrelationTaskArgument> {
     std::transform(std::begin(correction_steps), std::end(correction_steps),
                    std::back_inserter(arg.corrections_steps),
                    [](const auto &step) { return EQnCorrectionStep(step); });
-    arg.components = node["components"].as<std::vector<std::string>>();
+    /* components are not used by cumulant tasks */
+    arg.components = node["components"].as<std::vector<std::string>>(std::vector<std::string>{});
     arg.weight = node["weight"].as<std::string>("ones");
     return true;
   }
@@ -323,6 +329,7 @@ struct convert<Qn::Analysis::Correlate::CorrelationTask> {
 
   static bool decode(const Node &node, Qn::Analysis::Correlate::CorrelationTask &task) {
     using namespace Qn::Analysis::Correlate;
+    task.type = node["type"].as<Enum<ECorrelationTaskType>>(Enum<ECorrelationTaskType>(ECorrelationTaskType::CORRELATION));
     task.arguments = node["args"].as<std::vector<CorrelationTaskArgument>>();
 //    task.actions = node["actions"].as<std::vector<std::string>>();
     if(node["n-samples"]) {
@@ -332,7 +339,35 @@ struct convert<Qn::Analysis::Correlate::CorrelationTask> {
       throw std::runtime_error(message.c_str());
     }
     task.axes = node["axes"].as<std::vector<AxisConfig>>();
-    task.weight_type = node["weights-type"].as<Enum<EQnWeight>>();
+    if (task.type._value == ECorrelationTaskType::CUMULANT) {
+      if (task.arguments.size() != 1) {
+        throw std::runtime_error("Cumulant task must have exactly one argument");
+      }
+      /* self-correlations are removed assuming Q-vectors are sums of unit vectors of the particles,
+       * which holds for the plain (not normalized) Q-vectors only */
+      for (auto step : task.arguments.front().corrections_steps) {
+        if (step != +EQnCorrectionStep::PLAIN) {
+          throw std::runtime_error(std::string("Cumulant task supports only 'plain' correction step, not '")
+                                       + step._to_string() + "': self-correlations of corrected Q-vectors "
+                                       "can't be removed by the generic framework");
+        }
+      }
+      task.harmonics = node["harmonics"].as<std::vector<unsigned int>>();
+      task.orders = node["orders"].as<std::vector<unsigned int>>(std::vector<unsigned int>{2, 4, 6});
+      for (auto order : task.orders) {
+        if (order == 0 || order % 2 != 0 || order > 8) {
+          throw std::runtime_error("Orders of cumulant task must be even and not greater than 8");
+        }
+      }
+      task.weight_type = EQnWeight::REFERENCE;
+    } else {
+      for (auto &arg : task.arguments) {
+        if (arg.components.empty()) {
+          throw std::runtime_error("Components of the correlation task argument are not set");
+        }
+      }
+      task.weight_type = node["weights-type"].as<Enum<EQnWeight>>();
+    }
 //    if (task.weight_type == EQnWeight(EQnWeight::OBSERVABLE)) {
 //      task.weights_function = node["weights-function"].as<std::string>();
 //    }
@@ -65,4 +65,27 @@ TEST(Config, CorrelationTask) {
 
 }
 
+TEST(Config, CumulantTask) {
+  auto node = Load(R"(
+type: cumulant
+args:
+  - query: { name: { equals: tpc } }
+    query-list: [ { name: tpc, tags: [] } ]
+    correction-steps: [ plain ]
+axes: [ { name: centrality, nb: 10, lo: 0, hi: 100 } ]
+harmonics: [ 2, 3 ]
+)");
+  auto task = node.as<CorrelationTask>();
+  EXPECT_EQ(task.type, +ECorrelationTaskType::CUMULANT);
+  EXPECT_EQ(task.orders, std::vector<unsigned int>({2, 4, 6}));
+  EXPECT_EQ(task.harmonics, std::vector<unsigned int>({2, 3}));
+
+  node["orders"] = std::vector<unsigned int>{3};
+  EXPECT_THROW(node.as<CorrelationTask>(), std::runtime_error);
+  node["orders"] = std::vector<unsigned int>{2};
+
+  node["args"][0]["correction-steps"] = std::vector<std::string>{"plain", "recentered"};
+  EXPECT_THROW(node.as<CorrelationTask>(), std::runtime_error);
+}
+
 }
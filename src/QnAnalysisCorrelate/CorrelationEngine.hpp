@@ -0,0 +1,775 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONENGINE_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONENGINE_HPP
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <QnDataFrame.hpp>
+#include <TList.h>
+
+#include "Bootstrap.hpp"
+#include "GenericFramework.hpp"
+
+namespace Qn::Analysis::Correlate::Engine {
+
+/* Largest number of Q-vectors in a single correlation */
+constexpr std::size_t MAX_ARITY = 8;
+/* Largest number of event axes of a single correlation */
+constexpr std::size_t MAX_AXES = 4;
+/* Arities with compile-time specialization of the kernel, all others go to DYNAMIC_ARITY */
+constexpr std::size_t MAX_STATIC_ARITY = 3;
+constexpr std::size_t DYNAMIC_ARITY = 0;
+
+using SampleIds = std::vector<ULong64_t>;
+/* linear bin of the event axes, -1 if event is outside of the axes */
+using EventBin = Long64_t;
+
+struct QVectorComponentFct {
+  enum EComp { kX, kY, kCos, kSin };
+
+  EComp component{kX};
+  unsigned int harmonic{0};
+
+  [[nodiscard]]
+  float
+  Eval(const Qn::QVector &qv) const noexcept {
+    if (component == kX) {
+      return qv.x(harmonic);
+    } else if (component == kY) {
+      return qv.y(harmonic);
+    } else if (component == kCos) {
+      return qv.x(harmonic) / qv.mag(harmonic);
+    } else if (component == kSin) {
+      return qv.y(harmonic) / qv.mag(harmonic);
+    }
+    __builtin_unreachable();
+  }
+};
+
+struct QVectorWeightFct {
+  enum EWeightType { kOne, kSumw };
+
+  float Eval(const Qn::QVector &qv) const {
+    if (type == kOne) {
+      return 1.f;
+    } else if (type == kSumw) {
+      return qv.sumweights();
+    }
+
+    __builtin_unreachable();
+  }
+
+  EWeightType type{kOne};
+
+};
+
+/**
+ * @brief Compiled kernel (see KernelJit), same semantics as CorrelationKernel IsValid/EvalValue/EvalWeight
+ */
+using JitKernelFunction = bool (*)(const Qn::QVector *const *q, double *value, double *weight);
+
+/**
+ * @brief Runtime description of a single correlation: product of Q-vector components
+ * and (optionally) product of Q-vector weights. Capacity is fixed to MAX_ARITY.
+ */
+struct CorrelationKernel {
+  std::size_t arity{0};
+  std::array<QVectorComponentFct, MAX_ARITY> components{};
+  std::array<QVectorWeightFct, MAX_ARITY> weights{};
+  bool use_weights{false};
+  /* compiled equivalent of this kernel, if available */
+  JitKernelFunction jit{nullptr};
+
+  template<std::size_t Arity>
+  [[nodiscard]]
+  std::size_t GetArity() const noexcept {
+    if constexpr (Arity == DYNAMIC_ARITY) {
+      return arity;
+    } else {
+      return Arity;
+    }
+  }
+
+  template<std::size_t Arity>
+  [[nodiscard]]
+  float EvalValue(const std::array<const Qn::QVector *, MAX_ARITY> &q) const noexcept {
+    float result = 1.f;
+    for (std::size_t i = 0; i < GetArity<Arity>(); ++i) {
+      result *= components[i].Eval(*q[i]);
+    }
+    return result;
+  }
+
+  template<std::size_t Arity>
+  [[nodiscard]]
+  float EvalWeight(const std::array<const Qn::QVector *, MAX_ARITY> &q) const noexcept {
+    if (!use_weights) {
+      return 1.f;
+    }
+    float result = 1.f;
+    for (std::size_t i = 0; i < GetArity<Arity>(); ++i) {
+      result *= weights[i].Eval(*q[i]);
+    }
+    return result;
+  }
+
+  template<std::size_t Arity>
+  [[nodiscard]]
+  bool IsValid(const std::array<const Qn::QVector *, MAX_ARITY> &q) const noexcept {
+    for (std::size_t i = 0; i < GetArity<Arity>(); ++i) {
+      if (!(q[i]->sumweights() > 0.)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief Event axes with runtime dimension. Linear bin is row-major,
+ * the same convention as in Qn::DataContainer.
+ */
+struct EventAxes {
+  std::size_t n_axes{0};
+  std::array<Qn::AxisD, MAX_AXES> axes{};
+
+  explicit EventAxes(const std::vector<Qn::AxisD> &axes_vector = {}) {
+    if (axes_vector.size() > MAX_AXES) {
+      throw std::out_of_range("Number of event axes exceeds MAX_AXES");
+    }
+    n_axes = axes_vector.size();
+    std::copy(axes_vector.begin(), axes_vector.end(), axes.begin());
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    std::size_t result = 1;
+    for (std::size_t i = 0; i < n_axes; ++i) {
+      result *= axes[i].size();
+    }
+    return result;
+  }
+
+  /* returns -1 if any of values is outside of the axis range */
+  [[nodiscard]]
+  EventBin FindLinearBin(const std::array<double, MAX_AXES> &values) const {
+    EventBin result = 0;
+    for (std::size_t i = 0; i < n_axes; ++i) {
+      auto bin = axes[i].FindBin(values[i]);
+      if (bin < 0) {
+        return -1;
+      }
+      result = result * EventBin(axes[i].size()) + bin;
+    }
+    return result;
+  }
+
+  [[nodiscard]]
+  std::vector<Qn::AxisD> ToVector() const {
+    return std::vector<Qn::AxisD>(axes.begin(), axes.begin() + n_axes);
+  }
+};
+
+/**
+ * @brief Result of the booked correlation.
+ * Interface mimics Qn::Correlation::CorrelationActionBase
+ */
+class CorrelationResult {
+ public:
+  CorrelationResult() = default;
+  explicit CorrelationResult(std::string name) : name_(std::move(name)) {}
+
+  [[nodiscard]] const std::string &GetName() const { return name_; }
+  Qn::DataContainerStatCollect &GetDataContainer() {
+    if (!container_) {
+      throw std::logic_error("Container of '" + name_ + "' is already released");
+    }
+    Densify();
+    return *container_;
+  }
+
+  /**
+   * @brief Takes the container out of the result, frees memory as soon as the caller is done with it
+   */
+  std::unique_ptr<Qn::DataContainerStatCollect> ReleaseDataContainer() {
+    if (!container_) {
+      throw std::logic_error("Container of '" + name_ + "' is already released");
+    }
+    Densify();
+    return std::move(container_);
+  }
+
+  /* Bins of the output and bins with allocated samples during the event loop, summed over slots */
+  [[nodiscard]] std::size_t GetNBins() const { return n_bins_; }
+  [[nodiscard]] std::size_t GetNAllocatedBins() const { return n_allocated_bins_; }
+  [[nodiscard]] std::size_t GetNSamples() const { return n_samples_; }
+
+ private:
+  friend class CorrelationHelperBase;
+
+  /**
+   * @brief Allocates samples of the bins never filled with sparse storage,
+   * the container is then identical to the dense one
+   */
+  void Densify() {
+    if (allocated_.empty()) {
+      return;
+    }
+    for (std::size_t bin = 0; bin < allocated_.size(); ++bin) {
+      if (!allocated_[bin]) {
+        (*container_)[bin].SetNumberOfReSamples(n_samples_);
+      }
+    }
+    allocated_.clear();
+    allocated_.shrink_to_fit();
+  }
+
+  std::string name_;
+  /* held by pointer to be released without copying */
+  std::unique_ptr<Qn::DataContainerStatCollect> container_{std::make_unique<Qn::DataContainerStatCollect>()};
+  std::size_t n_bins_{0};
+  std::size_t n_allocated_bins_{0};
+  std::size_t n_samples_{0};
+  /* sparse storage: bins with allocated samples, empty if all are allocated */
+  std::vector<char> allocated_;
+};
+
+/**
+ * @brief Output layout of the correlation: [event axes..., input 0 axes..., input 1 axes..., ...] (row-major)
+ */
+class CorrelationLayout {
+ public:
+  CorrelationLayout(EventAxes event_axes, const std::vector<std::vector<Qn::AxisD>> &input_axes) :
+      arity_(input_axes.size()),
+      event_axes_(std::move(event_axes)) {
+    if (arity_ == 0 || arity_ > MAX_ARITY) {
+      throw std::out_of_range("Number of inputs is not supported");
+    }
+
+    output_axes_ = event_axes_.ToVector();
+    for (std::size_t i = 0; i < arity_; ++i) {
+      input_sizes_[i] = 1;
+      for (auto &axis : input_axes[i]) {
+        input_sizes_[i] *= axis.size();
+        output_axes_.emplace_back(axis);
+      }
+    }
+  }
+
+  /* total number of output bins */
+  [[nodiscard]] std::size_t NBins() const {
+    std::size_t result = event_axes_.size();
+    for (std::size_t i = 0; i < arity_; ++i) {
+      result *= input_sizes_[i];
+    }
+    return result;
+  }
+
+ protected:
+  /**
+   * @brief Calls f(linear_bin, q) for all combinations of input bins for the given event bin
+   */
+  template<std::size_t Arity, typename InputArray, typename Function>
+  void ForEachCombination(EventBin event_bin, const InputArray &inputs, Function &&f) const {
+    const std::size_t arity = Arity == DYNAMIC_ARITY ? arity_ : Arity;
+
+    std::array<std::size_t, MAX_ARITY> input_bin{};
+    std::array<const Qn::QVector *, MAX_ARITY> q{};
+    while (true) {
+      std::size_t linear_bin = event_bin;
+      for (std::size_t i = 0; i < arity; ++i) {
+        linear_bin = linear_bin * input_sizes_[i] + input_bin[i];
+        q[i] = &(*inputs[i])[input_bin[i]];
+      }
+
+      f(linear_bin, q);
+
+      /* next combination, last input runs fastest */
+      std::size_t i_increment = arity;
+      while (i_increment > 0) {
+        --i_increment;
+        if (++input_bin[i_increment] < input_sizes_[i_increment]) {
+          break;
+        }
+        input_bin[i_increment] = 0;
+        if (i_increment == 0) {
+          return;
+        }
+      }
+    }
+  }
+
+  std::size_t arity_{0};
+  EventAxes event_axes_;
+  std::array<std::size_t, MAX_ARITY> input_sizes_{};
+  std::vector<Qn::AxisD> output_axes_;
+};
+
+/**
+ * @brief Evaluates correlation kernel, compiled version is used if available
+ * @return false if the combination must be skipped
+ */
+template<std::size_t Arity>
+inline bool EvalKernel(const CorrelationKernel &kernel, const std::array<const Qn::QVector *, MAX_ARITY> &q,
+                       double &value, double &weight) {
+  if (kernel.jit) {
+    return kernel.jit(q.data(), &value, &weight);
+  }
+  if (!kernel.template IsValid<Arity>(q)) {
+    return false;
+  }
+  value = kernel.template EvalValue<Arity>(q);
+  weight = kernel.template EvalWeight<Arity>(q);
+  return true;
+}
+
+/**
+ * @brief Non-template part of the correlation helpers: per-slot containers and merging
+ */
+class CorrelationHelperBase : public CorrelationLayout {
+ public:
+  /**
+   * @param sparse samples of the bin are allocated on the first fill of the bin in the slot,
+   * otherwise all bins are allocated upfront
+   */
+  CorrelationHelperBase(std::string name,
+                        EventAxes event_axes,
+                        const std::vector<std::vector<Qn::AxisD>> &input_axes,
+                        std::size_t n_samples,
+                        unsigned int n_slots,
+                        bool sparse) :
+      CorrelationLayout(std::move(event_axes), input_axes),
+      result_(std::make_shared<CorrelationResult>(std::move(name))),
+      n_samples_(n_samples) {
+    Qn::DataContainerStatCollect prototype;
+    if (!output_axes_.empty()) {
+      prototype.AddAxes(output_axes_);
+    }
+    if (!sparse) {
+      for (auto &bin : prototype) {
+        bin.SetNumberOfReSamples(n_samples);
+      }
+    }
+    slot_containers_.assign(std::max(n_slots, 1u), prototype);
+    if (sparse) {
+      slot_allocated_.assign(slot_containers_.size(), std::vector<char>(prototype.size(), 0));
+    }
+  }
+
+  std::shared_ptr<CorrelationResult> GetResultPtr() const { return result_; }
+
+  void Initialize() {}
+
+  void InitTask(TTreeReader *, unsigned int) {}
+
+  void Finalize() {
+    auto &result_container = slot_containers_.front();
+    result_->n_bins_ = result_container.size();
+    result_->n_samples_ = n_samples_;
+    if (slot_allocated_.empty()) {
+      result_->n_allocated_bins_ = result_->n_bins_ * slot_containers_.size();
+    } else {
+      AlignAllocatedBins();
+    }
+    if (slot_containers_.size() > 1) {
+      TList others;
+      for (auto it = std::next(slot_containers_.begin()); it != slot_containers_.end(); ++it) {
+        others.Add(&(*it));
+      }
+      result_container.Merge(&others);
+    }
+    result_->container_ = std::make_unique<Qn::DataContainerStatCollect>(std::move(result_container));
+    slot_containers_.clear();
+    slot_allocated_.clear();
+  }
+
+  std::string GetActionName() { return "QnAnalysisCorrelation"; }
+
+ protected:
+  /**
+   * @brief Fills all combinations of input bins for the given event bin
+   * @param eval bool(const std::array<const Qn::QVector *, MAX_ARITY> &q, double &value, double &weight),
+   * returns false if the combination must be skipped
+   */
+  template<std::size_t Arity, typename InputArray, typename Function>
+  void Fill(unsigned int slot, EventBin event_bin, const InputArray &inputs, const SampleIds &samples,
+            Function &&eval) {
+    auto &container = slot_containers_[slot];
+    auto *allocated = slot_allocated_.empty() ? nullptr : &slot_allocated_[slot];
+    double value = 0.;
+    double weight = 0.;
+    ForEachCombination<Arity>(event_bin, inputs,
+                               [&](std::size_t linear_bin, const std::array<const Qn::QVector *, MAX_ARITY> &q) {
+      if (eval(q, value, weight)) {
+        auto &bin = container[linear_bin];
+        if (allocated && !(*allocated)[linear_bin]) {
+          bin.SetNumberOfReSamples(n_samples_);
+          (*allocated)[linear_bin] = 1;
+        }
+        bin.Fill(Qn::Product(value, weight, true), samples);
+      }
+    });
+  }
+
+ private:
+  /**
+   * @brief Sparse storage: allocates bins filled in any slot in all slots, so that slots can be merged.
+   * Bins filled nowhere stay without samples in the result until it is densified.
+   */
+  void AlignAllocatedBins() {
+    std::vector<char> allocated_any(slot_allocated_.front().size(), 0);
+    std::size_t n_allocated = 0;
+    for (auto &allocated : slot_allocated_) {
+      for (std::size_t bin = 0; bin < allocated.size(); ++bin) {
+        allocated_any[bin] |= allocated[bin];
+        n_allocated += std::size_t(allocated[bin]);
+      }
+    }
+    for (std::size_t i_slot = 0; i_slot < slot_containers_.size(); ++i_slot) {
+      for (std::size_t bin = 0; bin < allocated_any.size(); ++bin) {
+        if (allocated_any[bin] && !slot_allocated_[i_slot][bin]) {
+          slot_containers_[i_slot][bin].SetNumberOfReSamples(n_samples_);
+        }
+      }
+    }
+    result_->n_allocated_bins_ = n_allocated;
+    result_->allocated_ = std::move(allocated_any);
+  }
+
+  std::shared_ptr<CorrelationResult> result_;
+  std::size_t n_samples_{0};
+  std::vector<Qn::DataContainerStatCollect> slot_containers_;
+  /* sparse storage: per slot, bins with allocated samples */
+  std::vector<std::vector<char>> slot_allocated_;
+};
+
+/**
+ * @brief RDataFrame action computing correlation of Q-vectors.
+ *
+ * Columns are N_INPUTS Qn::DataContainerQVector, then samples, then linear event bin (see DefineEventBin).
+ * Hot arities (Arity = 1..MAX_STATIC_ARITY) take exactly Arity inputs;
+ * DYNAMIC_ARITY takes MAX_ARITY inputs of which only kernel.arity are used,
+ * unused columns are padded by the caller.
+ *
+ * @tparam Arity
+ */
+template<std::size_t Arity>
+class CorrelationHelper :
+    public CorrelationHelperBase,
+    public ROOT::Detail::RDF::RActionImpl<CorrelationHelper<Arity>> {
+ public:
+  static_assert(Arity <= MAX_STATIC_ARITY, "Only hot arities are specialized, use DYNAMIC_ARITY");
+  static constexpr std::size_t N_INPUTS = Arity == DYNAMIC_ARITY ? MAX_ARITY : Arity;
+
+  using Result_t = CorrelationResult;
+  using CorrelationHelperBase::Initialize;
+  using CorrelationHelperBase::InitTask;
+  using CorrelationHelperBase::Finalize;
+  using CorrelationHelperBase::GetResultPtr;
+  using CorrelationHelperBase::GetActionName;
+
+  CorrelationHelper(std::string name,
+                    CorrelationKernel kernel,
+                    EventAxes event_axes,
+                    const std::vector<std::vector<Qn::AxisD>> &input_axes,
+                    std::size_t n_samples,
+                    unsigned int n_slots,
+                    bool sparse = false) :
+      CorrelationHelperBase(std::move(name), std::move(event_axes), input_axes, n_samples, n_slots, sparse),
+      kernel_(std::move(kernel)) {
+    if (input_axes.size() != kernel_.arity) {
+      throw std::logic_error("Number of inputs is not consistent with kernel arity");
+    }
+  }
+
+  template<typename... Columns>
+  void Exec(unsigned int slot, const Columns &...columns) {
+    static_assert(sizeof...(Columns) == N_INPUTS + 2);
+    ExecImpl(slot, std::forward_as_tuple(columns...), std::make_index_sequence<N_INPUTS>());
+  }
+
+ private:
+  template<typename Tuple, std::size_t... IInput>
+  void ExecImpl(unsigned int slot, const Tuple &columns, std::index_sequence<IInput...>) {
+    const EventBin event_bin = std::get<N_INPUTS + 1>(columns);
+    if (event_bin < 0) {
+      return;
+    }
+    const std::array<const Qn::DataContainerQVector *, N_INPUTS> inputs{&std::get<IInput>(columns)...};
+    Fill<Arity>(slot, event_bin, inputs, std::get<N_INPUTS>(columns),
+                [this](const std::array<const Qn::QVector *, MAX_ARITY> &q, double &value, double &weight) {
+      return EvalKernel<Arity>(kernel_, q, value, weight);
+    });
+  }
+
+  CorrelationKernel kernel_;
+};
+
+/**
+ * @brief RDataFrame action computing multi-particle correlator of a single Q-vector
+ * with the generic framework. Columns are Qn::DataContainerQVector, samples, linear event bin.
+ * Correlator of each event enters the average with the number of distinct particle tuples as weight,
+ * so the result is the event-averaged correlator <<m>>.
+ */
+class CumulantHelper :
+    public CorrelationHelperBase,
+    public ROOT::Detail::RDF::RActionImpl<CumulantHelper> {
+ public:
+  using Result_t = CorrelationResult;
+  using CorrelationHelperBase::Initialize;
+  using CorrelationHelperBase::InitTask;
+  using CorrelationHelperBase::Finalize;
+  using CorrelationHelperBase::GetResultPtr;
+  using CorrelationHelperBase::GetActionName;
+
+  CumulantHelper(std::string name,
+                 GenericFramework::Correlator correlator,
+                 EventAxes event_axes,
+                 const std::vector<Qn::AxisD> &input_axes,
+                 std::size_t n_samples,
+                 unsigned int n_slots,
+                 bool sparse = false) :
+      CorrelationHelperBase(std::move(name), std::move(event_axes), {input_axes}, n_samples, n_slots, sparse),
+      correlator_(correlator) {
+    correlator_.Validate();
+    /* one buffer per slot, no allocations in the event loop */
+    slot_q_powers_.assign(std::max(n_slots, 1u),
+                          GenericFramework::QVectorPowers(correlator_.MaxHarmonic(), correlator_.order));
+  }
+
+  void Exec(unsigned int slot, const Qn::DataContainerQVector &input, const SampleIds &samples, EventBin event_bin) {
+    if (event_bin < 0) {
+      return;
+    }
+    auto &q_powers = slot_q_powers_[slot];
+    const std::array<const Qn::DataContainerQVector *, 1> inputs{&input};
+    Fill<1>(slot, event_bin, inputs, samples,
+            [this, &q_powers](const std::array<const Qn::QVector *, MAX_ARITY> &q, double &value, double &weight) {
+      if (!(q[0]->sumweights() > 0.)) {
+        return false;
+      }
+      /* Q_h of the particles, weights are assumed to be unity */
+      auto q_not_normalized = q[0]->DeNormal();
+      q_powers.SetUnitWeights(q_not_normalized.sumweights(), [&q_not_normalized](unsigned int h) {
+        return GenericFramework::Complex(q_not_normalized.x(h), q_not_normalized.y(h));
+      });
+      return correlator_.Eval(q_powers, value, weight);
+    });
+  }
+
+ private:
+  GenericFramework::Correlator correlator_;
+  std::vector<GenericFramework::QVectorPowers> slot_q_powers_;
+};
+
+/**
+ * @brief RDataFrame action accumulating per-sample means of the correlation for the pilot run
+ * of the adaptive number of samples. Columns are the same as in CorrelationHelper.
+ */
+template<std::size_t Arity>
+class PilotHelper :
+    public CorrelationLayout,
+    public ROOT::Detail::RDF::RActionImpl<PilotHelper<Arity>> {
+ public:
+  static constexpr std::size_t N_INPUTS = CorrelationHelper<Arity>::N_INPUTS;
+  using Result_t = Bootstrap::ConvergenceAccumulator;
+
+  PilotHelper(CorrelationKernel kernel,
+              EventAxes event_axes,
+              const std::vector<std::vector<Qn::AxisD>> &input_axes,
+              std::size_t n_samples,
+              unsigned int n_slots) :
+      CorrelationLayout(std::move(event_axes), input_axes),
+      kernel_(std::move(kernel)),
+      result_(std::make_shared<Result_t>()),
+      slot_accumulators_(std::max(n_slots, 1u), Result_t(NBins(), n_samples)) {}
+
+  std::shared_ptr<Result_t> GetResultPtr() const { return result_; }
+
+  void Initialize() {}
+
+  void InitTask(TTreeReader *, unsigned int) {}
+
+  template<typename... Columns>
+  void Exec(unsigned int slot, const Columns &...columns) {
+    static_assert(sizeof...(Columns) == N_INPUTS + 2);
+    ExecImpl(slot, std::forward_as_tuple(columns...), std::make_index_sequence<N_INPUTS>());
+  }
+
+  void Finalize() {
+    *result_ = std::move(slot_accumulators_.front());
+    for (auto it = std::next(slot_accumulators_.begin()); it != slot_accumulators_.end(); ++it) {
+      result_->Merge(*it);
+    }
+    slot_accumulators_.clear();
+  }
+
+  std::string GetActionName() { return "QnAnalysisCorrelationPilot"; }
+
+ private:
+  template<typename Tuple, std::size_t... IInput>
+  void ExecImpl(unsigned int slot, const Tuple &columns, std::index_sequence<IInput...>) {
+    const EventBin event_bin = std::get<N_INPUTS + 1>(columns);
+    if (event_bin < 0) {
+      return;
+    }
+    const std::array<const Qn::DataContainerQVector *, N_INPUTS> inputs{&std::get<IInput>(columns)...};
+    const SampleIds &samples = std::get<N_INPUTS>(columns);
+    auto &accumulator = slot_accumulators_[slot];
+    double value = 0.;
+    double weight = 0.;
+    ForEachCombination<Arity>(event_bin, inputs,
+                              [&](std::size_t linear_bin, const std::array<const Qn::QVector *, MAX_ARITY> &q) {
+      if (EvalKernel<Arity>(kernel_, q, value, weight)) {
+        accumulator.Fill(linear_bin, value, weight, samples);
+      }
+    });
+  }
+
+  CorrelationKernel kernel_;
+  std::shared_ptr<Result_t> result_;
+  std::vector<Result_t> slot_accumulators_;
+};
+
+namespace Details {
+
+template<typename T, std::size_t I>
+using Indexed = T;
+
+template<typename Helper, typename DataFrame, std::size_t... IInput>
+auto BookImpl(DataFrame &df, Helper &&helper, const std::vector<std::string> &columns,
+              std::index_sequence<IInput...>) {
+  return df.template Book<
+      Indexed<Qn::DataContainerQVector, IInput>...,
+      SampleIds,
+      EventBin>(std::forward<Helper>(helper), columns);
+}
+
+/* padding to the fixed capacity: unused columns repeat the first one */
+inline std::vector<std::string> MakeColumns(std::size_t n_inputs,
+                                            const EventAxes &event_axes,
+                                            const std::string &event_bin_column,
+                                            const std::vector<std::string> &input_names,
+                                            const std::string &samples_column) {
+  if (input_names.empty() || input_names.size() > n_inputs) {
+    throw std::out_of_range("Number of inputs is not supported by this helper");
+  }
+  if (event_axes.n_axes == 0) {
+    throw std::out_of_range("At least one event axis is required");
+  }
+  std::vector<std::string> columns(input_names);
+  columns.resize(n_inputs, input_names.front());
+  columns.emplace_back(samples_column);
+  columns.emplace_back(event_bin_column);
+  return columns;
+}
+
+template<typename DataFrame, std::size_t... IAxis>
+ROOT::RDF::RNode DefineEventBinImpl(DataFrame &df, const std::string &column_name,
+                                    const EventAxes &event_axes, const std::vector<std::string> &variables,
+                                    std::index_sequence<IAxis...>) {
+  return df.Define(column_name, [event_axes](Indexed<double, IAxis>... values) -> EventBin {
+    return event_axes.FindLinearBin({values...});
+  }, variables);
+}
+
+}
+
+/**
+ * @brief Defines column with the linear event bin, computed once per event
+ * and shared by all correlations with the same event axes
+ * @param df data frame
+ * @param column_name name of the new column
+ * @param event_axes axes, names of the axes are names of the event variables
+ * @return data frame with the new column
+ */
+template<typename DataFrame>
+ROOT::RDF::RNode DefineEventBin(DataFrame &df, const std::string &column_name, const EventAxes &event_axes) {
+  if (event_axes.n_axes == 0) {
+    throw std::out_of_range("At least one event axis is required");
+  }
+  /* padding to the fixed capacity: unused variables repeat the first one and are ignored */
+  std::vector<std::string> variables;
+  for (std::size_t i = 0; i < MAX_AXES; ++i) {
+    variables.emplace_back(event_axes.axes[i < event_axes.n_axes ? i : 0].Name());
+  }
+  return Details::DefineEventBinImpl(df, column_name, event_axes, variables, std::make_index_sequence<MAX_AXES>());
+}
+
+/**
+ * @brief Books correlation to the data frame
+ * @param df data frame
+ * @param event_axes event axes of the output
+ * @param event_bin_column column defined by DefineEventBin with the same event axes
+ * @param input_names names of Q-vector columns, size must match kernel arity
+ * @param samples_column column with n_samples bootstrap multiplicities
+ * @param sparse allocate samples of the bin on its first fill
+ */
+template<std::size_t Arity, typename DataFrame>
+ROOT::RDF::RResultPtr<CorrelationResult>
+BookCorrelation(DataFrame &df,
+                const std::string &name,
+                const CorrelationKernel &kernel,
+                const EventAxes &event_axes,
+                const std::string &event_bin_column,
+                const std::vector<std::string> &input_names,
+                const std::vector<std::vector<Qn::AxisD>> &input_axes,
+                std::size_t n_samples,
+                const std::string &samples_column = "samples",
+                bool sparse = false) {
+  constexpr auto n_inputs = CorrelationHelper<Arity>::N_INPUTS;
+  auto columns = Details::MakeColumns(n_inputs, event_axes, event_bin_column, input_names, samples_column);
+  CorrelationHelper<Arity> helper(name, kernel, event_axes, input_axes, n_samples, df.GetNSlots(), sparse);
+  return Details::BookImpl(df, std::move(helper), columns, std::make_index_sequence<n_inputs>());
+}
+
+/**
+ * @brief Books pilot accumulation of the correlation, arguments are the same as in BookCorrelation
+ */
+template<std::size_t Arity, typename DataFrame>
+ROOT::RDF::RResultPtr<Bootstrap::ConvergenceAccumulator>
+BookPilot(DataFrame &df,
+          const CorrelationKernel &kernel,
+          const EventAxes &event_axes,
+          const std::string &event_bin_column,
+          const std::vector<std::string> &input_names,
+          const std::vector<std::vector<Qn::AxisD>> &input_axes,
+          std::size_t n_samples,
+          const std::string &samples_column = "samples") {
+  constexpr auto n_inputs = PilotHelper<Arity>::N_INPUTS;
+  auto columns = Details::MakeColumns(n_inputs, event_axes, event_bin_column, input_names, samples_column);
+  PilotHelper<Arity> helper(kernel, event_axes, input_axes, n_samples, df.GetNSlots());
+  return Details::BookImpl(df, std::move(helper), columns, std::make_index_sequence<n_inputs>());
+}
+
+/**
+ * @brief Books multi-particle correlator of the Q-vector to the data frame
+ * @param df data frame
+ * @param event_bin_column column defined by DefineEventBin with the same event axes
+ * @param samples_column column with n_samples bootstrap multiplicities
+ * @param sparse allocate samples of the bin on its first fill
+ */
+template<typename DataFrame>
+ROOT::RDF::RResultPtr<CorrelationResult>
+BookCumulant(DataFrame &df,
+             const std::string &name,
+             const GenericFramework::Correlator &correlator,
+             const EventAxes &event_axes,
+             const std::string &event_bin_column,
+             const std::string &input_name,
+             const std::vector<Qn::AxisD> &input_axes,
+             std::size_t n_samples,
+             const std::string &samples_column = "samples",
+             bool sparse = false) {
+  CumulantHelper helper(name, correlator, event_axes, input_axes, n_samples, df.GetNSlots(), sparse);
+  return df.template Book<Qn::DataContainerQVector, SampleIds, EventBin>(
+      std::move(helper), {input_name, samples_column, event_bin_column});
+}
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONENGINE_HPP
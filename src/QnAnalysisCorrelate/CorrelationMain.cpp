@@ -36,8 +36,18 @@ int main(int argc, char **argv) {
   }
 
 
-  runner.Initialize();
-  runner.Run();
+  try {
+    runner.Initialize();
+  } catch (std::exception& e) {
+    Error("Main", "%s", e.what());
+    return 1;
+  }
+  try {
+    runner.Run();
+  } catch (std::exception& e) {
+    Error("Main", "%s", e.what());
+    return 1;
+  }
 
 
   return 0;
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "CorrelationMerger.hpp"
+
+using namespace Qn::Analysis::Correlate;
+using namespace boost::program_options;
+
+int main(int argc, char **argv) {
+
+  CorrelationMerger merger;
+
+  options_description desc("Common options");
+  desc.add_options()
+      ("help", "Print help message")
+      ;
+
+  desc.add(merger.GetBoostOptions());
+
+  variables_map vm;
+
+  store(command_line_parser(argc, argv).options(desc).positional(merger.GetPositionalOptions()).run(), vm);
+
+  if (vm.count("help")) {
+    std::cout << "Usage: QnAnalysisCorrelateMerge -o merged.root shard_0.root shard_1.root ..." << std::endl;
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  try {
+    vm.notify();
+    merger.Run();
+  } catch (std::exception& e) {
+    Error("Main", "%s", e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include "CorrelationMerger.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+
+#include <QnDataFrame.hpp>
+#include <TClass.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TList.h>
+#include <TObjString.h>
+
+using namespace Qn::Analysis::Correlate;
+
+boost::program_options::options_description CorrelationMerger::GetBoostOptions() {
+  using namespace boost::program_options;
+  options_description desc("Merge options");
+  desc.add_options()
+      ("output-file,o", value(&output_file_)->required(), "Name of the merged output ROOT file")
+      ("input-files", value(&input_files_)->required()->multitoken(), "Outputs of QnAnalysisCorrelate to merge");
+  return desc;
+}
+
+boost::program_options::positional_options_description CorrelationMerger::GetPositionalOptions() {
+  boost::program_options::positional_options_description desc;
+  desc.add("input-files", -1);
+  return desc;
+}
+
+void CorrelationMerger::Run() {
+  Merge(input_files_, output_file_);
+  Info(__func__, "Merged %zu files to '%s'", input_files_.size(), output_file_.c_str());
+}
+
+void CorrelationMerger::Merge(const std::vector<std::string> &input_files,
+                              const std::string &output_file,
+                              const std::string &mode) {
+  if (input_files.empty()) {
+    throw std::runtime_error("Nothing to merge");
+  }
+
+  std::vector<std::unique_ptr<TFile>> inputs;
+  std::vector<TDirectory *> input_dirs;
+  std::vector<CorrelationRunMeta> metas;
+  for (auto &input_file : input_files) {
+    std::unique_ptr<TFile> f(TFile::Open(input_file.c_str(), "READ"));
+    if (!f || f->IsZombie()) {
+      throw std::runtime_error("Unable to open '" + input_file + "'");
+    }
+    metas.emplace_back(ReadMeta(*f));
+    input_dirs.emplace_back(f.get());
+    inputs.emplace_back(std::move(f));
+  }
+
+  auto merged_meta = MergeMeta(metas);
+
+  std::unique_ptr<TFile> output(TFile::Open(output_file.c_str(), mode.c_str()));
+  if (!output || output->IsZombie()) {
+    throw std::runtime_error("Unable to open '" + output_file + "'");
+  }
+  MergeDirectories(*output, input_dirs);
+  WriteMeta(*output, merged_meta);
+  output->Close();
+}
+
+void CorrelationMerger::MergeDirectories(TDirectory &output_dir, const std::vector<TDirectory *> &input_dirs) {
+  auto first_dir = input_dirs.front();
+
+  std::set<std::string> processed_keys;
+  for (auto obj : *first_dir->GetListOfKeys()) {
+    auto key = dynamic_cast<TKey *>(obj);
+    std::string name = key->GetName();
+    /* only the highest cycle */
+    if (!processed_keys.emplace(name).second || name == CORRELATION_META_NAME) {
+      continue;
+    }
+
+    auto cl = TClass::GetClass(key->GetClassName());
+    if (cl && cl->InheritsFrom(TDirectory::Class())) {
+      std::vector<TDirectory *> nested_dirs;
+      for (auto input_dir : input_dirs) {
+        auto nested_dir = input_dir->GetDirectory(name.c_str());
+        if (!nested_dir) {
+          throw incompatible_inputs("Directory '" + name + "' is missing in '" + input_dir->GetPath() + "'");
+        }
+        nested_dirs.emplace_back(nested_dir);
+      }
+      auto output_nested_dir = output_dir.GetDirectory(name.c_str());
+      if (!output_nested_dir) {
+        output_nested_dir = output_dir.mkdir(name.c_str());
+      }
+      MergeDirectories(*output_nested_dir, nested_dirs);
+    } else if (cl && cl->InheritsFrom(Qn::DataContainerStatCollect::Class())) {
+      std::unique_ptr<Qn::DataContainerStatCollect> merged(first_dir->Get<Qn::DataContainerStatCollect>(name.c_str()));
+      std::vector<std::unique_ptr<Qn::DataContainerStatCollect>> others;
+      TList others_list;
+      for (auto it = std::next(input_dirs.begin()); it != input_dirs.end(); ++it) {
+        others.emplace_back((*it)->Get<Qn::DataContainerStatCollect>(name.c_str()));
+        if (!others.back()) {
+          throw incompatible_inputs("Correlation '" + name + "' is missing in '" + (*it)->GetPath() + "'");
+        }
+        others_list.Add(others.back().get());
+      }
+      merged->Merge(&others_list);
+      output_dir.WriteObject(merged.get(), name.c_str(), "Overwrite");
+    } else {
+      Warning(__func__, "'%s' of class '%s' is not a correlation, copying from the first input",
+              name.c_str(), key->GetClassName());
+      std::unique_ptr<TObject> copy(key->ReadObj());
+      output_dir.WriteTObject(copy.get(), name.c_str(), "Overwrite");
+    }
+  }
+}
+
+CorrelationRunMeta CorrelationMerger::ReadMeta(TDirectory &dir) {
+  std::unique_ptr<TObjString> meta_string(dir.Get<TObjString>(CORRELATION_META_NAME));
+  if (!meta_string) {
+    throw incompatible_inputs(std::string("No ") + CORRELATION_META_NAME + " in '" + dir.GetPath() + "'");
+  }
+  return YAML::Load(meta_string->GetString().Data()).as<CorrelationRunMeta>();
+}
+
+void CorrelationMerger::WriteMeta(TDirectory &dir, const CorrelationRunMeta &meta) {
+  YAML::Node node;
+  node = meta;
+  TObjString meta_string(YAML::Dump(node).c_str());
+  dir.WriteTObject(&meta_string, CORRELATION_META_NAME, "Overwrite");
+}
+
+CorrelationRunMeta CorrelationMerger::MergeMeta(const std::vector<CorrelationRunMeta> &metas) {
+  CorrelationRunMeta result = metas.front();
+  result.shards.clear();
+  result.ledger.clear();
+  const bool has_entry_ranges = std::any_of(metas.begin(), metas.end(), [](const CorrelationRunMeta &meta) {
+    return meta.HasEntryRange();
+  });
+  /* entry ranges of each input and file shard */
+  std::map<std::tuple<std::string, unsigned int, unsigned int>, std::vector<std::pair<long long, long long>>> ranges;
+  std::map<std::string, unsigned int> file_shard_counts;
+  std::set<std::string> processed_files;
+  for (auto &meta : metas) {
+    if (!meta.IsCompatible(result)) {
+      throw incompatible_inputs("Inputs are produced with different configuration, number of samples, seed or resampler version");
+    }
+    /* files are processed partially by entry-range shards, only shards are checked */
+    const bool check_files = !meta.HasEntryRange();
+    for (auto &shard : meta.shards) {
+      if (has_entry_ranges) {
+        /* entries of the chains with different file sharding can't be compared */
+        auto count_it = file_shard_counts.emplace(shard.input_file, shard.file_shard_count).first;
+        if (count_it->second != shard.file_shard_count) {
+          throw incompatible_inputs("Entry-range shards of '" + shard.input_file + "' use different --file-shard-count");
+        }
+        ranges[{shard.input_file, shard.file_shard_index, shard.file_shard_count}].emplace_back(shard.EntryRange());
+      }
+      result.shards.emplace_back(shard);
+    }
+    for (auto &file : meta.ledger) {
+      if (check_files && !processed_files.emplace(file.path).second) {
+        throw incompatible_inputs("File '" + file.path + "' is merged twice");
+      }
+      result.ledger.emplace_back(file);
+    }
+  }
+  for (auto &[shard_key, shard_ranges] : ranges) {
+    std::sort(shard_ranges.begin(), shard_ranges.end());
+    for (std::size_t i = 1; i < shard_ranges.size(); ++i) {
+      if (shard_ranges[i].first < shard_ranges[i - 1].second) {
+        throw incompatible_inputs("Entry ranges of '" + std::get<0>(shard_key) + "' starting at "
+                                      + std::to_string(shard_ranges[i - 1].first) + " and "
+                                      + std::to_string(shard_ranges[i].first) + " overlap");
+      }
+    }
+  }
+  return result;
+}
@@ -0,0 +1,66 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONMERGER_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONMERGER_HPP
+
+#include <string>
+#include <vector>
+
+#include <TDirectory.h>
+#include <boost/program_options.hpp>
+
+#include "CorrelationMeta.hpp"
+
+namespace Qn::Analysis::Correlate {
+
+/**
+ * @brief Merges outputs of QnAnalysisCorrelate run over disjoint parts of the input.
+ *
+ * Correlation containers are merged bin-by-bin and sample-by-sample,
+ * bootstrap samples are aligned since multiplicities depend on (seed, global entry) only.
+ * Outputs are accepted only if configuration, number of samples and seed are identical.
+ */
+class CorrelationMerger {
+
+ public:
+  struct incompatible_inputs : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+
+  boost::program_options::options_description GetBoostOptions();
+
+  boost::program_options::positional_options_description GetPositionalOptions();
+
+  void Run();
+
+  /**
+   * @brief Merges input files to the output file
+   * @param input_files outputs of QnAnalysisCorrelate
+   * @param output_file
+   * @param mode mode to open output file (RECREATE, UPDATE...)
+   */
+  static void Merge(const std::vector<std::string> &input_files,
+                    const std::string &output_file,
+                    const std::string &mode = "RECREATE");
+
+  /**
+   * @brief Merges directories recursively into the output directory
+   */
+  static void MergeDirectories(TDirectory &output_dir, const std::vector<TDirectory *> &input_dirs);
+
+  static CorrelationRunMeta ReadMeta(TDirectory &dir);
+
+  static void WriteMeta(TDirectory &dir, const CorrelationRunMeta &meta);
+
+  /**
+   * @brief Checks that runs are compatible and do not process the same shard twice
+   * @return meta of the merged output
+   */
+  static CorrelationRunMeta MergeMeta(const std::vector<CorrelationRunMeta> &metas);
+
+ private:
+  std::vector<std::string> input_files_;
+  std::string output_file_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONMERGER_HPP
@@ -0,0 +1,201 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONMETA_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONMETA_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+namespace Qn::Analysis::Correlate {
+
+/* Name of the TObjString with run meta in the output file */
+constexpr const char *CORRELATION_META_NAME = "correlation_meta";
+
+/**
+ * @brief Part of the input processed by a single run
+ */
+struct CorrelationShard {
+  std::string input_file;
+  /* entry range in the chain of all input files, n_entries < 0 - till the end */
+  long long first_entry{0};
+  long long n_entries{-1};
+  /* file-index sharding: files with (index % file_shard_count == file_shard_index) */
+  unsigned int file_shard_index{0};
+  unsigned int file_shard_count{1};
+
+  /**
+   * @brief [first, last) entries of the chain of the file shard, last is the maximum value if till the end
+   */
+  [[nodiscard]] std::pair<long long, long long> EntryRange() const {
+    return {first_entry, n_entries >= 0 ? first_entry + n_entries : std::numeric_limits<long long>::max()};
+  }
+};
+
+/**
+ * @brief Entry of the ledger of processed input files
+ */
+struct ProcessedFile {
+  std::string path;
+  /* checksum of the file identity (ROOT UUID and size), changes if file is rewritten */
+  std::string checksum;
+  long long n_entries{0};
+  /* entry of the first event in the chain of all input files (seeds its bootstrap multiplicities), -1 - unknown */
+  long long first_entry{-1};
+
+  [[nodiscard]] bool Overlaps(long long first, long long n) const {
+    return first_entry >= 0 && first < first_entry + n_entries && first_entry < first + n;
+  }
+};
+
+/**
+ * @brief Everything what must be identical for outputs to be merged
+ */
+struct CorrelationRunMeta {
+  std::string configuration_name;
+  std::string config_hash;
+  int n_samples{0};
+  std::uint64_t seed{0};
+  std::vector<CorrelationShard> shards;
+  std::vector<ProcessedFile> ledger;
+  /* number of samples of each task chosen by --adaptive-samples, empty - n_samples for all tasks */
+  std::vector<int> task_n_samples;
+  /* fraction of events selected in preview runs, 1 - all events */
+  double sampling_fraction{1.};
+  /* Bootstrap::Resampler::VERSION, 0 - outputs written before it was recorded */
+  int resampler_version{0};
+
+  [[nodiscard]] bool IsPreview() const { return sampling_fraction < 1.; }
+
+  [[nodiscard]] bool HasEntryRange() const {
+    return std::any_of(shards.begin(), shards.end(), [](const CorrelationShard &s) {
+      return s.first_entry > 0 || s.n_entries >= 0;
+    });
+  }
+
+  [[nodiscard]] const ProcessedFile *FindInLedger(const std::string &path) const {
+    auto it = std::find_if(ledger.begin(), ledger.end(), [&path](const ProcessedFile &f) { return f.path == path; });
+    return it == ledger.end() ? nullptr : &(*it);
+  }
+
+  [[nodiscard]] bool IsCompatible(const CorrelationRunMeta &other) const {
+    return config_hash == other.config_hash &&
+        n_samples == other.n_samples &&
+        seed == other.seed &&
+        task_n_samples == other.task_n_samples &&
+        sampling_fraction == other.sampling_fraction &&
+        resampler_version == other.resampler_version;
+  }
+};
+
+/**
+ * @brief FNV-1a, stable across platforms and runs unlike std::hash
+ */
+inline std::string HashString(const std::string &str) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto c : str) {
+    hash ^= std::uint64_t(static_cast<unsigned char>(c));
+    hash *= 0x100000001b3ULL;
+  }
+  std::stringstream stream;
+  stream << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return stream.str();
+}
+
+}
+
+namespace YAML {
+
+template<>
+struct convert<Qn::Analysis::Correlate::CorrelationShard> {
+  static Node encode(const Qn::Analysis::Correlate::CorrelationShard &shard) {
+    Node node;
+    node["input-file"] = shard.input_file;
+    node["first-entry"] = shard.first_entry;
+    node["n-entries"] = shard.n_entries;
+    node["file-shard-index"] = shard.file_shard_index;
+    node["file-shard-count"] = shard.file_shard_count;
+    return node;
+  }
+
+  static bool decode(const Node &node, Qn::Analysis::Correlate::CorrelationShard &shard) {
+    if (!node.IsMap()) {
+      return false;
+    }
+    shard.input_file = node["input-file"].as<std::string>("");
+    shard.first_entry = node["first-entry"].as<long long>(0);
+    shard.n_entries = node["n-entries"].as<long long>(-1);
+    shard.file_shard_index = node["file-shard-index"].as<unsigned int>(0);
+    shard.file_shard_count = node["file-shard-count"].as<unsigned int>(1);
+    return true;
+  }
+};
+
+template<>
+struct convert<Qn::Analysis::Correlate::ProcessedFile> {
+  static Node encode(const Qn::Analysis::Correlate::ProcessedFile &file) {
+    Node node;
+    node["path"] = file.path;
+    node["checksum"] = file.checksum;
+    node["n-entries"] = file.n_entries;
+    node["first-entry"] = file.first_entry;
+    return node;
+  }
+
+  static bool decode(const Node &node, Qn::Analysis::Correlate::ProcessedFile &file) {
+    if (!node.IsMap()) {
+      return false;
+    }
+    file.path = node["path"].as<std::string>();
+    file.checksum = node["checksum"].as<std::string>("");
+    file.n_entries = node["n-entries"].as<long long>(0);
+    file.first_entry = node["first-entry"].as<long long>(-1);
+    return true;
+  }
+};
+
+template<>
+struct convert<Qn::Analysis::Correlate::CorrelationRunMeta> {
+  static Node encode(const Qn::Analysis::Correlate::CorrelationRunMeta &meta) {
+    Node node;
+    node["configuration-name"] = meta.configuration_name;
+    node["config-hash"] = meta.config_hash;
+    node["n-samples"] = meta.n_samples;
+    node["seed"] = meta.seed;
+    node["shards"] = meta.shards;
+    node["ledger"] = meta.ledger;
+    node["task-n-samples"] = meta.task_n_samples;
+    node["resampler-version"] = meta.resampler_version;
+    if (meta.IsPreview()) {
+      node["preview"] = true;
+      node["sampling-fraction"] = meta.sampling_fraction;
+    }
+    return node;
+  }
+
+  static bool decode(const Node &node, Qn::Analysis::Correlate::CorrelationRunMeta &meta) {
+    using namespace Qn::Analysis::Correlate;
+    if (!node.IsMap()) {
+      return false;
+    }
+    meta.configuration_name = node["configuration-name"].as<std::string>("");
+    meta.config_hash = node["config-hash"].as<std::string>();
+    meta.n_samples = node["n-samples"].as<int>();
+    meta.seed = node["seed"].as<std::uint64_t>();
+    meta.shards = node["shards"].as<std::vector<CorrelationShard>>(std::vector<CorrelationShard>{});
+    meta.ledger = node["ledger"].as<std::vector<ProcessedFile>>(std::vector<ProcessedFile>{});
+    meta.task_n_samples = node["task-n-samples"].as<std::vector<int>>(std::vector<int>{});
+    meta.sampling_fraction = node["sampling-fraction"].as<double>(1.);
+    meta.resampler_version = node["resampler-version"].as<int>(0);
+    return true;
+  }
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONMETA_HPP
@@ -0,0 +1,259 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONPLANNER_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONPLANNER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Config.hpp"
+
+namespace Qn::Analysis::Correlate::Planner {
+
+/* Approximate in-memory size of Qn::StatCollect without bootstrap samples */
+constexpr std::size_t STATISTIC_BYTES = 96;
+/* Approximate in-memory size of a single bootstrap sample accumulator */
+constexpr std::size_t SAMPLE_BYTES = 24;
+/* Bootstrap::ConvergenceAccumulator of the pilot: entry counter per bin, sum of weights and of weighted values per sample */
+constexpr std::size_t PILOT_BIN_BYTES = 8;
+constexpr std::size_t PILOT_SAMPLE_BYTES = 16;
+
+struct CorrelationEstimate {
+  std::string name;
+  std::size_t arity{0};
+  /* number of combinations of input bins filled for every event */
+  std::size_t n_input_bins{1};
+};
+
+struct TaskEstimate {
+  std::string output_folder;
+  std::size_t n_event_bins{1};
+  /* cumulant tasks are not processed by the pilot */
+  bool has_pilot{true};
+  std::vector<CorrelationEstimate> correlations;
+
+  [[nodiscard]] std::size_t NBins() const {
+    std::size_t result = 0;
+    for (auto &c : correlations) {
+      result += n_event_bins * c.n_input_bins;
+    }
+    return result;
+  }
+
+  /* accumulators of all slots */
+  [[nodiscard]] std::size_t MemoryBytes(std::size_t n_samples, std::size_t n_slots = 1) const;
+  /* pilot accumulators of all slots, 0 if the task is not processed by the pilot */
+  [[nodiscard]] std::size_t PilotMemoryBytes(std::size_t n_samples, std::size_t n_slots = 1) const;
+
+  /* Number of accumulator updates per accepted event, proxy for per-event CPU cost */
+  [[nodiscard]] std::size_t UpdatesPerEvent(std::size_t n_samples) const {
+    std::size_t result = 0;
+    for (auto &c : correlations) {
+      result += c.n_input_bins * (c.arity + 1 + n_samples);
+    }
+    return result;
+  }
+};
+
+inline std::size_t NBins(const AxisConfig &axis) {
+  if (axis.type == AxisConfig::RANGE) {
+    return std::size_t(axis.nb);
+  } else if (axis.type == AxisConfig::BIN_EDGES) {
+    return axis.bin_edges.empty() ? 0 : axis.bin_edges.size() - 1;
+  }
+  __builtin_unreachable();
+}
+
+inline std::size_t NEventBins(const std::vector<AxisConfig> &axes) {
+  std::size_t result = 1;
+  for (auto &axis : axes) {
+    result *= NBins(axis);
+  }
+  return result;
+}
+
+inline std::size_t AccumulatorBytes(std::size_t n_bins, std::size_t n_samples) {
+  return n_bins * (STATISTIC_BYTES + n_samples * SAMPLE_BYTES);
+}
+
+inline std::size_t PilotAccumulatorBytes(std::size_t n_bins, std::size_t n_samples) {
+  return n_bins * (PILOT_BIN_BYTES + n_samples * PILOT_SAMPLE_BYTES);
+}
+
+inline std::size_t TaskEstimate::MemoryBytes(std::size_t n_samples, std::size_t n_slots) const {
+  return n_slots * AccumulatorBytes(NBins(), n_samples);
+}
+
+inline std::size_t TaskEstimate::PilotMemoryBytes(std::size_t n_samples, std::size_t n_slots) const {
+  return has_pilot ? n_slots * PilotAccumulatorBytes(NBins(), n_samples) : 0;
+}
+
+inline std::size_t TotalMemoryBytes(const std::vector<TaskEstimate> &tasks, std::size_t n_samples, std::size_t n_slots = 1) {
+  return std::accumulate(tasks.begin(), tasks.end(), std::size_t(0),
+                         [=](std::size_t acc, const TaskEstimate &t) { return acc + t.MemoryBytes(n_samples, n_slots); });
+}
+
+/**
+ * @brief Memory of the pilot run over all tasks at once.
+ * Pilot accumulators are freed before the tasks are booked, the peak is the larger of the two.
+ */
+inline std::size_t TotalPilotMemoryBytes(const std::vector<TaskEstimate> &tasks, std::size_t n_samples, std::size_t n_slots = 1) {
+  return std::accumulate(tasks.begin(), tasks.end(), std::size_t(0),
+                         [=](std::size_t acc, const TaskEstimate &t) { return acc + t.PilotMemoryBytes(n_samples, n_slots); });
+}
+
+namespace Details {
+
+template<typename BytesFunction>
+std::vector<std::vector<std::size_t>> SplitByBytes(const std::vector<TaskEstimate> &tasks,
+                                                   std::size_t budget_bytes,
+                                                   BytesFunction &&bytes) {
+  std::vector<std::vector<std::size_t>> result;
+  std::size_t group_bytes = 0;
+  for (std::size_t i = 0; i < tasks.size(); ++i) {
+    auto task_bytes = bytes(tasks[i]);
+    if (result.empty() || group_bytes + task_bytes > budget_bytes) {
+      result.emplace_back();
+      group_bytes = 0;
+    }
+    result.back().push_back(i);
+    group_bytes += task_bytes;
+  }
+  return result;
+}
+
+}
+
+/**
+ * @brief Greedy split of tasks into groups (in the order of configuration) fitting the budget.
+ * A task larger than the budget forms its own group.
+ * @return indices of tasks per group
+ */
+inline std::vector<std::vector<std::size_t>> SplitTasks(const std::vector<TaskEstimate> &tasks,
+                                                        std::size_t n_samples,
+                                                        std::size_t budget_bytes,
+                                                        std::size_t n_slots = 1) {
+  return Details::SplitByBytes(tasks, budget_bytes, [=](const TaskEstimate &t) {
+    return t.MemoryBytes(n_samples, n_slots);
+  });
+}
+
+/**
+ * @brief Same as SplitTasks() for the pilot accumulators, tasks without the pilot are left out.
+ * Each group is a separate pass of the pilot over its entries.
+ */
+inline std::vector<std::vector<std::size_t>> SplitPilotTasks(const std::vector<TaskEstimate> &tasks,
+                                                             std::size_t n_samples,
+                                                             std::size_t budget_bytes,
+                                                             std::size_t n_slots = 1) {
+  auto groups = Details::SplitByBytes(tasks, budget_bytes, [=](const TaskEstimate &t) {
+    return t.PilotMemoryBytes(n_samples, n_slots);
+  });
+  std::vector<std::vector<std::size_t>> result;
+  for (auto &group : groups) {
+    group.erase(std::remove_if(group.begin(), group.end(), [&tasks](std::size_t i) { return !tasks[i].has_pilot; }),
+                group.end());
+    if (!group.empty()) {
+      result.emplace_back(std::move(group));
+    }
+  }
+  return result;
+}
+
+inline std::string FormatBytes(double bytes) {
+  const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+  int i_unit = 0;
+  while (bytes >= 1024. && i_unit < 4) {
+    bytes /= 1024.;
+    ++i_unit;
+  }
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.1f %s", bytes, units[i_unit]);
+  return buffer;
+}
+
+inline void PrintPlan(std::ostream &os, const std::vector<TaskEstimate> &tasks, std::size_t n_samples, std::size_t n_slots = 1) {
+  std::size_t total_correlations = 0;
+  std::size_t total_updates = 0;
+  os << "Correlation plan (n-samples = " << n_samples << ", slots = " << n_slots << ")" << std::endl;
+  for (std::size_t i = 0; i < tasks.size(); ++i) {
+    auto &t = tasks[i];
+    os << "  task " << i << " '" << t.output_folder << "': "
+       << t.correlations.size() << " correlations, "
+       << t.n_event_bins << " event bins, "
+       << t.NBins() << " bins total, "
+       << FormatBytes(double(t.MemoryBytes(n_samples, n_slots))) << ", "
+       << t.UpdatesPerEvent(n_samples) << " updates/event" << std::endl;
+    total_correlations += t.correlations.size();
+    total_updates += t.UpdatesPerEvent(n_samples);
+  }
+  os << "Total: " << tasks.size() << " tasks, "
+     << total_correlations << " correlations, "
+     << FormatBytes(double(TotalMemoryBytes(tasks, n_samples, n_slots))) << ", "
+     << total_updates << " updates/event" << std::endl;
+}
+
+/**
+ * @brief Accumulators actually allocated during the event loop with sparse storage
+ */
+struct AccumulatorUsage {
+  std::size_t n_bins{0};
+  /* bins with allocated samples, summed over slots */
+  std::size_t n_allocated_bins{0};
+  std::size_t n_samples{0};
+
+  [[nodiscard]] std::size_t DenseBytes(std::size_t n_slots) const {
+    return n_slots * AccumulatorBytes(n_bins, n_samples);
+  }
+
+  [[nodiscard]] std::size_t AllocatedBytes(std::size_t n_slots) const {
+    return n_slots * n_bins * STATISTIC_BYTES + n_allocated_bins * n_samples * SAMPLE_BYTES;
+  }
+};
+
+/**
+ * @brief Collects usage of the correlations per task and compares it with the dense storage
+ */
+class AccumulatorReport {
+ public:
+  void Add(const std::string &output_folder, std::size_t n_bins, std::size_t n_allocated_bins, std::size_t n_samples) {
+    if (tasks_.empty() || tasks_.back().first != output_folder) {
+      tasks_.emplace_back(output_folder, std::vector<AccumulatorUsage>{});
+    }
+    tasks_.back().second.push_back({n_bins, n_allocated_bins, n_samples});
+  }
+
+  void Print(std::ostream &os, std::size_t n_slots) const {
+    std::size_t total_dense = 0;
+    std::size_t total_allocated = 0;
+    os << "Accumulator memory (allocated / dense, slots = " << n_slots << ")" << std::endl;
+    for (auto &task : tasks_) {
+      std::size_t dense = 0;
+      std::size_t allocated = 0;
+      for (auto &usage : task.second) {
+        dense += usage.DenseBytes(n_slots);
+        allocated += usage.AllocatedBytes(n_slots);
+      }
+      os << "  '" << task.first << "': " << FormatBytes(double(allocated)) << " / " << FormatBytes(double(dense))
+         << std::endl;
+      total_dense += dense;
+      total_allocated += allocated;
+    }
+    os << "Total: " << FormatBytes(double(total_allocated)) << " / " << FormatBytes(double(total_dense));
+    if (total_dense > 0) {
+      os << " (" << std::lround(100. * double(total_allocated) / double(total_dense)) << "%)";
+    }
+    os << std::endl;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::vector<AccumulatorUsage>>> tasks_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_CORRELATIONPLANNER_HPP
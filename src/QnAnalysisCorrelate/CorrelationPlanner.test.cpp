@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "CorrelationPlanner.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate;
+using namespace Qn::Analysis::Correlate::Planner;
+
+TaskEstimate MakeTask(std::size_t n_correlations, std::size_t n_event_bins, std::size_t n_input_bins) {
+  TaskEstimate t;
+  t.n_event_bins = n_event_bins;
+  for (std::size_t i = 0; i < n_correlations; ++i) {
+    t.correlations.push_back({"c" + std::to_string(i), 2, n_input_bins});
+  }
+  return t;
+}
+
+TEST(Planner, NEventBins) {
+  AxisConfig range;
+  range.type = AxisConfig::RANGE;
+  range.nb = 10;
+  AxisConfig edges;
+  edges.type = AxisConfig::BIN_EDGES;
+  edges.bin_edges = {0., 10., 25., 45., 80.};
+
+  EXPECT_EQ(NEventBins({}), 1);
+  EXPECT_EQ(NEventBins({range}), 10);
+  EXPECT_EQ(NEventBins({range, edges}), 40);
+}
+
+TEST(Planner, Memory) {
+  auto t = MakeTask(4, 10, 5);
+  EXPECT_EQ(t.NBins(), 4 * 10 * 5);
+  EXPECT_EQ(t.MemoryBytes(50), 200 * (STATISTIC_BYTES + 50 * SAMPLE_BYTES));
+  EXPECT_EQ(t.MemoryBytes(50, 4), 4 * t.MemoryBytes(50));
+  EXPECT_EQ(TotalMemoryBytes({t, t}, 50), 2 * t.MemoryBytes(50));
+}
+
+TEST(Planner, PilotMemory) {
+  auto t = MakeTask(4, 10, 5);
+  EXPECT_EQ(t.PilotMemoryBytes(50), 200 * (PILOT_BIN_BYTES + 50 * PILOT_SAMPLE_BYTES));
+  EXPECT_EQ(t.PilotMemoryBytes(50, 4), 4 * t.PilotMemoryBytes(50));
+  auto cumulant = t;
+  cumulant.has_pilot = false;
+  EXPECT_EQ(cumulant.PilotMemoryBytes(50, 4), 0);
+  EXPECT_EQ(TotalPilotMemoryBytes({t, cumulant}, 50, 2), t.PilotMemoryBytes(50, 2));
+}
+
+TEST(Planner, SplitTasks) {
+  auto small = MakeTask(1, 10, 1);
+  auto large = MakeTask(100, 10, 1);
+  const auto budget = small.MemoryBytes(10) * 2;
+
+  auto groups = SplitTasks({small, small, small, large, small}, 10, budget);
+  ASSERT_EQ(groups.size(), 4);
+  EXPECT_EQ(groups[0], std::vector<std::size_t>({0, 1}));
+  EXPECT_EQ(groups[1], std::vector<std::size_t>({2}));
+  EXPECT_EQ(groups[2], std::vector<std::size_t>({3}));
+  EXPECT_EQ(groups[3], std::vector<std::size_t>({4}));
+}
+
+TEST(Planner, SplitPilotTasks) {
+  auto small = MakeTask(1, 10, 1);
+  auto cumulant = MakeTask(100, 10, 1);
+  cumulant.has_pilot = false;
+  const auto budget = small.PilotMemoryBytes(10) * 2;
+
+  auto groups = SplitPilotTasks({small, cumulant, small, small}, 10, budget);
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_EQ(groups[0], std::vector<std::size_t>({0, 2}));
+  EXPECT_EQ(groups[1], std::vector<std::size_t>({3}));
+}
+
+TEST(Planner, PrintPlan) {
+  std::stringstream stream;
+  PrintPlan(stream, {MakeTask(2, 10, 3)}, 50);
+  EXPECT_NE(stream.str().find("2 correlations"), std::string::npos);
+}
+
+TEST(Planner, AccumulatorReport) {
+  AccumulatorUsage usage{100, 20, 50};
+  EXPECT_EQ(usage.DenseBytes(2), AccumulatorBytes(100, 50) * 2);
+  EXPECT_EQ(usage.AllocatedBytes(2), 200 * STATISTIC_BYTES + 20 * 50 * SAMPLE_BYTES);
+  EXPECT_EQ((AccumulatorUsage{100, 200, 50}.AllocatedBytes(2)), usage.DenseBytes(2));
+
+  AccumulatorReport report;
+  report.Add("a", 100, 200, 50);
+  report.Add("a", 100, 200, 50);
+  report.Add("b", 10, 0, 50);
+  std::stringstream stream;
+  report.Print(stream, 2);
+  EXPECT_NE(stream.str().find("'a'"), std::string::npos);
+  EXPECT_NE(stream.str().find("'b'"), std::string::npos);
+  EXPECT_NE(stream.str().find("Total"), std::string::npos);
+}
+
+}
@@ -9,10 +9,26 @@
 #include "Utils.hpp"
 
 #include <QnDataFrame.hpp>
+#include <Compression.h>
 #include <TFileCollection.h>
 #include <TChain.h>
 #include <TDirectory.h>
 #include <TObjString.h>
+#include <TTreeReader.h>
+#include <TTreeReaderValue.h>
+#include <TBranch.h>
+#include <TFileInfo.h>
+#include <TUrl.h>
+
+#include "CorrelationMerger.hpp"
+#include "ImplicitMT.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <list>
+#include <set>
 
 using fs::path;
 using fs::current_path;
@@ -29,49 +45,721 @@ boost::program_options::options_description Qn::Analysis::Correlate::Correlation
       ("input-file,i", value(&input_file_name_)->required(), "Name of the input ROOT file (or .list file)")
       ("input-tree,i", value(&input_tree_)->default_value("tree"), "Name of the input tree")
       ("output-file,o", value(&output_file_)->required(), "Name of the output ROOT file")
-      ("n-samples", value(&n_samples_)->default_value(50), "Number of bootstrap samples");
+      ("n-samples", value(&n_samples_)->default_value(50), "Number of bootstrap samples")
+      ("prune-branches", value(&prune_branches_)->default_value(true),
+       "Read only branches referenced by the configuration")
+      ("plan", bool_switch(&plan_only_), "Print expanded tasks with estimated memory and per-event cost, then exit")
+      ("memory-budget", value(&memory_budget_mb_)->default_value(0.),
+       "Refuse to start if estimated accumulator memory (MB) exceeds the budget, 0 - no limit")
+      ("seed", value(&seed_)->default_value(0), "Seed of the bootstrap resampling")
+      ("first-entry", value(&shard_.first_entry)->default_value(0), "First entry of the input chain to process")
+      ("n-entries", value(&shard_.n_entries)->default_value(-1), "Number of entries to process, -1 - till the end")
+      ("file-shard-index", value(&shard_.file_shard_index)->default_value(0),
+       "Process only input files with (index % file-shard-count == file-shard-index)")
+      ("file-shard-count", value(&shard_.file_shard_count)->default_value(1), "Number of file shards")
+      ("update", bool_switch(&update_),
+       "Process only input files missing in the ledger of the existing output and merge them into it")
+      ("progress-interval", value(&progress_interval_)->default_value(30.),
+       "Seconds between progress reports of the event loop, 0 - no reports")
+      ("summary-file", value(&summary_file_)->default_value(""),
+       "Write JSON summary of the run (phase timings, throughput, peak RSS) to this file")
+      ("adaptive-samples", bool_switch(&adaptive_samples_),
+       "Choose number of samples per task from the pilot run, --n-samples is the maximum")
+      ("pilot-entries", value(&pilot_entries_)->default_value(100000),
+       "Number of entries of the pilot run for --adaptive-samples")
+      ("samples-precision", value(&samples_precision_)->default_value(0.1),
+       "Relative deviation of the bootstrap error from the one with --n-samples, allowed by --adaptive-samples")
+      ("pilot-min-entries", value(&pilot_min_entries_)->default_value(100),
+       "Bins with less entries in the pilot are ignored by --adaptive-samples")
+      ("pilot-candidates", value(&pilot_candidates_)->multitoken()
+           ->default_value(std::vector<std::size_t>{10, 20, 30, 50, 75, 100, 150, 200, 300, 500, 1000},
+                           "10 20 30 50 75 100 150 200 300 500 1000"),
+       "Numbers of samples tried by --adaptive-samples in increasing order")
+      ("skim", bool_switch(&skim_),
+       "Write Q-vectors and event variables used by the configuration to the reduced tree in --output-file "
+       "instead of correlations, later runs detect the skim in --input-file")
+      ("skim-compression", value(&skim_compression_)->default_value(Skim::DEFAULT_COMPRESSION),
+       "ROOT compression setting of the skim (algorithm * 100 + level)")
+      ("background-writer", bool_switch(&background_writer_),
+       "Write results on a separate thread while the next ones are released from the data frame")
+      ("sparse-accumulators", bool_switch(&sparse_accumulators_),
+       "Allocate bootstrap samples of an event bin only when the bin is filled, "
+       "saves memory with many sparsely populated bins")
+      ("fraction", value(&fraction_)->default_value(1.),
+       "Preview: process this fraction of events selected by the hash of the entry and --seed")
+      ("max-events", value(&max_events_)->default_value(0),
+       "Preview: process about this number of events of the whole input, selected as with --fraction, 0 - no limit")
+      ("preview-n-samples", value(&preview_n_samples_)->default_value(10),
+       "Number of bootstrap samples in preview (--fraction or --max-events), replaces --n-samples")
+      ("friend-file", value(&friend_file_name_)->default_value(""),
+       "Original AnalysisTree file (or .list file), event variables absent in the input are read from its event headers")
+      ("friend-tree", value(&friend_tree_name_)->default_value("rTree"), "Name of the AnalysisTree tree")
+      ("friend-index", value(&friend_index_)->default_value(""),
+       "Join with the friend by the value of this event variable present in both trees instead of the entry number")
+      ("jit-kernels", bool_switch(&jit_kernels_),
+       "Compile correlation kernels with constant components and harmonics at startup")
+      ("jit-cache-dir", value(&jit_cache_dir_)->default_value(".qnanalysis_jit"),
+       "Directory with compiled kernels, reused by runs with the same configuration");
 
   return desc;
 }
 
 void Qn::Analysis::Correlate::CorrelationTaskRunner::Initialize() {
-  df_ = GetRDF();
-  df_sampled_ = new ROOT::RDF::RInterface<ROOT::Detail::RDF::RLoopManager>(Qn::Correlation::Resample(*df_, n_samples_));
+  Monitor::ScopedPhase phase(summary_, "initialization");
+  if (shard_.first_entry < 0 || shard_.n_entries == 0 || shard_.n_entries < -1) {
+    throw std::runtime_error("--first-entry must not be negative, --n-entries must be positive or -1");
+  }
+  if (adaptive_samples_) {
+    if (pilot_candidates_.empty() || std::count(pilot_candidates_.begin(), pilot_candidates_.end(), 0) > 0) {
+      throw std::runtime_error("--pilot-candidates must be a non-empty list of positive numbers");
+    }
+    std::sort(pilot_candidates_.begin(), pilot_candidates_.end());
+  }
+  /* configuration is needed before the data frame to know which branches to read */
   LookupConfiguration();
+  DetectSkim();
+  if (!friend_file_name_.empty()) {
+    SetupFriend();
+  } else if (!friend_index_.empty()) {
+    throw std::runtime_error("--friend-index requires --friend-file");
+  }
+  if (IsPreview()) {
+    if (!(fraction_ > 0. && fraction_ <= 1.) || max_events_ < 0) {
+      throw std::runtime_error("--fraction must be in (0, 1], --max-events must not be negative");
+    }
+    if (update_ || skim_) {
+      throw std::runtime_error("--fraction and --max-events cannot be combined with --update or --skim");
+    }
+    n_samples_ = preview_n_samples_;
+  }
+  if (IsEntryNumberNeeded() && ROOT::IsImplicitMTEnabled()) {
+    /* with implicit multi-threading rdfentry_ counts entries in the processing order, not in the input chain */
+    Info(__func__, "Disabling implicit multi-threading, bootstrap samples of shards, previews and updates "
+                   "and the friend joined by number depend on the entry in the chain of all input files");
+    ROOT::DisableImplicitMT();
+  }
+  if (skim_) {
+    if (update_ || shard_.file_shard_count > 1 || shard_.first_entry > 0 || shard_.n_entries >= 0) {
+      throw std::runtime_error("--skim processes the whole input, it cannot be combined with --update or sharding");
+    }
+    if (ROOT::IsImplicitMTEnabled()) {
+      /* multi-thread snapshot does not keep the order of entries, bootstrap samples depend on it */
+      Info(__func__, "Disabling implicit multi-threading to keep the order of entries in the skim");
+      ROOT::DisableImplicitMT();
+    }
+    df_ = GetRDF();
+    PrepareFriend();
+    return;
+  }
+  if (update_) {
+    PrepareUpdate();
+  }
+  if (plan_only_ || memory_budget_mb_ > 0.) {
+    CheckPlan(MakePlan());
+    if (plan_only_) {
+      return;
+    }
+  }
+  df_ = GetRDF();
+  PrepareFriend();
+  if (IsPreview()) {
+    /* the same fraction for all shards, --max-events refers to the whole input */
+    sampling_fraction_ = fraction_;
+    if (max_events_ > 0 && n_input_entries_ > 0) {
+      sampling_fraction_ = std::min(sampling_fraction_, double(max_events_) / double(n_input_entries_));
+    }
+    Info(__func__, "Preview: selecting %.4g of %lld entries with %d samples",
+         sampling_fraction_, n_input_entries_, n_samples_);
+  }
+  if (previous_meta_ && ledger_.empty()) {
+    Info(__func__, "No new input files since the previous run, nothing to update");
+    return;
+  }
+  df_sampled_ = std::make_unique<ROOT::RDF::RNode>(GetSampledRDF(*df_));
+  if (jit_kernels_) {
+    CompileKernels();
+  }
+  if (IsPilotNeeded()) {
+    RunPilot();
+  }
   InitializeTasks();
+  BookProgress();
+}
+
+void CorrelationTaskRunner::BookProgress() {
+  auto n_events_total = ULong64_t(input_chain_->GetEntries());
+  if (shard_.first_entry > 0 || shard_.n_entries >= 0) {
+    const auto first_entry = std::min(ULong64_t(shard_.first_entry), n_events_total);
+    n_events_total -= first_entry;
+    if (shard_.n_entries >= 0) {
+      n_events_total = std::min(n_events_total, ULong64_t(shard_.n_entries));
+    }
+  }
+
+  n_events_total = ULong64_t(double(n_events_total) * sampling_fraction_);
+
+  progress_monitor_ = std::make_shared<Monitor::ProgressMonitor>(df_->GetNSlots(), n_events_total, progress_interval_);
+  n_events_processed_ = df_sampled_->Count();
+
+  /* executed once after JIT, right before the first event */
+  n_events_processed_.OnPartialResult(decltype(n_events_processed_)::kOnce, [this](ULong64_t &) {
+    event_loop_start_ = Monitor::Clock::now();
+    progress_monitor_->Start(TFile::GetFileBytesRead());
+  });
+  auto monitor = progress_monitor_;
+  n_events_processed_.OnPartialResultSlot(Monitor::PROGRESS_CHECK_N_EVENTS,
+                                          [monitor](unsigned int slot, ULong64_t &slot_events) {
+    if (monitor->Update(slot, slot_events)) {
+      auto progress = monitor->GetProgress(TFile::GetFileBytesRead());
+      Info("Progress", "%s", Monitor::FormatProgress(progress).c_str());
+    }
+  });
+}
+
+void CorrelationTaskRunner::WriteSummary() {
+  summary_.n_events = n_events_processed_ ? *n_events_processed_ : 0;
+  summary_.bytes_read = progress_monitor_ ? progress_monitor_->GetProgress(TFile::GetFileBytesRead()).bytes_read : 0;
+  summary_.n_slots = df_ ? df_->GetNSlots() : 1;
+  summary_.n_correlations = 0;
+  for (auto &task : initialized_tasks_) {
+    summary_.n_correlations += task->correlations.size();
+  }
+  summary_.peak_rss_bytes = Monitor::PeakRSSBytes();
+
+  Info(__func__, "Total %.1f s, %llu events, peak RSS %s",
+       summary_.TotalTime(), ULong64_t(summary_.n_events),
+       Planner::FormatBytes(double(summary_.peak_rss_bytes)).c_str());
+  for (auto &phase : summary_.phases) {
+    Info(__func__, "  %-16s %.1f s", phase.first.c_str(), phase.second);
+  }
+
+  if (!summary_file_.empty()) {
+    std::ofstream summary_stream(summary_file_);
+    summary_stream << summary_.ToJSON();
+    Info(__func__, "Summary is written to '%s'", summary_file_.c_str());
+  }
+}
+
+void CorrelationTaskRunner::CompileKernels() {
+  kernel_jit_ = std::make_unique<Engine::KernelJit>(jit_cache_dir_, config_hash_);
+  for (auto &t : config_tasks_) {
+    auto use_weights = t.weight_type == EQnWeight(EQnWeight::OBSERVABLE);
+    for (auto &correlation : GetTaskCombinations(t)) {
+      if (correlation.correlator) {
+        continue;
+      }
+      try {
+        kernel_jit_->Add(BuildKernel(correlation, use_weights));
+      } catch (std::exception &e) {
+        /* reported when the correlation is booked */
+      }
+    }
+  }
+
+  if (!kernel_jit_->Compile()) {
+    Warning(__func__, "Falling back to runtime kernels");
+    kernel_jit_.reset();
+  }
 }
 
 void CorrelationTaskRunner::InitializeTasks() {
   initialized_tasks_.clear();
-  InitializeTasksImpl(std::back_inserter(initialized_tasks_),
-                      config_tasks_,
-                      make_index_range<1, MAX_ARITY>(), make_index_range<1, MAX_AXES>());
+  for (auto &t : config_tasks_) {
+    if (t.arguments.empty() || t.arguments.size() > MAX_ARITY) {
+      Warning(__func__, "Skipping task: arity %zu is not supported (max %zu)", t.arguments.size(), MAX_ARITY);
+      continue;
+    }
+    if (t.axes.empty() || t.axes.size() > MAX_AXES) {
+      Warning(__func__, "Skipping task: number of axes %zu is not supported (max %zu)", t.axes.size(), MAX_AXES);
+      continue;
+    }
+    initialized_tasks_.emplace_back(InitializeTask(t, GetTaskNSamples(t)));
+  }
+}
+
+std::shared_ptr<CorrelationTaskRunner::CorrelationTaskInitialized>
+CorrelationTaskRunner::InitializeTask(const CorrelationTask &t, std::size_t n_samples) {
+  std::vector<Qn::AxisD> axes_qn;
+  std::transform(t.axes.begin(), t.axes.end(),
+                 std::back_inserter(axes_qn), ToQnAxis);
+  Engine::EventAxes event_axes(axes_qn);
+
+  auto use_weights = t.weight_type == EQnWeight(EQnWeight::OBSERVABLE);
+
+  auto result = std::make_shared<CorrelationTaskInitialized>();
+  result->arity = t.arguments.size();
+  result->n_axes = t.axes.size();
+
+  result->output_folder = fs::path(t.output_folder);
+  if (result->output_folder.is_relative()) {
+    throw std::runtime_error("Output folder must be an absolute path");
+  }
+
+  std::string event_bin_column;
+  try {
+    event_bin_column = GetEventBinColumn(t.axes, event_axes);
+  } catch (std::exception &e) {
+    Warning(__func__, "Skipping task '%s': %s", t.output_folder.c_str(), e.what());
+    return result;
+  }
+
+  auto correlations = GetTaskCombinations(t);
+  {
+    /* read axes of all inputs of the task at once */
+    std::set<std::string> task_inputs;
+    for (auto &correlation : correlations) {
+      task_inputs.insert(correlation.argument_names.begin(), correlation.argument_names.end());
+    }
+    try {
+      GetInputAxes(std::vector<std::string>(task_inputs.begin(), task_inputs.end()));
+    } catch (std::exception &e) {
+      Warning(__func__, "Unable to read all inputs of the task at once: %s", e.what());
+    }
+  }
+
+  for (auto &correlation : correlations) {
+    try {
+      if (correlation.correlator) {
+        correlation.result_ptr = BookCumulant(correlation, event_axes, event_bin_column, n_samples);
+      } else {
+        auto kernel = BuildKernel(correlation, use_weights);
+        if (kernel_jit_) {
+          kernel.jit = kernel_jit_->Find(kernel);
+        }
+        correlation.result_ptr = BookCorrelation(correlation, kernel, event_axes, event_bin_column, n_samples);
+      }
+      result->correlations.emplace_back(correlation);
+      Info(__func__, "%s", correlation.meta_key.c_str());
+    } catch (std::exception &e) {
+      Warning(__func__, "Skipping correlation: %s", e.what());
+    }
+  }
+
+  return result;
+}
+
+std::vector<Planner::TaskEstimate> CorrelationTaskRunner::MakePlan() {
+  std::vector<Planner::TaskEstimate> result;
+  for (auto &t : config_tasks_) {
+    Planner::TaskEstimate task_estimate;
+    task_estimate.output_folder = t.output_folder;
+    task_estimate.n_event_bins = Planner::NEventBins(t.axes);
+    task_estimate.has_pilot = t.type._value != ECorrelationTaskType::CUMULANT;
+    for (auto &correlation : GetTaskCombinations(t)) {
+      Planner::CorrelationEstimate correlation_estimate;
+      correlation_estimate.name = correlation.meta_key;
+      correlation_estimate.arity = correlation.args_list.size();
+      try {
+        for (auto &input_axes : GetInputAxes(correlation.argument_names)) {
+          for (auto &axis : input_axes) {
+            correlation_estimate.n_input_bins *= axis.size();
+          }
+        }
+      } catch (std::exception &e) {
+        Warning(__func__, "Inputs of '%s' are not available: %s", correlation.meta_key.c_str(), e.what());
+        continue;
+      }
+      task_estimate.correlations.emplace_back(std::move(correlation_estimate));
+    }
+    result.emplace_back(std::move(task_estimate));
+  }
+  return result;
+}
+
+void CorrelationTaskRunner::CheckPlan(const std::vector<Planner::TaskEstimate> &plan) const {
+  using Planner::FormatBytes;
+  /* accumulators are allocated per slot of the data frame */
+  const std::size_t n_slots = ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : 1;
+  Planner::PrintPlan(std::cout, plan, n_samples_, n_slots);
+
+  const auto tasks_bytes = Planner::TotalMemoryBytes(plan, n_samples_, n_slots);
+  /* pilot runs on a single thread */
+  const auto pilot_bytes = IsPilotNeeded() ? Planner::TotalPilotMemoryBytes(plan, n_samples_) : 0;
+  if (pilot_bytes > 0) {
+    std::cout << "Pilot: " << FormatBytes(double(pilot_bytes)) << std::endl;
+  }
+
+  if (!(memory_budget_mb_ > 0.)) {
+    return;
+  }
+  const auto budget_bytes = std::size_t(memory_budget_mb_ * 1024 * 1024);
+  /* with the budget the pilot runs over groups of tasks one after another */
+  std::size_t pilot_peak_bytes = 0;
+  if (pilot_bytes > 0) {
+    for (auto &group : Planner::SplitPilotTasks(plan, n_samples_, budget_bytes)) {
+      std::size_t group_bytes = 0;
+      for (auto i_task : group) {
+        group_bytes += plan[i_task].PilotMemoryBytes(n_samples_);
+      }
+      pilot_peak_bytes = std::max(pilot_peak_bytes, group_bytes);
+    }
+  }
+  const auto total_bytes = std::max(tasks_bytes, pilot_peak_bytes);
+  if (total_bytes <= budget_bytes) {
+    Info(__func__, "Estimated memory %s is within the budget %s",
+         FormatBytes(double(total_bytes)).c_str(), FormatBytes(double(budget_bytes)).c_str());
+    return;
+  }
+
+  std::cout << "Estimated memory " << FormatBytes(double(total_bytes))
+            << " exceeds the budget " << FormatBytes(double(budget_bytes)) << std::endl;
+  if (pilot_peak_bytes > budget_bytes) {
+    std::cout << "Pilot of --adaptive-samples for a single task exceeds the budget, reduce --n-samples" << std::endl;
+  }
+  std::cout << "Suggested split of tasks into separate jobs:" << std::endl;
+  for (auto &group : Planner::SplitTasks(plan, n_samples_, budget_bytes, n_slots)) {
+    std::size_t group_bytes = 0;
+    std::cout << "  job:";
+    for (auto i_task : group) {
+      std::cout << " " << i_task;
+      group_bytes += plan[i_task].MemoryBytes(n_samples_, n_slots);
+    }
+    std::cout << " (" << FormatBytes(double(group_bytes)) << ")";
+    if (group_bytes > budget_bytes) {
+      std::cout << " - task alone exceeds the budget, reduce --n-samples or split its arguments";
+    }
+    std::cout << std::endl;
+  }
+  throw std::runtime_error("Estimated memory exceeds --memory-budget");
+}
+
+Engine::CorrelationKernel CorrelationTaskRunner::BuildKernel(const Correlation &correlation, bool use_weights) {
+  Engine::CorrelationKernel kernel;
+  kernel.arity = correlation.args_list.size();
+  kernel.use_weights = use_weights;
+  for (size_t i = 0; i < kernel.arity; ++i) {
+    kernel.components[i] = GetQVectorComponentFct(correlation.args_list[i]);
+    kernel.weights[i] = GetQVectorWeightFct(correlation.args_list[i]);
+  }
+  return kernel;
+}
+
+CorrelationTaskRunner::CorrelationResultPtr
+CorrelationTaskRunner::BookCorrelation(const Correlation &correlation,
+                                       const Engine::CorrelationKernel &kernel,
+                                       const Engine::EventAxes &event_axes,
+                                       const std::string &event_bin_column,
+                                       std::size_t n_samples) {
+  using Engine::BookCorrelation;
+  auto input_axes = GetInputAxes(correlation.argument_names);
+  const auto samples_column = GetSamplesColumn(n_samples);
+  auto &df = *df_sampled_;
+  const auto &name = correlation.meta_key;
+  const auto &inputs = correlation.argument_names;
+
+  switch (kernel.arity) {
+    case 1: return BookCorrelation<1>(df, name, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples, samples_column,
+                                      sparse_accumulators_);
+    case 2: return BookCorrelation<2>(df, name, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples, samples_column,
+                                      sparse_accumulators_);
+    case 3: return BookCorrelation<3>(df, name, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples, samples_column,
+                                      sparse_accumulators_);
+    default:
+      return BookCorrelation<Engine::DYNAMIC_ARITY>(df, name, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples, samples_column,
+                                                    sparse_accumulators_);
+  }
+}
+
+CorrelationTaskRunner::CorrelationResultPtr
+CorrelationTaskRunner::BookCumulant(const Correlation &correlation,
+                                    const Engine::EventAxes &event_axes,
+                                    const std::string &event_bin_column,
+                                    std::size_t n_samples) {
+  const auto &input_name = correlation.argument_names.front();
+  auto input_axes = GetInputAxes({input_name}).front();
+  /* QnTools returns zero for a harmonic which is not configured, the correlator would be silently wrong */
+  const auto &input_harmonics = GetInputHarmonics(input_name);
+  for (auto harmonic : correlation.correlator->RequiredHarmonics()) {
+    if (input_harmonics.count(harmonic) == 0) {
+      throw std::runtime_error("Harmonic " + std::to_string(harmonic) + " required by '" + correlation.meta_key
+                                   + "' is not configured for '" + input_name + "'");
+    }
+  }
+  const auto samples_column = GetSamplesColumn(n_samples);
+  return Engine::BookCumulant(*df_sampled_, correlation.meta_key, *correlation.correlator,
+                              event_axes, event_bin_column, input_name, input_axes, n_samples, samples_column,
+                              sparse_accumulators_);
+}
+
+std::string CorrelationTaskRunner::GetSamplesColumn(std::size_t n_samples) {
+  if (n_samples == std::size_t(n_samples_)) {
+    return "samples";
+  }
+  auto emplace_result = samples_columns_.emplace(n_samples, "samples_" + std::to_string(n_samples));
+  const auto &column_name = emplace_result.first->second;
+  if (emplace_result.second) {
+    /* multiplicities of the first samples do not depend on the total number of samples */
+    df_sampled_ = std::make_unique<ROOT::RDF::RNode>(df_sampled_->Define(column_name, [n_samples](
+        const Engine::SampleIds &samples) {
+      return Engine::SampleIds(samples.begin(), samples.begin() + n_samples);
+    }, {"samples"}));
+  }
+  return column_name;
+}
+
+std::size_t CorrelationTaskRunner::GetTaskNSamples(const CorrelationTask &t) const {
+  if (task_n_samples_.empty()) {
+    return n_samples_;
+  }
+  auto i_task = std::size_t(std::distance(config_tasks_.data(), &t));
+  return task_n_samples_.at(i_task);
+}
+
+void CorrelationTaskRunner::RunPilot() {
+  Monitor::ScopedPhase phase(summary_, "pilot");
+  /* Range is not available with implicit multi-threading, the whole pilot is built and run on a single thread
+   * with one set of accumulators. Multi-threading is restored after the pilot results are read */
+  SingleThreadScope single_thread;
+
+  /* pilot runs over the first files of all inputs, so that all shards choose the same number of samples */
+  auto pilot_chain = std::make_shared<TChain>(input_tree_.c_str(), "");
+  for (auto &file : GetInputFiles()) {
+    if (pilot_chain->GetEntries() >= pilot_entries_) {
+      break;
+    }
+    pilot_chain->Add(file.c_str());
+  }
+  if (prune_branches_) {
+    PruneBranches(*pilot_chain, GetInputBranches());
+  }
+  ROOT::RDataFrame pilot_rdf(*pilot_chain);
+  Bootstrap::Resampler resampler(n_samples_, seed_);
+  /* entries of the pilot chain are entries of the chain of all input files */
+  ROOT::RDF::RNode pilot_df = DefineFriendVariables(
+      DefineSkimVariables(pilot_rdf.Range(ULong64_t(pilot_entries_))), Bootstrap::GlobalEntryMap())
+      .Define("samples", [resampler](ULong64_t entry) {
+        return resampler.operator()<ULong64_t>(entry);
+      }, {"rdfentry_"});
+
+  /* with the budget tasks are split into groups, each is a separate pass over the pilot entries */
+  auto plan = MakePlan();
+  std::vector<std::vector<std::size_t>> groups;
+  if (memory_budget_mb_ > 0.) {
+    groups = Planner::SplitPilotTasks(plan, n_samples_, std::size_t(memory_budget_mb_ * 1024 * 1024));
+  } else {
+    groups = Planner::SplitPilotTasks(plan, n_samples_, std::numeric_limits<std::size_t>::max());
+  }
+  Info(__func__, "Pilot run over %lld entries with %d samples in %zu pass(es)",
+       std::min(pilot_chain->GetEntries(), pilot_entries_), n_samples_, groups.size());
+
+  task_n_samples_.assign(config_tasks_.size(), n_samples_);
+  using PilotResultPtr = ROOT::RDF::RResultPtr<Bootstrap::ConvergenceAccumulator>;
+  for (auto &group : groups) {
+    std::map<std::size_t, std::vector<PilotResultPtr>> task_results;
+    for (auto i_task : group) {
+      auto &t = config_tasks_[i_task];
+      if (t.axes.empty() || t.axes.size() > MAX_AXES) {
+        continue;
+      }
+      std::vector<Qn::AxisD> axes_qn;
+      std::transform(t.axes.begin(), t.axes.end(), std::back_inserter(axes_qn), ToQnAxis);
+      Engine::EventAxes event_axes(axes_qn);
+      const auto event_bin_column = "_pilot_event_bin_" + std::to_string(i_task);
+      auto use_weights = t.weight_type == EQnWeight(EQnWeight::OBSERVABLE);
+      auto &results = task_results[i_task];
+      try {
+        auto task_df = Engine::DefineEventBin(pilot_df, event_bin_column, event_axes);
+        for (auto &correlation : GetTaskCombinations(t)) {
+          auto kernel = BuildKernel(correlation, use_weights);
+          if (kernel_jit_) {
+            kernel.jit = kernel_jit_->Find(kernel);
+          }
+          auto input_axes = GetInputAxes(correlation.argument_names);
+          const auto &inputs = correlation.argument_names;
+          switch (kernel.arity) {
+            case 1: results.emplace_back(Engine::BookPilot<1>(
+                  task_df, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples_));
+              break;
+            case 2: results.emplace_back(Engine::BookPilot<2>(
+                  task_df, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples_));
+              break;
+            case 3: results.emplace_back(Engine::BookPilot<3>(
+                  task_df, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples_));
+              break;
+            default: results.emplace_back(Engine::BookPilot<Engine::DYNAMIC_ARITY>(
+                  task_df, kernel, event_axes, event_bin_column, inputs, input_axes, n_samples_));
+          }
+        }
+      } catch (std::exception &e) {
+        Warning(__func__, "Task '%s' is excluded from the pilot: %s", t.output_folder.c_str(), e.what());
+        results.clear();
+      }
+    }
+
+    for (auto &[i_task, results] : task_results) {
+      if (results.empty()) {
+        continue;
+      }
+      std::size_t required = 0;
+      for (auto &result : results) {
+        required = std::max(required, result->RequiredSamples(pilot_candidates_, samples_precision_, pilot_min_entries_));
+      }
+      task_n_samples_[i_task] = int(required);
+      Info(__func__, "%-40s %zu samples", config_tasks_[i_task].output_folder.c_str(), required);
+    }
+  }
+}
+
+std::string CorrelationTaskRunner::GetEventBinColumn(const std::vector<AxisConfig> &axes,
+                                                 const Engine::EventAxes &event_axes) {
+  std::stringstream key_stream;
+  key_stream << std::setprecision(17);
+  for (auto &axis : axes) {
+    key_stream << axis.variable << ":";
+    if (axis.type == AxisConfig::RANGE) {
+      key_stream << axis.nb << "," << axis.lo << "," << axis.hi;
+    } else {
+      for (auto edge : axis.bin_edges) {
+        key_stream << edge << ",";
+      }
+    }
+    key_stream << ";";
+  }
+
+  auto emplace_result = event_bin_columns_.emplace(key_stream.str(), "");
+  auto &column_name = emplace_result.first->second;
+  if (emplace_result.second) {
+    column_name = "_event_bin_" + std::to_string(event_bin_columns_.size() - 1);
+    df_sampled_ = std::make_unique<ROOT::RDF::RNode>(Engine::DefineEventBin(*df_sampled_, column_name, event_axes));
+    Info(__func__, "Event bin column '%s' for axes '%s'", column_name.c_str(), key_stream.str().c_str());
+  }
+  return column_name;
+}
+
+std::vector<std::vector<Qn::AxisD>> CorrelationTaskRunner::GetInputAxes(const std::vector<std::string> &input_names) {
+  std::vector<std::string> missing_names;
+  std::copy_if(input_names.begin(), input_names.end(), std::back_inserter(missing_names),
+               [this](const std::string &name) { return input_axes_cache_.count(name) == 0; });
+
+  if (!missing_names.empty()) {
+    auto tree = GetTree();
+    TTreeReader reader(tree.get());
+    std::list<TTreeReaderValue<Qn::DataContainerQVector>> values;
+    for (auto &name : missing_names) {
+      values.emplace_back(reader, name.c_str());
+    }
+    if (!reader.Next()) {
+      throw std::runtime_error("Unable to read the first entry of the input tree");
+    }
+    auto value_it = values.begin();
+    for (auto &name : missing_names) {
+      input_axes_cache_.emplace(name, (*value_it)->GetAxes());
+      /* all bins of the container have the harmonics of the detector */
+      const auto &q = *(*value_it)->begin();
+      std::vector<int> harmonics(q.GetNoOfHarmonics());
+      q.GetHarmonicsMap(harmonics.data());
+      input_harmonics_cache_[name] = std::set<unsigned int>(harmonics.begin(), harmonics.end());
+      ++value_it;
+    }
+  }
+
+  std::vector<std::vector<Qn::AxisD>> result;
+  result.reserve(input_names.size());
+  for (auto &name : input_names) {
+    result.emplace_back(input_axes_cache_.at(name));
+  }
+  return result;
+}
+
+const std::set<unsigned int> &CorrelationTaskRunner::GetInputHarmonics(const std::string &input_name) {
+  GetInputAxes({input_name});
+  return input_harmonics_cache_.at(input_name);
 }
 
 void Qn::Analysis::Correlate::CorrelationTaskRunner::Run() {
+  if (plan_only_ || (previous_meta_ && ledger_.empty())) {
+    return;
+  }
+  if (skim_) {
+    WriteSkim();
+    WriteSummary();
+    return;
+  }
   Info(__func__, "Go!");
 
-  TFile f(output_file_.c_str(), "RECREATE");
+  /* the first result triggers the event loop for all booked actions */
+  const auto run_start = Monitor::Clock::now();
+  event_loop_start_ = run_start;
+  try {
+    n_events_processed_.GetValue();
+  } catch (std::runtime_error &e) {
+    Error(__func__, "%s", e.what());
+  }
+  summary_.phases["jit"] += std::chrono::duration<double>(event_loop_start_ - run_start).count();
+  summary_.phases["event_loop"] += Monitor::SecondsSince(event_loop_start_);
+  if (progress_monitor_) {
+    Info(__func__, "%s", Monitor::FormatProgress(progress_monitor_->GetProgress(TFile::GetFileBytesRead())).c_str());
+  }
 
-  TObjString container_meta;
-  for (auto &task : initialized_tasks_) {
-    auto dir = mkcd(task->output_folder, f);
+  std::optional<Monitor::ScopedPhase> writing_phase(std::in_place, summary_, "writing");
+
+  /* in the update mode new results are written aside and then merged with the previous ones */
+  const std::string write_file_name = previous_meta_ ? output_file_ + ".update.root" : output_file_;
+  TFile f(write_file_name.c_str(), "RECREATE");
+  if (f.IsZombie()) {
+    throw std::runtime_error("Unable to open '" + write_file_name + "'");
+  }
 
-    for (auto &correlation : task->correlations) {
-      Info(__func__, "Processing '%s'... ", correlation.result_ptr->GetName().c_str());
+  {
+    /* results are taken out of the data frame and freed one by one as soon as they are written */
+    if (background_writer_) {
+      /* ROOT objects are destroyed on the main thread while the writer thread uses the file */
+      ROOT::EnableThreadSafety();
+    }
+    Qn::Analysis::Tools::BackgroundWriter writer(background_writer_);
+    Planner::AccumulatorReport accumulator_report;
+    for (auto &task : initialized_tasks_) {
+      for (auto &correlation : task->correlations) {
+        Info(__func__, "Processing '%s'... ", correlation.result_ptr->GetName().c_str());
 
-      try {
-        auto &container = correlation.result_ptr.GetValue().GetDataContainer();
-        dir->WriteObject(&container, correlation.meta_key.c_str());
-      } catch (std::runtime_error& e) {
-        Error(__func__, "%s", e.what());
+        std::shared_ptr<Qn::DataContainerStatCollect> container;
+        try {
+          container = correlation.result_ptr.GetValue().ReleaseDataContainer();
+        } catch (std::exception &e) {
+          Error(__func__, "%s", e.what());
+        }
+        if (container) {
+          auto &result = correlation.result_ptr.GetValue();
+          accumulator_report.Add(task->output_folder, result.GetNBins(), result.GetNAllocatedBins(), result.GetNSamples());
+        }
+        correlation.result_ptr = {};
+        if (!container) {
+          continue;
+        }
+        writer.Push([&f, folder = task->output_folder, key = correlation.meta_key, container]() {
+          auto dir = mkcd(folder, f);
+          if (dir->WriteObject(container.get(), key.c_str()) <= 0 || f.TestBit(TFile::kWriteError)) {
+            throw std::runtime_error("Unable to write '" + folder + "/" + key + "' to '" + f.GetName() + "'");
+          }
+        });
       }
     }
+    /* the output is incomplete, the run fails */
+    writer.Flush();
+    if (sparse_accumulators_) {
+      accumulator_report.Print(std::cout, df_sampled_->GetNSlots());
+    }
   }
 
+  CorrelationMerger::WriteMeta(f, GetRunMeta());
+
   f.Close();
+  if (f.TestBit(TFile::kWriteError)) {
+    throw std::runtime_error("Error while writing '" + write_file_name + "'");
+  }
   Info(__func__, "Written to '%s'...", f.GetName());
 
+  if (previous_meta_) {
+    const std::string merged_file_name = output_file_ + ".merged.root";
+    CorrelationMerger::Merge({output_file_, write_file_name}, merged_file_name);
+    fs::rename(merged_file_name, output_file_);
+    fs::remove(write_file_name);
+    Info(__func__, "%zu new files are merged into '%s'", ledger_.size(), output_file_.c_str());
+  }
+
+  writing_phase.reset();
+  WriteSummary();
+
 }
 void Qn::Analysis::Correlate::CorrelationTaskRunner::LookupConfiguration() {
   if (configuration_file_path_.is_absolute()) {
@@ -110,6 +798,7 @@ bool Qn::Analysis::Correlate::CorrelationTaskRunner::LoadConfiguration(const fs:
   Info(__func__, "Loaded %s...", path.c_str());
 
   config_tasks_ = top_node[configuration_node_name_].as<std::vector<CorrelationTask>>();
+  config_hash_ = HashString(YAML::Dump(top_node[configuration_node_name_]));
   return true;
 }
 
@@ -131,17 +820,427 @@ std::shared_ptr<TTree> CorrelationTaskRunner::GetTree() {
   throw std::runtime_error("Unknown input file extension " + input_file_name_.extension().string());
 }
 
+std::vector<std::string> CorrelationTaskRunner::GetInputFiles() const {
+  return ReadFileList(input_file_name_);
+}
+
+std::vector<std::string> CorrelationTaskRunner::ReadFileList(const fs::path &input_file_name) {
+  std::vector<std::string> result;
+  if (".list" == input_file_name.extension()) {
+    TFileCollection fc("fc", "", input_file_name.c_str());
+    for (auto obj : *fc.GetList()) {
+      auto file_info = dynamic_cast<TFileInfo *>(obj);
+      result.emplace_back(file_info->GetCurrentUrl()->GetUrl());
+    }
+  } else if (".root" == input_file_name.extension()) {
+    result.emplace_back(input_file_name.string());
+  } else {
+    throw std::runtime_error("Unknown input file extension " + input_file_name.extension().string());
+  }
+  return result;
+}
+
+bool CorrelationTaskRunner::IsFileSelected(size_t i_file, const std::string &file) const {
+  if (i_file % shard_.file_shard_count != shard_.file_shard_index) {
+    return false;
+  }
+  return !(previous_meta_ && previous_meta_->FindInLedger(file));
+}
+
+std::shared_ptr<TChain> CorrelationTaskRunner::MakeChain() {
+  if (shard_.file_shard_count == 0 || shard_.file_shard_index >= shard_.file_shard_count) {
+    throw std::runtime_error("--file-shard-index must be less than --file-shard-count");
+  }
+
+  auto input_files = GetInputFiles();
+  /* entry numbers in the chain of all files keep bootstrap samples aligned between shards and updates */
+  TChain full_chain(input_tree_.c_str(), "");
+  for (auto &file : input_files) {
+    full_chain.Add(file.c_str());
+  }
+  full_chain.GetEntries();
+  auto tree_offsets = full_chain.GetTreeOffset();
+  n_input_entries_ = full_chain.GetEntries();
+
+  auto chain = std::make_shared<TChain>(input_tree_.c_str(), "");
+  global_entry_map_ = Bootstrap::GlobalEntryMap();
+  ledger_.clear();
+  Long64_t local_first = 0;
+  for (size_t i_file = 0; i_file < input_files.size(); ++i_file) {
+    const auto n_entries = tree_offsets[i_file + 1] - tree_offsets[i_file];
+    if (previous_meta_) {
+      CheckUpdateEntries(input_files[i_file], tree_offsets[i_file], n_entries);
+    }
+    if (!IsFileSelected(i_file, input_files[i_file])) {
+      continue;
+    }
+    chain->Add(input_files[i_file].c_str());
+    global_entry_map_.AddSegment(local_first, tree_offsets[i_file]);
+    ledger_.push_back({input_files[i_file], FileChecksum(input_files[i_file]), n_entries, tree_offsets[i_file]});
+    local_first += n_entries;
+  }
+  Info(__func__, "Processing %d of %zu files, %lld entries",
+       chain->GetNtrees(), input_files.size(), local_first);
+  return chain;
+}
+
+std::string CorrelationTaskRunner::FileChecksum(const std::string &path) {
+  std::unique_ptr<TFile> f(TFile::Open(path.c_str(), "READ"));
+  if (!f || f->IsZombie()) {
+    throw std::runtime_error("Unable to open '" + path + "'");
+  }
+  /* UUID is regenerated whenever the file is rewritten, no need to read the whole file */
+  return HashString(std::string(f->GetUUID().AsString()) + ":" + std::to_string(f->GetSize()));
+}
+
+void CorrelationTaskRunner::PrepareUpdate() {
+  if (!fs::exists(output_file_)) {
+    Info(__func__, "No previous output '%s', processing all input files", output_file_.c_str());
+    return;
+  }
+  if (shard_.file_shard_count > 1 || shard_.first_entry > 0 || shard_.n_entries >= 0) {
+    throw std::runtime_error("--update cannot be combined with sharding options");
+  }
+
+  std::unique_ptr<TFile> f(TFile::Open(output_file_.c_str(), "READ"));
+  if (!f || f->IsZombie()) {
+    throw std::runtime_error("Unable to open previous output '" + output_file_ + "'");
+  }
+  auto previous_meta = CorrelationMerger::ReadMeta(*f);
+
+  if (adaptive_samples_ && !previous_meta.task_n_samples.empty()) {
+    /* new files must be processed with the same number of samples, pilot is not repeated */
+    task_n_samples_ = previous_meta.task_n_samples;
+  }
+  if (!previous_meta.IsCompatible(GetRunMeta())) {
+    throw std::runtime_error("Configuration, --n-samples, --seed or bootstrap resampling changed since the previous run, "
+                             "reconciliation refused. Rerun without --update.");
+  }
+  if (previous_meta.HasEntryRange()) {
+    throw std::runtime_error("Previous output was produced from entry-range shards, reconciliation refused");
+  }
+
+  std::size_t n_processed = 0;
+  auto input_files = GetInputFiles();
+  for (auto &file : input_files) {
+    auto processed_file = previous_meta.FindInLedger(file);
+    if (!processed_file) {
+      continue;
+    }
+    if (processed_file->checksum != FileChecksum(file)) {
+      throw std::runtime_error("File '" + file + "' was changed since the previous run, reconciliation refused");
+    }
+    ++n_processed;
+  }
+  const bool has_entries = std::all_of(previous_meta.ledger.begin(), previous_meta.ledger.end(),
+                                       [](const ProcessedFile &f) { return f.first_entry >= 0; });
+  if (!has_entries) {
+    /* entries of the processed files are not recorded, they are the same only if the files are the head of the list */
+    for (std::size_t i = 0; i < previous_meta.ledger.size(); ++i) {
+      if (i >= input_files.size() || input_files[i] != previous_meta.ledger[i].path) {
+        throw std::runtime_error("Previous output does not record entry numbers of processed files, "
+                                 "new files must follow them in the input list, reconciliation refused");
+      }
+    }
+  }
+  if (n_processed != previous_meta.ledger.size()) {
+    /* entry numbers of removed files are still taken, checked by MakeChain */
+    Warning(__func__, "%zu previously processed files are not in the input list anymore",
+            previous_meta.ledger.size() - n_processed);
+  }
+
+  Info(__func__, "%zu files are already processed", n_processed);
+  previous_meta_ = std::move(previous_meta);
+}
+
+void CorrelationTaskRunner::CheckUpdateEntries(const std::string &file, long long first_entry, long long n_entries) const {
+  if (auto processed_file = previous_meta_->FindInLedger(file)) {
+    if (processed_file->first_entry >= 0 && processed_file->first_entry != first_entry) {
+      throw std::runtime_error("Entry numbers of '" + file + "' changed since the previous run "
+                               "(files are inserted or removed before it), reconciliation refused");
+    }
+    return;
+  }
+  /* new events with entry numbers of processed ones would get the same bootstrap multiplicities */
+  for (auto &processed_file : previous_meta_->ledger) {
+    if (processed_file.Overlaps(first_entry, n_entries)) {
+      throw std::runtime_error("New file '" + file + "' takes entry numbers of '" + processed_file.path +
+          "' processed by the previous run, add new files to the end of the list. Reconciliation refused");
+    }
+  }
+}
+
+ROOT::RDF::RNode CorrelationTaskRunner::GetSampledRDF(ROOT::RDF::RNode df) const {
+  df = DefineSkimVariables(df);
+  df = DefineFriendVariables(df, global_entry_map_);
+  if (shard_.first_entry > 0 || shard_.n_entries >= 0) {
+    const auto first_entry = ULong64_t(shard_.first_entry);
+    const auto last_entry = shard_.n_entries >= 0 ? first_entry + ULong64_t(shard_.n_entries) : 0;
+    /* entry range shards run without implicit multi-threading, see IsEntryNumberNeeded */
+    df = df.Range(first_entry, last_entry);
+  }
+
+  auto entry_map = global_entry_map_;
+  if (sampling_fraction_ < 1.) {
+    Bootstrap::EntrySampler sampler(sampling_fraction_, seed_);
+    df = df.Filter([sampler, entry_map](ULong64_t entry) {
+      return sampler(entry_map(entry));
+    }, {"rdfentry_"}, "preview");
+  }
+
+  Bootstrap::Resampler resampler(n_samples_, seed_);
+  return df.Define("samples", [resampler, entry_map](ULong64_t entry) {
+    return resampler.operator()<ULong64_t>(entry_map(entry));
+  }, {"rdfentry_"});
+}
+
 std::shared_ptr<ROOT::RDataFrame> CorrelationTaskRunner::GetRDF() {
-  if (".list" == input_file_name_.extension()) {
-    TFileCollection fc("fc", "", input_file_name_.c_str());
-    auto chain = new TChain(input_tree_.c_str(), "");
-    chain->AddFileInfoList(reinterpret_cast<TCollection *>(fc.GetList()));
-    /* Lifetime of the chain is managed by RDataFrame */
-    return std::make_shared<ROOT::RDataFrame>(*chain);
-  } else if (".root" == input_file_name_.extension()) {
-    return std::make_shared<ROOT::RDataFrame>(input_tree_.c_str(), input_file_name_.c_str());
+  /* chain must outlive the data frame */
+  input_chain_ = MakeChain();
+  if (prune_branches_) {
+    PruneBranches(*input_chain_, GetInputBranches());
   }
-  throw std::runtime_error("Unknown input file extension " + input_file_name_.extension().string());
+  return std::make_shared<ROOT::RDataFrame>(*input_chain_);
+}
+
+std::set<std::string> CorrelationTaskRunner::GetRequiredQVectors() const {
+  std::set<std::string> result;
+  for (auto &t : config_tasks_) {
+    for (auto &correlation : GetTaskCombinations(t)) {
+      result.insert(correlation.argument_names.begin(), correlation.argument_names.end());
+    }
+  }
+  return result;
+}
+
+std::set<std::string> CorrelationTaskRunner::GetRequiredVariables() const {
+  std::set<std::string> result;
+  for (auto &t : config_tasks_) {
+    for (auto &axis : t.axes) {
+      result.insert(axis.variable);
+    }
+  }
+  if (!friend_index_.empty()) {
+    result.insert(friend_index_);
+  }
+  return result;
+}
+
+std::set<std::string> CorrelationTaskRunner::GetRequiredColumns() const {
+  auto result = GetRequiredQVectors();
+  auto variables = GetRequiredVariables();
+  result.insert(variables.begin(), variables.end());
+  return result;
+}
+
+std::set<std::string> CorrelationTaskRunner::GetInputBranches() const {
+  auto columns = GetRequiredColumns();
+  for (auto &variable : friend_variables_) {
+    columns.erase(variable);
+  }
+  return skim_meta_ ? skim_meta_->ToBranches(columns) : columns;
+}
+
+void CorrelationTaskRunner::SetupFriend() {
+  friend_tree_ = std::make_shared<FriendTree>(ReadFileList(friend_file_name_), friend_tree_name_);
+
+  /* only variables absent in the input are taken from the friend */
+  auto tree = GetTree();
+  std::set<std::string> missing_variables;
+  for (auto &variable : GetRequiredVariables()) {
+    const bool in_input = skim_meta_ ? skim_meta_->HasVariable(variable) : tree->GetBranch(variable.c_str()) != nullptr;
+    if (!in_input) {
+      missing_variables.emplace(variable);
+    }
+  }
+  if (missing_variables.count(friend_index_) > 0) {
+    throw std::runtime_error("Index variable '" + friend_index_ + "' is not found in the input");
+  }
+  friend_variables_ = friend_tree_->Select(missing_variables);
+  for (auto &variable : friend_variables_) {
+    missing_variables.erase(variable);
+  }
+  if (!missing_variables.empty()) {
+    throw std::runtime_error("Event variables are found neither in the input nor in the friend: " +
+        JoinStrings(missing_variables.begin(), missing_variables.end()));
+  }
+
+  if (!friend_index_.empty()) {
+    friend_tree_->BuildIndex(friend_index_);
+  }
+  Info(__func__, "%zu event variables are read from the friend, joined by %s",
+       friend_variables_.size(), friend_index_.empty() ? "entry" : friend_index_.c_str());
+}
+
+void CorrelationTaskRunner::PrepareFriend() {
+  if (!friend_tree_) {
+    return;
+  }
+  /* joined by number, a different number of entries means that events of the two trees don't match */
+  if (!friend_tree_->HasIndex() && friend_tree_->GetEntries() != n_input_entries_) {
+    throw std::runtime_error("Friend has " + std::to_string(friend_tree_->GetEntries()) + " entries, input has "
+                                 + std::to_string(n_input_entries_) + ", join them by an event id with --friend-index");
+  }
+  friend_tree_->Prepare(df_->GetNSlots());
+}
+
+ROOT::RDF::RNode CorrelationTaskRunner::DefineFriendVariables(ROOT::RDF::RNode df,
+                                                              const Bootstrap::GlobalEntryMap &entry_map) const {
+  if (!friend_tree_ || friend_variables_.empty()) {
+    return df;
+  }
+  auto friend_tree = friend_tree_;
+  const std::string values_column = "_friend_values";
+  if (friend_tree->HasIndex()) {
+    df = df.DefineSlot(values_column, [friend_tree](unsigned int slot, double index_value) {
+      /* integer ids are exact in double, other values have no friend entry */
+      const bool is_id = std::isfinite(index_value) && std::trunc(index_value) == index_value
+          && std::abs(index_value) < 0x1p63;
+      return friend_tree->ReadEntry(slot, is_id ? friend_tree->FindEntry((long long) index_value) : -1);
+    }, {friend_index_});
+  } else {
+    /* friend is aligned with the chain of all input files, runs without implicit multi-threading */
+    df = df.DefineSlot(values_column, [friend_tree, entry_map](unsigned int slot, ULong64_t entry) {
+      return friend_tree->ReadEntry(slot, (long long) entry_map(entry));
+    }, {"rdfentry_"});
+  }
+  for (std::size_t i = 0; i < friend_variables_.size(); ++i) {
+    df = df.Define(friend_variables_[i], [i](const std::vector<double> &values) {
+      return values[i];
+    }, {values_column});
+  }
+  return df;
+}
+
+void CorrelationTaskRunner::DetectSkim() {
+  auto input_files = GetInputFiles();
+  if (input_files.empty()) {
+    return;
+  }
+  std::unique_ptr<TFile> f(TFile::Open(input_files.front().c_str(), "READ"));
+  if (!f || f->IsZombie()) {
+    throw std::runtime_error("Unable to open '" + input_files.front() + "'");
+  }
+  std::unique_ptr<TObjString> meta_string(f->Get<TObjString>(Skim::SKIM_META_NAME));
+  if (!meta_string) {
+    return;
+  }
+  skim_meta_ = YAML::Load(meta_string->GetString().Data()).as<Skim::SkimMeta>();
+
+  /* event variables may come from the friend, they are checked when it is opened */
+  auto missing = skim_meta_->Missing(friend_file_name_.empty() ? GetRequiredColumns() : GetRequiredQVectors());
+  if (!missing.empty()) {
+    throw std::runtime_error("Input is a skim without columns required by the configuration: " +
+        JoinStrings(missing.begin(), missing.end()) + ". Skim the original input again.");
+  }
+  input_tree_ = Skim::SKIM_TREE_NAME;
+  Info(__func__, "Reading skim of %zu files (%zu Q-vectors, %zu variables)",
+       skim_meta_->source_files.size(), skim_meta_->q_vectors.size(), skim_meta_->variables.size());
+}
+
+ROOT::RDF::RNode CorrelationTaskRunner::DefineSkimVariables(ROOT::RDF::RNode df) const {
+  if (!skim_meta_) {
+    return df;
+  }
+  for (auto &variable : skim_meta_->variables) {
+    df = df.Define(variable, [](float value) { return double(value); }, {Skim::VariableBranchName(variable)});
+  }
+  return df;
+}
+
+void CorrelationTaskRunner::WriteSkim() {
+  Monitor::ScopedPhase phase(summary_, "skim");
+
+  Skim::SkimMeta meta;
+  meta.source_tree = skim_meta_ ? skim_meta_->source_tree : input_tree_;
+  meta.source_files = skim_meta_ ? skim_meta_->source_files : ledger_;
+  meta.n_entries = input_chain_->GetEntries();
+  meta.compression = skim_compression_;
+  auto q_vectors = GetRequiredQVectors();
+  auto variables = GetRequiredVariables();
+  meta.q_vectors.assign(q_vectors.begin(), q_vectors.end());
+  meta.variables.assign(variables.begin(), variables.end());
+
+  ROOT::RDF::RNode df = DefineFriendVariables(*df_, global_entry_map_);
+  std::vector<std::string> columns(q_vectors.begin(), q_vectors.end());
+  for (auto &variable : variables) {
+    const auto branch_name = Skim::VariableBranchName(variable);
+    /* skim of the skim copies float branches as they are */
+    if (!(skim_meta_ && skim_meta_->HasVariable(variable))) {
+      df = df.Define(branch_name, [](double value) { return float(value); }, {variable});
+    }
+    columns.emplace_back(branch_name);
+  }
+
+  ROOT::RDF::RSnapshotOptions options;
+  options.fMode = "RECREATE";
+  options.fCompressionAlgorithm =
+      static_cast<ROOT::RCompressionSetting::EAlgorithm::EValues>(skim_compression_ / 100);
+  options.fCompressionLevel = skim_compression_ % 100;
+  Info(__func__, "Writing %zu Q-vectors and %zu variables of %lld entries to '%s'",
+       q_vectors.size(), variables.size(), meta.n_entries, output_file_.c_str());
+  df.Snapshot(Skim::SKIM_TREE_NAME, output_file_, columns, options);
+
+  TFile f(output_file_.c_str(), "UPDATE");
+  YAML::Node node;
+  node = meta;
+  TObjString meta_string(YAML::Dump(node).c_str());
+  f.WriteTObject(&meta_string, Skim::SKIM_META_NAME, "Overwrite");
+  f.Close();
+
+  Long64_t source_bytes = 0;
+  for (auto obj : *input_chain_->GetListOfFiles()) {
+    std::unique_ptr<TFile> source(TFile::Open(obj->GetTitle(), "READ"));
+    if (source && !source->IsZombie()) {
+      source_bytes += source->GetSize();
+    }
+  }
+  Info(__func__, "Skim is %.1f MB, source is %.1f MB",
+       double(fs::file_size(output_file_)) / (1024 * 1024), double(source_bytes) / (1024 * 1024));
+}
+
+void CorrelationTaskRunner::PruneBranches(TTree &tree, const std::set<std::string> &columns) {
+  auto branches = tree.GetListOfBranches();
+  if (!branches) {
+    Warning(__func__, "No branches in the input tree, nothing to prune");
+    return;
+  }
+
+  Long64_t total_bytes = 0;
+  Long64_t used_bytes = 0;
+  std::set<std::string> found_columns;
+  for (auto obj : *branches) {
+    auto branch = dynamic_cast<TBranch *>(obj);
+    auto branch_bytes = branch->GetZipBytes("*");
+    total_bytes += branch_bytes;
+    if (columns.count(branch->GetName()) > 0) {
+      used_bytes += branch_bytes;
+      found_columns.emplace(branch->GetName());
+    }
+  }
+
+  for (auto &column : columns) {
+    if (found_columns.count(column) == 0) {
+      Warning(__func__, "Column '%s' is required by configuration but not found in the input tree", column.c_str());
+    }
+  }
+
+  tree.SetBranchStatus("*", false);
+  for (auto &column : found_columns) {
+    /* sub-branches of the top-level branch are enabled as well */
+    tree.SetBranchStatus(column.c_str(), true);
+    tree.AddBranchToCache(column.c_str(), true);
+  }
+
+  /* sizes are known for the currently loaded tree only, extrapolating to the whole chain */
+  auto tree_entries = tree.GetTree() ? tree.GetTree()->GetEntries() : 0;
+  double scale = tree_entries > 0 ? double(tree.GetEntries()) / double(tree_entries) : 1.;
+  Info(__func__, "Reading %zu of %d branches: %.1f MB of %.1f MB compressed (%.1f MB saved, estimated for %lld entries)",
+       found_columns.size(), branches->GetEntries(),
+       scale * double(used_bytes) / (1024 * 1024),
+       scale * double(total_bytes) / (1024 * 1024),
+       scale * double(total_bytes - used_bytes) / (1024 * 1024),
+       tree.GetEntries());
 }
 
 Qn::AxisD CorrelationTaskRunner::ToQnAxis(const AxisConfig &c) {
@@ -172,6 +1271,28 @@ std::vector<CorrelationTaskRunner::Correlation> CorrelationTaskRunner::GetTaskCo
     };
   };
 
+  if (t.type._value == ECorrelationTaskType::CUMULANT) {
+    /* single Q-vector per correlation, one correlator per order and harmonic */
+    std::vector<Correlation> result;
+    auto &task_arg = t.arguments.front();
+    for (auto &qv : task_arg.query_result) {
+      for (auto step : task_arg.corrections_steps) {
+        for (auto order : t.orders) {
+          for (auto harmonic : t.harmonics) {
+            auto component = "cor" + std::to_string(order) + "_h" + std::to_string(harmonic);
+            Correlation c;
+            c.args_list = {make_arg(qv, step, component, task_arg.weight)};
+            c.argument_names = {qv.name + "_" + step._to_string()};
+            c.meta_key = c.argument_names.front() + "." + component;
+            c.correlator = GenericFramework::Correlator{order, harmonic};
+            result.emplace_back(std::move(c));
+          }
+        }
+      }
+    }
+    return result;
+  }
+
   std::vector<CorrelationArgList> arglists_to_combine;
   for (auto &task_arg : t.arguments) {
     CorrelationArgList arglist;
@@ -283,7 +1404,21 @@ CorrelationTaskRunner::QVectorWeightFct CorrelationTaskRunner::GetQVectorWeightF
   }
 }
 
-CorrelationTaskRunner::~CorrelationTaskRunner() {
-  if(df_sampled_!=nullptr) delete df_sampled_;
+CorrelationRunMeta CorrelationTaskRunner::GetRunMeta() const {
+  CorrelationRunMeta meta;
+  meta.configuration_name = configuration_node_name_;
+  meta.config_hash = config_hash_;
+  meta.n_samples = n_samples_;
+  meta.seed = seed_;
+  auto shard = shard_;
+  shard.input_file = input_file_name_.filename().string();
+  meta.shards.emplace_back(std::move(shard));
+  meta.ledger = ledger_;
+  meta.task_n_samples = task_n_samples_;
+  meta.sampling_fraction = sampling_fraction_;
+  meta.resampler_version = Bootstrap::Resampler::VERSION;
+  return meta;
 }
 
+CorrelationTaskRunner::~CorrelationTaskRunner() = default;
+
@@ -6,6 +6,10 @@
 #define DATATREEFLOW_SRC_CORRELATION_CORRELATIONTASK_H
 
 #include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
 #include <utility>
 #include <vector>
 #include <string>
@@ -20,13 +24,23 @@ namespace fs = ::boost::filesystem;
 
 
 #include <QnDataFrame.hpp>
+#include <TChain.h>
 #include <TFile.h>
 #include <TTree.h>
 #include <boost/program_options.hpp>
 
 #include <yaml-cpp/yaml.h>
+#include <QnAnalysisTools/BackgroundWriter.hpp>
 
 #include "Config.hpp"
+#include "Bootstrap.hpp"
+#include "CorrelationEngine.hpp"
+#include "CorrelationMeta.hpp"
+#include "CorrelationPlanner.hpp"
+#include "FriendTree.hpp"
+#include "KernelJit.hpp"
+#include "RunMonitor.hpp"
+#include "Skim.hpp"
 #include "Utils.hpp"
 //#include "UserCorrelationAction.hpp"
 
@@ -34,7 +48,7 @@ namespace Qn::Analysis::Correlate {
 
 class CorrelationTaskRunner {
 
-  using CorrelationResultPtr = ROOT::RDF::RResultPtr<Qn::Correlation::CorrelationActionBase>;
+  using CorrelationResultPtr = ROOT::RDF::RResultPtr<Engine::CorrelationResult>;
 
 
   struct CorrelationArg {
@@ -46,44 +60,8 @@ class CorrelationTaskRunner {
 
   using CorrelationArgList = std::vector<CorrelationArg>;
 
-  struct QVectorComponentFct {
-    enum EComp { kX, kY, kCos, kSin };
-
-    EComp component{kX};
-    unsigned int harmonic{0};
-
-    [[nodiscard]]
-    float
-    Eval(const Qn::QVector &qv) const noexcept {
-      if (component == kX) {
-        return qv.x(harmonic);
-      } else if (component == kY) {
-        return qv.y(harmonic);
-      } else if (component == kCos) {
-        return qv.x(harmonic) / qv.mag(harmonic);
-      } else if (component == kSin) {
-        return qv.y(harmonic) / qv.mag(harmonic);
-      }
-      __builtin_unreachable();
-    }
-  };
-
-  struct QVectorWeightFct {
-    enum EWeightType { kOne, kSumw };
-
-    float Eval(const Qn::QVector &qv) const {
-      if (type == kOne) {
-        return 1.f;
-      } else if (type == kSumw) {
-        return qv.sumweights();
-      }
-
-      __builtin_unreachable();
-    }
-
-    EWeightType type{kOne};
-
-  };
+  using QVectorComponentFct = Engine::QVectorComponentFct;
+  using QVectorWeightFct = Engine::QVectorWeightFct;
 
   struct Correlation {
     CorrelationArgList args_list;
@@ -91,6 +69,8 @@ class CorrelationTaskRunner {
     std::vector<std::string> argument_names;
     std::string action_name;
     std::string meta_key;
+    /* set for multi-particle correlators of cumulant tasks */
+    std::optional<GenericFramework::Correlator> correlator;
 
     CorrelationResultPtr result_ptr;
   };
@@ -114,8 +94,8 @@ class CorrelationTaskRunner {
   };
 
  public:
-  static constexpr size_t MAX_ARITY = 8;
-  static constexpr size_t MAX_AXES = 4;
+  static constexpr size_t MAX_ARITY = Engine::MAX_ARITY;
+  static constexpr size_t MAX_AXES = Engine::MAX_AXES;
 
   boost::program_options::options_description GetBoostOptions();
 
@@ -127,13 +107,154 @@ class CorrelationTaskRunner {
 
  private:
   std::shared_ptr<TTree> GetTree();
+  std::vector<std::string> GetInputFiles() const;
+  static std::vector<std::string> ReadFileList(const fs::path &input_file_name);
+  bool IsFileSelected(size_t i_file, const std::string &file) const;
+  /**
+   * @brief Checksum of the file identity, cheap to evaluate for large files
+   */
+  static std::string FileChecksum(const std::string &path);
+  /**
+   * @brief Reads ledger of the existing output, refuses to continue if configuration or inputs changed
+   */
+  void PrepareUpdate();
+  /**
+   * @brief Throws if entries of the file in the chain of all inputs differ from the previous run (processed file)
+   * or overlap entries of the processed files (new file)
+   */
+  void CheckUpdateEntries(const std::string &file, long long first_entry, long long n_entries) const;
+  /**
+   * @brief Chains input files selected by file-index sharding and not processed yet
+   */
+  std::shared_ptr<TChain> MakeChain();
   std::shared_ptr<ROOT::RDataFrame> GetRDF();
+  /**
+   * @brief Applies entry range and defines 'samples' column.
+   * Bootstrap multiplicities depend on the seed and the entry in the chain of all input files only.
+   */
+  ROOT::RDF::RNode GetSampledRDF(ROOT::RDF::RNode df) const;
+  CorrelationRunMeta GetRunMeta() const;
+  [[nodiscard]] bool IsPreview() const { return fraction_ < 1. || max_events_ != 0; }
+  /**
+   * @brief Event selection or bootstrap multiplicities must repeat between runs and shards,
+   * or the friend is joined by the entry number.
+   * They are computed from rdfentry_, which is the entry of the processed chain only without implicit multi-threading.
+   */
+  [[nodiscard]] bool IsEntryNumberNeeded() const {
+    return update_ || IsPreview() || shard_.file_shard_count > 1 || shard_.first_entry > 0 || shard_.n_entries >= 0
+        || (friend_tree_ && !friend_tree_->HasIndex());
+  }
+  /* numbers of samples are not known yet (from the previous output in the update mode) */
+  [[nodiscard]] bool IsPilotNeeded() const { return adaptive_samples_ && task_n_samples_.empty(); }
+  /**
+   * @brief Collects names of Q-vectors and event variables referenced by config_tasks_
+   */
+  std::set<std::string> GetRequiredColumns() const;
+  std::set<std::string> GetRequiredQVectors() const;
+  std::set<std::string> GetRequiredVariables() const;
+  /**
+   * @brief Branches of the input tree with the required columns
+   */
+  std::set<std::string> GetInputBranches() const;
+  /**
+   * @brief Reads skim meta if the input is a skim, throws if the skim lacks required columns
+   */
+  void DetectSkim();
+  /**
+   * @brief Defines double event variables from the float branches of the skim, no-op for other inputs
+   */
+  ROOT::RDF::RNode DefineSkimVariables(ROOT::RDF::RNode df) const;
+  /**
+   * @brief Writes required columns to the skim in the output file
+   */
+  void WriteSkim();
+  /**
+   * @brief Opens the friend AnalysisTree and selects event variables absent in the input
+   */
+  void SetupFriend();
+  /**
+   * @brief Prepares the friend for slots of the data frame, no-op without friend
+   * @throws std::runtime_error if entries are joined by number and the number of entries differs from the input
+   */
+  void PrepareFriend();
+  /**
+   * @brief Defines event variables read from the friend, no-op without friend
+   * @param entry_map maps entries of the data frame to entries of the friend
+   */
+  ROOT::RDF::RNode DefineFriendVariables(ROOT::RDF::RNode df, const Bootstrap::GlobalEntryMap &entry_map) const;
+  /**
+   * @brief Disables all branches of the tree except for the columns
+   */
+  static void PruneBranches(TTree &tree, const std::set<std::string> &columns);
+  /**
+   * @brief Expands all tasks and estimates their size without booking
+   */
+  std::vector<Planner::TaskEstimate> MakePlan();
+  /**
+   * @brief Prints the plan, throws if estimated memory exceeds the budget
+   */
+  void CheckPlan(const std::vector<Planner::TaskEstimate> &plan) const;
+  /**
+   * @brief Books event counter with callbacks reporting progress of the event loop
+   */
+  void BookProgress();
+  /**
+   * @brief Prints summary of the run and writes it to the summary file as JSON
+   */
+  void WriteSummary();
   void LookupConfiguration();
   bool LoadConfiguration(const fs::path &path);
 
   int n_samples_{0};
+  std::uint64_t seed_{0};
+  CorrelationShard shard_;
+  Bootstrap::GlobalEntryMap global_entry_map_;
+  bool update_{false};
+  std::optional<CorrelationRunMeta> previous_meta_;
+  std::vector<ProcessedFile> ledger_;
+  std::string config_hash_;
+  bool prune_branches_{true};
+  bool plan_only_{false};
+  double memory_budget_mb_{0.};
+  std::shared_ptr<TChain> input_chain_;
   std::shared_ptr<ROOT::RDataFrame> df_;
-  ROOT::RDF::RInterface<ROOT::Detail::RDF::RLoopManager>* df_sampled_{nullptr};
+  std::unique_ptr<ROOT::RDF::RNode> df_sampled_;
+  double progress_interval_{30.};
+  std::string summary_file_;
+  Monitor::RunSummary summary_;
+  std::shared_ptr<Monitor::ProgressMonitor> progress_monitor_;
+  ROOT::RDF::RResultPtr<ULong64_t> n_events_processed_;
+  Monitor::Clock::time_point event_loop_start_;
+  bool jit_kernels_{false};
+  std::string jit_cache_dir_;
+  std::unique_ptr<Engine::KernelJit> kernel_jit_;
+  bool adaptive_samples_{false};
+  Long64_t pilot_entries_{0};
+  double samples_precision_{0.1};
+  std::uint64_t pilot_min_entries_{100};
+  /* numbers of samples tried by the pilot, sorted in Initialize() */
+  std::vector<std::size_t> pilot_candidates_;
+  /* number of samples of each task in config_tasks_, empty - n_samples_ for all */
+  std::vector<int> task_n_samples_;
+  std::map<std::size_t, std::string> samples_columns_;
+  bool skim_{false};
+  int skim_compression_{Skim::DEFAULT_COMPRESSION};
+  std::optional<Skim::SkimMeta> skim_meta_;
+  bool background_writer_{false};
+  bool sparse_accumulators_{false};
+  std::string friend_file_name_;
+  std::string friend_tree_name_;
+  std::string friend_index_;
+  std::shared_ptr<FriendTree> friend_tree_;
+  /* event variables read from the friend */
+  std::vector<std::string> friend_variables_;
+  double fraction_{1.};
+  long long max_events_{0};
+  int preview_n_samples_{10};
+  /* fraction of entries selected by EntrySampler, 1 - all */
+  double sampling_fraction_{1.};
+  /* entries in the chain of all input files */
+  long long n_input_entries_{0};
 
   static std::vector<Correlation> GetTaskCombinations(const CorrelationTask &args);
 
@@ -155,32 +276,6 @@ class CorrelationTaskRunner {
   static Qn::AxisD ToQnAxis(const AxisConfig &c);
 
   static std::string ToQVectorFullName(const QVectorTagged &qv);
-  /*
-   * All machinery below is needed because Lucas uses static
-   * polymorphism in correlation task base on DataFrame, that
-   * makes dynamic parametrization very difficult to implement.
-   *
-   * Vectors of axes and vectors of arguments must be somehow converted
-   * to arrays or passed to template function
-   */
-  template<std::size_t N, std::size_t... Seq>
-  static
-  constexpr std::index_sequence<N + Seq ...>
-  add(std::index_sequence<Seq...>) { return {}; }
-
-  template<std::size_t Min, std::size_t Max>
-  using make_index_range = decltype(add<Min>(std::make_index_sequence<Max - Min>()));
-
-  template<size_t ... IAxis>
-  static auto MakeAxisConfig(const std::vector<Qn::AxisD> &axes, std::index_sequence<IAxis...>) {
-    return Qn::MakeAxes(axes.at(IAxis)...);
-  }
-
-  template<size_t Arity>
-  static bool PredicateArity(const CorrelationTask &t) { return t.arguments.size() == Arity; }
-
-  template<size_t NAxes>
-  static bool PredicateNAxes(const CorrelationTask &t) { return t.axes.size() == NAxes; }
 
   static TDirectory *mkcd(const fs::path &path, TDirectory &root_dir);
 
@@ -190,106 +285,70 @@ class CorrelationTaskRunner {
 
   static QVectorWeightFct GetQVectorWeightFct(const CorrelationArg &arg);
 
-  template<size_t I>
-  using IndexedQVectorArg = const QVector &;
+  static Engine::CorrelationKernel BuildKernel(const Correlation &correlation, bool use_weights);
 
-  template<typename FunctionFactory, size_t ... IArg>
-  static auto BuildFunction(FunctionFactory &&factory, const Correlation &correlation, std::index_sequence<IArg...>) {
-    auto fct_tuple = std::make_tuple(factory(correlation.args_list[IArg])...);
-    return [fct_tuple](IndexedQVectorArg<IArg>...args) -> float {
-      auto args_tuple = std::forward_as_tuple(args...);
-      return (std::get<IArg>(fct_tuple).Eval(std::get<IArg>(args_tuple)) * ... * 1);
-    };
-  }
+  /**
+   * @brief Reads axes of the Q-vector containers from the first entry of the input tree
+   * @param input_names names of Q-vector branches
+   * @return axes of each container
+   */
+  std::vector<std::vector<Qn::AxisD>> GetInputAxes(const std::vector<std::string> &input_names);
+  /**
+   * @brief Harmonics configured for the input Q-vector, read together with its axes
+   */
+  const std::set<unsigned int> &GetInputHarmonics(const std::string &input_name);
 
   /**
-   * @brief Takes task config and initializes IO
-   * @tparam Arity
-   * @tparam NAxis
-   * @param t
-   * @return
+   * @brief Books correlation with compile-time kernel for hot arities,
+   * and runtime kernel for all other
    */
-  template<size_t Arity, size_t NAxis>
-  std::shared_ptr<CorrelationTaskInitialized> InitializeTask(const CorrelationTask &t) {
-    using Qn::Correlation::UseWeights;
-    /* this is a function pointer */
-//    const auto GetActionRegistry = ::Qn::Analysis::Correlate::Action::GetActionRegistry<Arity>;
-
-    /* Qn::MakeAxes() */
-    std::vector<Qn::AxisD> axes_qn;
-    std::transform(t.axes.begin(), t.axes.end(),
-                   std::back_inserter(axes_qn), ToQnAxis);
-    auto axes_config = MakeAxisConfig(axes_qn, std::make_index_sequence<NAxis>());
-
-    /* weights */
-    auto use_weights = t.weight_type == EQnWeight(EQnWeight::OBSERVABLE) ? UseWeights::Yes : UseWeights::No;
-//    auto weight_function_name = t.weights_function;
-//    auto weight_function = GetActionRegistry().Get(weight_function_name);
-
-    auto result = std::make_shared<CorrelationTaskInitialized>();
-
-    result->output_folder = fs::path(t.output_folder);
-    if (result->output_folder.is_relative()) {
-      throw std::runtime_error("Output folder must be an absolute path");
-    }
+  CorrelationResultPtr BookCorrelation(const Correlation &correlation,
+                                       const Engine::CorrelationKernel &kernel,
+                                       const Engine::EventAxes &event_axes,
+                                       const std::string &event_bin_column,
+                                       std::size_t n_samples);
 
-    for (auto &correlation : GetTaskCombinations(t)) {
-
-      auto args_list = correlation.args_list;
-      std::array<std::string, Arity> args_list_array;
-      std::copy(std::begin(correlation.argument_names), std::end(correlation.argument_names),
-                std::begin(args_list_array));
-
-      try {
-        auto booked_action = Qn::MakeAverageHelper(Qn::Correlation::MakeCorrelationAction(
-            correlation.meta_key,
-            BuildFunction(GetQVectorComponentFct, correlation, std::make_index_sequence<Arity>()),
-            BuildFunction(GetQVectorWeightFct, correlation, std::make_index_sequence<Arity>()),
-            use_weights,
-            args_list_array,
-            axes_config,
-            n_samples_)).BookMe(*df_sampled_);
-
-        correlation.result_ptr = booked_action;
-
-        result->correlations.emplace_back(correlation);
-        Info(__func__, "%s", correlation.meta_key.c_str());
-      } catch (std::exception &e) {
-        Warning(__func__, "Skipping correlation: %s", e.what());
-      }
-    }
+  /**
+   * @brief Books multi-particle correlator of the cumulant task
+   */
+  CorrelationResultPtr BookCumulant(const Correlation &correlation,
+                                    const Engine::EventAxes &event_axes,
+                                    const std::string &event_bin_column,
+                                    std::size_t n_samples);
 
-    result->arity = Arity;
-    result->n_axes = NAxis;
+  /**
+   * @brief Returns column with the first n_samples bootstrap multiplicities
+   */
+  std::string GetSamplesColumn(std::size_t n_samples);
 
-    return result;
-  }
+  std::size_t GetTaskNSamples(const CorrelationTask &t) const;
 
-  template<typename OIter, size_t Arity, size_t NAxes>
-  void InitializeTasksArityNAxes(OIter &&o, const std::vector<CorrelationTask> &tasks) {
-    std::vector<CorrelationTask> tasks_naxes;
-    std::copy_if(tasks.begin(), tasks.end(), std::back_inserter(tasks_naxes), PredicateNAxes<NAxes>);
-    for (auto &t : tasks_naxes) {
-      o = InitializeTask<Arity, NAxes>(t);
-    }
-  }
+  /**
+   * @brief Runs correlations over the first entries with --n-samples samples
+   * and chooses the smallest number of samples per task reaching --samples-precision
+   */
+  void RunPilot();
 
-  template<typename OIter, typename Container, size_t Arity, size_t ...INAxes>
-  void InitializeTasksArity(OIter &&o, Container &&c) {
-    std::vector<typename std::remove_reference_t<Container>::value_type> tasks_arity;
-    std::copy_if(std::begin(c), std::end(c), std::back_inserter(tasks_arity), PredicateArity<Arity>);
-    (InitializeTasksArityNAxes<OIter, Arity, INAxes>(std::forward<OIter>(o), tasks_arity), ...);
-  }
+  /**
+   * @brief Returns column with the linear event bin for the axes,
+   * column is defined once per distinct binning and shared by all correlations
+   */
+  std::string GetEventBinColumn(const std::vector<AxisConfig> &axes, const Engine::EventAxes &event_axes);
 
-  template<typename OIter, typename Container, size_t...IArity, size_t...INAxis>
-  void InitializeTasksImpl(OIter &&o, Container &&c, std::index_sequence<IArity...>, std::index_sequence<INAxis...>) {
-    /* CXX17 folding */
-    (InitializeTasksArity<OIter, Container, IArity, INAxis...>(std::forward<OIter>(o),
-                                                               std::forward<Container>(c)), ...);
-  }
+  /**
+   * @brief Takes task config and initializes IO
+   * @param t
+   * @return
+   */
+  std::shared_ptr<CorrelationTaskInitialized> InitializeTask(const CorrelationTask &t, std::size_t n_samples);
 
   void InitializeTasks();
 
+  /**
+   * @brief Generates and compiles kernels of all correlations, falls back to runtime kernels on failure
+   */
+  void CompileKernels();
+
   fs::path configuration_file_path_{};
   std::string configuration_node_name_{};
   std::string output_file_;
@@ -299,6 +358,10 @@ class CorrelationTaskRunner {
 
   std::vector<CorrelationTask> config_tasks_;
   std::vector<std::shared_ptr<CorrelationTaskInitialized>> initialized_tasks_;
+  std::map<std::string, std::vector<Qn::AxisD>> input_axes_cache_;
+  std::map<std::string, std::set<unsigned int>> input_harmonics_cache_;
+  /* binning key -> name of the event bin column */
+  std::map<std::string, std::string> event_bin_columns_;
 };
 
 }
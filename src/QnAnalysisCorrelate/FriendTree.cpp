@@ -0,0 +1,193 @@
+#include "FriendTree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <TError.h>
+#include <TFile.h>
+
+#include <AnalysisTree/Configuration.hpp>
+#include <AnalysisTree/EventHeader.hpp>
+
+using namespace Qn::Analysis::Correlate;
+
+FriendTree::FriendTree(const std::vector<std::string> &files, const std::string &tree_name) :
+    files_(files),
+    tree_name_(tree_name) {
+  if (files_.empty()) {
+    throw std::runtime_error("No friend files");
+  }
+  std::unique_ptr<TFile> f(TFile::Open(files_.front().c_str(), "READ"));
+  if (!f || f->IsZombie()) {
+    throw std::runtime_error("Unable to open friend file '" + files_.front() + "'");
+  }
+  configuration_.reset(f->Get<AnalysisTree::Configuration>("Configuration"));
+  if (!configuration_) {
+    throw std::runtime_error("No AnalysisTree configuration in '" + files_.front() + "'");
+  }
+
+  TChain chain(tree_name_.c_str(), "");
+  for (auto &file : files_) {
+    chain.Add(file.c_str());
+  }
+  n_entries_ = chain.GetEntries();
+}
+
+FriendTree::~FriendTree() {
+  for (auto &slot : slots_) {
+    ReleaseSlot(slot);
+  }
+}
+
+bool FriendTree::Resolve(const std::string &variable, Field &field) const {
+  /* branch names may contain '_' as well, every split point is tried */
+  for (std::size_t pos = variable.find_first_of("_/"); pos != std::string::npos;
+       pos = variable.find_first_of("_/", pos + 1)) {
+    const auto branch = variable.substr(0, pos);
+    const auto field_name = variable.substr(pos + 1);
+    try {
+      auto &branch_config = configuration_->GetBranchConfig(branch);
+      if (branch_config.GetType() != AnalysisTree::DetType::kEventHeader) {
+        continue;
+      }
+      const auto id = branch_config.GetFieldId(field_name);
+      if (id == AnalysisTree::UndefValueShort) {
+        continue;
+      }
+      field.branch = branch;
+      field.id = id;
+      field.type = int(branch_config.GetFieldType(field_name));
+      return true;
+    } catch (std::exception &) {
+      /* no such branch */
+    }
+  }
+  return false;
+}
+
+std::vector<std::string> FriendTree::Select(const std::set<std::string> &variables) {
+  std::vector<std::string> result;
+  fields_.clear();
+  for (auto &variable : variables) {
+    Field field;
+    if (Resolve(variable, field)) {
+      result.emplace_back(variable);
+      fields_.emplace_back(std::move(field));
+    }
+  }
+  /* readers are reopened with the new fields */
+  Prepare(slots_.size());
+  return result;
+}
+
+void FriendTree::Prepare(unsigned int n_slots) {
+  for (auto &slot : slots_) {
+    ReleaseSlot(slot);
+  }
+  slots_.clear();
+  slots_.resize(std::max(n_slots, 1u));
+}
+
+void FriendTree::ReleaseSlot(Slot &slot) {
+  if (slot.chain) {
+    slot.chain->ResetBranchAddresses();
+    slot.chain.reset();
+  }
+  /* objects allocated by ROOT for the branch addresses */
+  for (auto &header : slot.headers) {
+    delete header.second;
+  }
+  slot.headers.clear();
+  slot.entry = -1;
+}
+
+void FriendTree::InitSlot(Slot &slot) const {
+  slot.chain = std::make_unique<TChain>(tree_name_.c_str(), "");
+  for (auto &file : files_) {
+    slot.chain->Add(file.c_str());
+  }
+  slot.chain->SetBranchStatus("*", false);
+  for (auto &field : fields_) {
+    if (slot.headers.count(field.branch) == 0) {
+      auto &header = slot.headers[field.branch];
+      header = nullptr;
+      /* sub-branches of the event header are enabled as well */
+      slot.chain->SetBranchStatus((field.branch + "*").c_str(), true);
+      slot.chain->SetBranchAddress(field.branch.c_str(), &header);
+    }
+  }
+  slot.values.assign(fields_.size(), std::numeric_limits<double>::quiet_NaN());
+}
+
+double FriendTree::GetValue(const AnalysisTree::EventHeader &header, const Field &field) {
+  switch (AnalysisTree::Types(field.type)) {
+    case AnalysisTree::Types::kFloat: return header.GetField<float>(field.id);
+    case AnalysisTree::Types::kInteger: return header.GetField<int>(field.id);
+    case AnalysisTree::Types::kBool: return header.GetField<bool>(field.id);
+    default: return std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
+const std::vector<double> &FriendTree::ReadEntry(unsigned int slot_id, long long entry) {
+  auto &slot = slots_.at(slot_id);
+  if (!slot.chain) {
+    InitSlot(slot);
+  }
+  if (entry == slot.entry) {
+    return slot.values;
+  }
+  slot.entry = entry;
+  if (entry < 0 || entry >= n_entries_ || slot.chain->GetEntry(entry) <= 0) {
+    std::fill(slot.values.begin(), slot.values.end(), std::numeric_limits<double>::quiet_NaN());
+    return slot.values;
+  }
+  for (std::size_t i = 0; i < fields_.size(); ++i) {
+    auto header = slot.headers.at(fields_[i].branch);
+    slot.values[i] = header ? GetValue(*header, fields_[i]) : std::numeric_limits<double>::quiet_NaN();
+  }
+  return slot.values;
+}
+
+void FriendTree::BuildIndex(const std::string &index_variable) {
+  Field field;
+  if (!Resolve(index_variable, field)) {
+    throw std::runtime_error("Index variable '" + index_variable + "' is not found in the friend event headers");
+  }
+  /* floating point values above 2^24 (float) or 2^53 (double) would map different ids to the same key */
+  if (AnalysisTree::Types(field.type) != AnalysisTree::Types::kInteger) {
+    throw std::runtime_error("Index variable '" + index_variable + "' must be an integer field of the event header");
+  }
+
+  TChain chain(tree_name_.c_str(), "");
+  for (auto &file : files_) {
+    chain.Add(file.c_str());
+  }
+  chain.SetBranchStatus("*", false);
+  chain.SetBranchStatus((field.branch + "*").c_str(), true);
+  AnalysisTree::EventHeader *header{nullptr};
+  chain.SetBranchAddress(field.branch.c_str(), &header);
+
+  index_.clear();
+  index_.reserve(std::size_t(n_entries_));
+  std::size_t n_duplicates = 0;
+  for (long long entry = 0; entry < n_entries_; ++entry) {
+    chain.GetEntry(entry);
+    if (!index_.emplace(header->GetField<int>(field.id), entry).second) {
+      ++n_duplicates;
+    }
+  }
+  chain.ResetBranchAddresses();
+  delete header;
+  if (n_duplicates > 0) {
+    Warning(__func__, "%zu duplicate values of '%s' in the friend, the first entry is used",
+            n_duplicates, index_variable.c_str());
+  }
+  Info(__func__, "Indexed %zu friend entries by '%s'", index_.size(), index_variable.c_str());
+}
+
+long long FriendTree::FindEntry(long long index_value) const {
+  auto it = index_.find(index_value);
+  return it == index_.end() ? -1 : it->second;
+}
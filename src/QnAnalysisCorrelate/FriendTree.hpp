@@ -0,0 +1,95 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_FRIENDTREE_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_FRIENDTREE_HPP
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <TChain.h>
+
+namespace AnalysisTree {
+class Configuration;
+class EventHeader;
+}
+
+namespace Qn::Analysis::Correlate {
+
+/**
+ * @brief Event variables read from the event headers of the original AnalysisTree.
+ *
+ * Variable '<branch>_<field>' (or '<branch>/<field>') is the field of the event header branch,
+ * the same name the correction task gives to the event variable in its output.
+ * Entries are joined either by the entry number in the chain of all input files
+ * (correction output has one entry per AnalysisTree event),
+ * or by the value of the index variable present in both trees.
+ * Each slot reads the friend with its own chain, random access is allowed.
+ */
+class FriendTree {
+ public:
+  FriendTree(const std::vector<std::string> &files, const std::string &tree_name);
+  ~FriendTree();
+
+  /**
+   * @brief Variables of the list available in the friend, these are read by ReadEntry
+   */
+  std::vector<std::string> Select(const std::set<std::string> &variables);
+
+  /**
+   * @brief Allocates readers for the slots of the data frame, they are opened on the first read
+   */
+  void Prepare(unsigned int n_slots);
+
+  /**
+   * @brief Scans the friend and maps values of the index variable to entries.
+   * The index variable must be an integer field, floating point ids are refused.
+   */
+  void BuildIndex(const std::string &index_variable);
+
+  /**
+   * @brief Friend entry of the index value, -1 if not found
+   */
+  [[nodiscard]] long long FindEntry(long long index_value) const;
+
+  /**
+   * @brief Values of the selected variables in the entry, NaN if entry is out of range
+   */
+  const std::vector<double> &ReadEntry(unsigned int slot, long long entry);
+
+  [[nodiscard]] long long GetEntries() const { return n_entries_; }
+  [[nodiscard]] bool HasIndex() const { return !index_.empty(); }
+
+ private:
+  struct Field {
+    std::string branch;
+    int id{0};
+    /* AnalysisTree::Types */
+    int type{0};
+  };
+
+  struct Slot {
+    std::unique_ptr<TChain> chain;
+    std::map<std::string, AnalysisTree::EventHeader *> headers;
+    std::vector<double> values;
+    long long entry{-1};
+  };
+
+  bool Resolve(const std::string &variable, Field &field) const;
+  void InitSlot(Slot &slot) const;
+  static void ReleaseSlot(Slot &slot);
+  static double GetValue(const AnalysisTree::EventHeader &header, const Field &field);
+
+  std::vector<std::string> files_;
+  std::string tree_name_;
+  long long n_entries_{0};
+  std::unique_ptr<AnalysisTree::Configuration> configuration_;
+  std::vector<Field> fields_;
+  std::vector<Slot> slots_;
+  std::unordered_map<long long, long long> index_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_FRIENDTREE_HPP
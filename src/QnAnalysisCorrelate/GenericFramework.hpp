@@ -0,0 +1,161 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_GENERICFRAMEWORK_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_GENERICFRAMEWORK_HPP
+
+#include <complex>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Multi-particle correlators with self-correlations removed,
+ * computed from Q-vectors with the generic framework recursion
+ * (A. Bilandzic et al., Phys. Rev. C 89, 064904 (2014)).
+ */
+namespace Qn::Analysis::Correlate::GenericFramework {
+
+using Complex = std::complex<double>;
+
+/* highest supported order of the correlator */
+constexpr std::size_t MAX_ORDER = 8;
+
+/**
+ * @brief Q-vectors Q_{h,p} = sum_i w_i^p exp(i h phi_i) for |h| <= max_harmonic, 0 <= p <= max_power.
+ * Q_{-h,p} is conj(Q_{h,p})
+ */
+class QVectorPowers {
+ public:
+  QVectorPowers(unsigned int max_harmonic, unsigned int max_power) :
+      max_harmonic_(max_harmonic),
+      max_power_(max_power),
+      q_((max_harmonic + 1) * (max_power + 1)) {}
+
+  void Set(unsigned int harmonic, unsigned int power, Complex value) {
+    q_.at(Index(harmonic, power)) = value;
+  }
+
+  /**
+   * @brief Fills from the Q-vectors of particles with unit weights:
+   * Q_{h,p} = Q_h for any p, Q_{0,p} = multiplicity
+   * @param q function of harmonic returning not normalized Q_h
+   */
+  template<typename Function>
+  void SetUnitWeights(double multiplicity, Function &&q) {
+    for (unsigned int p = 0; p <= max_power_; ++p) {
+      Set(0, p, Complex(multiplicity, 0.));
+      for (unsigned int h = 1; h <= max_harmonic_; ++h) {
+        Set(h, p, q(h));
+      }
+    }
+  }
+
+  [[nodiscard]] Complex operator()(int harmonic, unsigned int power) const {
+    auto value = q_[Index(std::abs(harmonic), power)];
+    return harmonic >= 0 ? value : std::conj(value);
+  }
+
+  [[nodiscard]] unsigned int GetMaxHarmonic() const { return max_harmonic_; }
+  [[nodiscard]] unsigned int GetMaxPower() const { return max_power_; }
+
+ private:
+  [[nodiscard]] std::size_t Index(unsigned int harmonic, unsigned int power) const {
+    return std::size_t(harmonic) * (max_power_ + 1) + power;
+  }
+
+  unsigned int max_harmonic_{0};
+  unsigned int max_power_{0};
+  std::vector<Complex> q_;
+};
+
+/**
+ * @brief Sum over all distinct n-tuples of particles of w_1...w_n exp(i (h_1 phi_1 + ... + h_n phi_n)).
+ * Harmonics are permuted during the recursion and restored on return.
+ */
+inline Complex Recursion(const QVectorPowers &q, int *harmonics, int n, unsigned int mult = 1, int skip = 0) {
+  const int nm1 = n - 1;
+  Complex c = q(harmonics[nm1], mult);
+  if (nm1 == 0) {
+    return c;
+  }
+  c *= Recursion(q, harmonics, nm1);
+  if (nm1 == skip) {
+    return c;
+  }
+
+  const unsigned int multp1 = mult + 1;
+  const int nm2 = n - 2;
+  int counter1 = 0;
+  int hhold = harmonics[counter1];
+  harmonics[counter1] = harmonics[nm2];
+  harmonics[nm2] = hhold + harmonics[nm1];
+  Complex c2 = Recursion(q, harmonics, nm1, multp1, nm2);
+  int counter2 = n - 3;
+  while (counter2 >= skip) {
+    harmonics[nm2] = harmonics[counter1];
+    harmonics[counter1] = hhold;
+    ++counter1;
+    hhold = harmonics[counter1];
+    harmonics[counter1] = harmonics[nm2];
+    harmonics[nm2] = hhold + harmonics[nm1];
+    c2 += Recursion(q, harmonics, nm1, multp1, counter2);
+    --counter2;
+  }
+  harmonics[nm2] = harmonics[counter1];
+  harmonics[counter1] = hhold;
+
+  return c - double(mult) * c2;
+}
+
+/**
+ * @brief Event-wise m-particle correlator <m>_n = <cos n(phi_1 + ... + phi_k - phi_k+1 - ... - phi_m)>
+ * with k = m/2
+ */
+struct Correlator {
+  unsigned int order{2};
+  unsigned int harmonic{2};
+
+  void Validate() const {
+    if (order == 0 || order % 2 != 0 || order > MAX_ORDER) {
+      throw std::out_of_range("Order of the correlator must be even and not greater than 8");
+    }
+    if (harmonic == 0) {
+      throw std::out_of_range("Harmonic of the correlator must be positive");
+    }
+  }
+
+  /* Q_{h,p} are needed for h up to this harmonic */
+  [[nodiscard]] unsigned int MaxHarmonic() const { return harmonic * order / 2; }
+
+  /* harmonics n, 2n, ... m/2 n entering the recursion, the input Q-vector must have all of them */
+  [[nodiscard]] std::vector<unsigned int> RequiredHarmonics() const {
+    std::vector<unsigned int> result;
+    for (unsigned int k = 1; k <= order / 2; ++k) {
+      result.push_back(k * harmonic);
+    }
+    return result;
+  }
+
+  /**
+   * @brief Evaluates the correlator
+   * @param q Q-vector powers up to MaxHarmonic() and order
+   * @param value numerator over denominator
+   * @param weight denominator, number of weighted distinct m-tuples
+   * @return false if the event has less than order particles
+   */
+  bool Eval(const QVectorPowers &q, double &value, double &weight) const {
+    int harmonics[MAX_ORDER]{};
+    for (unsigned int i = 0; i < order; ++i) {
+      harmonics[i] = i < order / 2 ? int(harmonic) : -int(harmonic);
+    }
+    int zeros[MAX_ORDER]{};
+    weight = Recursion(q, zeros, int(order)).real();
+    if (!(weight > 0.)) {
+      return false;
+    }
+    value = Recursion(q, harmonics, int(order)).real() / weight;
+    return true;
+  }
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_GENERICFRAMEWORK_HPP
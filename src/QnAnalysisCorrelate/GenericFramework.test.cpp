@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "GenericFramework.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate::GenericFramework;
+
+struct Particle {
+  double phi;
+  double w;
+};
+
+QVectorPowers MakeQ(const std::vector<Particle> &particles, unsigned int max_harmonic, unsigned int max_power) {
+  QVectorPowers q(max_harmonic, max_power);
+  for (unsigned int h = 0; h <= max_harmonic; ++h) {
+    for (unsigned int p = 0; p <= max_power; ++p) {
+      Complex sum;
+      for (auto &particle : particles) {
+        sum += std::pow(particle.w, p) * std::polar(1., h * particle.phi);
+      }
+      q.Set(h, p, sum);
+    }
+  }
+  return q;
+}
+
+/* sum over distinct ordered tuples by nested loops */
+Complex BruteForce(const std::vector<Particle> &particles, const std::vector<int> &harmonics,
+                   std::vector<std::size_t> &used, Complex product = {1., 0.}) {
+  if (used.size() == harmonics.size()) {
+    return product;
+  }
+  Complex sum;
+  for (std::size_t i = 0; i < particles.size(); ++i) {
+    if (std::find(used.begin(), used.end(), i) != used.end()) {
+      continue;
+    }
+    used.push_back(i);
+    auto &particle = particles[i];
+    sum += BruteForce(particles, harmonics, used,
+                      product * particle.w * std::polar(1., harmonics[used.size() - 1] * particle.phi));
+    used.pop_back();
+  }
+  return sum;
+}
+
+TEST(GenericFramework, RecursionMatchesNestedLoops) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> phi(0., 2 * M_PI);
+  std::uniform_real_distribution<double> w(0.5, 1.5);
+  std::vector<Particle> particles(8);
+  for (auto &particle : particles) {
+    particle = {phi(rng), w(rng)};
+  }
+
+  for (auto harmonics : std::vector<std::vector<int>>{{2, -2}, {3, 2, -1}, {2, 2, -2, -2}, {1, 2, 3, -3, -2, -1}}) {
+    auto q = MakeQ(particles, 6, harmonics.size());
+    std::vector<std::size_t> used;
+    auto expected = BruteForce(particles, harmonics, used);
+    auto harmonics_copy = harmonics;
+    auto result = Recursion(q, harmonics_copy.data(), int(harmonics.size()));
+    EXPECT_NEAR(result.real(), expected.real(), 1e-8 * std::abs(expected) + 1e-8);
+    EXPECT_NEAR(result.imag(), expected.imag(), 1e-8 * std::abs(expected) + 1e-8);
+    /* harmonics are restored */
+    EXPECT_EQ(harmonics_copy, harmonics);
+  }
+}
+
+TEST(GenericFramework, UnitWeights) {
+  /* two-particle correlator with unit weights is (|Q|^2 - M) / (M (M - 1)) */
+  std::vector<Particle> particles{{0.1, 1.}, {0.5, 1.}, {2.0, 1.}, {4.0, 1.}};
+  auto full_q = MakeQ(particles, 2, 1);
+  QVectorPowers q(2, 2);
+  q.SetUnitWeights(4., [&full_q](unsigned int h) { return full_q(int(h), 1); });
+
+  Correlator c2{2, 2};
+  double value = 0., weight = 0.;
+  ASSERT_TRUE(c2.Eval(q, value, weight));
+  EXPECT_DOUBLE_EQ(weight, 12.);
+  EXPECT_NEAR(value, (std::norm(full_q(2, 1)) - 4.) / 12., 1e-12);
+
+  Correlator c6{6, 1};
+  QVectorPowers q6(3, 6);
+  q6.SetUnitWeights(4., [](unsigned int) { return Complex(); });
+  /* less particles than the order */
+  EXPECT_FALSE(c6.Eval(q6, value, weight));
+
+  EXPECT_THROW((Correlator{3, 2}.Validate()), std::out_of_range);
+}
+
+TEST(GenericFramework, RequiredHarmonics) {
+  EXPECT_EQ((Correlator{2, 2}.RequiredHarmonics()), (std::vector<unsigned int>{2}));
+  EXPECT_EQ((Correlator{6, 3}.RequiredHarmonics()), (std::vector<unsigned int>{3, 6, 9}));
+  EXPECT_EQ((Correlator{8, 1}.RequiredHarmonics().back()), (Correlator{8, 1}.MaxHarmonic()));
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_IMPLICITMT_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_IMPLICITMT_HPP
+
+#include <TROOT.h>
+
+namespace Qn::Analysis::Correlate {
+
+/**
+ * @brief Disables implicit multi-threading for the lifetime of the scope and restores the thread pool at its end.
+ * Data frames built and event loops run inside the scope are single-threaded, e.g. those using Range.
+ * Data frames must be destroyed before the scope, declare it first.
+ */
+class SingleThreadScope {
+ public:
+  SingleThreadScope() : n_threads_(ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : 0) {
+    if (n_threads_ > 0) {
+      ROOT::DisableImplicitMT();
+    }
+  }
+  ~SingleThreadScope() {
+    if (n_threads_ > 0) {
+      ROOT::EnableImplicitMT(n_threads_);
+    }
+  }
+  SingleThreadScope(const SingleThreadScope &) = delete;
+  SingleThreadScope &operator=(const SingleThreadScope &) = delete;
+
+ private:
+  unsigned int n_threads_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_IMPLICITMT_HPP
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <ROOT/RDataFrame.hxx>
+#include <TTree.h>
+#include "ImplicitMT.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate;
+
+/* graph of the pilot: Range over the first entries, columns of the entry number, single slot */
+ULong64_t RunPilotGraph(TTree &tree, ULong64_t n_entries) {
+  ROOT::RDataFrame rdf(tree);
+  auto df = rdf.Range(n_entries)
+      .Define("entry_x2", [](ULong64_t entry) { return 2 * entry; }, {"rdfentry_"})
+      .DefineSlot("slot", [](unsigned int slot) { return slot; }, {});
+  auto n_slots = df.Max<unsigned int>("slot");
+  auto sum = df.Sum<ULong64_t>("entry_x2");
+  EXPECT_EQ(*n_slots, 0u);
+  /* entries are read in order from the first one */
+  EXPECT_EQ(*sum, n_entries * (n_entries - 1));
+  return *df.Count();
+}
+
+TEST(ImplicitMT, PilotWithImplicitMT) {
+  TTree tree("tree", "");
+  int value = 0;
+  tree.Branch("value", &value);
+  for (value = 0; value < 1000; ++value) {
+    tree.Fill();
+  }
+
+  ROOT::EnableImplicitMT(2);
+  ASSERT_TRUE(ROOT::IsImplicitMTEnabled());
+  /* Range refuses to run with implicit multi-threading */
+  {
+    ROOT::RDataFrame rdf(tree);
+    EXPECT_ANY_THROW(rdf.Range(10));
+  }
+  {
+    SingleThreadScope single_thread;
+    EXPECT_FALSE(ROOT::IsImplicitMTEnabled());
+    EXPECT_EQ(RunPilotGraph(tree, 100), 100);
+  }
+  /* the thread pool is restored after the pilot */
+  EXPECT_TRUE(ROOT::IsImplicitMTEnabled());
+  EXPECT_EQ(ROOT::GetThreadPoolSize(), 2u);
+  ROOT::DisableImplicitMT();
+
+  /* without implicit multi-threading the scope does nothing */
+  {
+    SingleThreadScope single_thread;
+    EXPECT_EQ(RunPilotGraph(tree, 10), 10);
+  }
+  EXPECT_FALSE(ROOT::IsImplicitMTEnabled());
+}
+
+}
@@ -0,0 +1,56 @@
+#include "KernelJit.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#include <TError.h>
+#include <TSystem.h>
+
+#include <BuildOptions.hpp>
+
+using namespace Qn::Analysis::Correlate::Engine;
+
+bool KernelJit::Compile() {
+  compiled_.clear();
+  if (kernels_.empty()) {
+    return true;
+  }
+
+  if (gSystem->mkdir(cache_dir_.c_str(), true) != 0 && gSystem->AccessPathName(cache_dir_.c_str())) {
+    Error(__func__, "Unable to create JIT cache directory '%s'", cache_dir_.c_str());
+    return false;
+  }
+
+  const auto source = GenerateSource();
+  const auto source_path = cache_dir_ + "/QnAnalysisKernels_" + config_hash_ + ".cxx";
+  {
+    /* source is rewritten only if changed, otherwise ACLiC reuses the compiled library */
+    std::ifstream existing_stream(source_path);
+    std::string existing((std::istreambuf_iterator<char>(existing_stream)), std::istreambuf_iterator<char>());
+    if (existing != source) {
+      std::ofstream source_stream(source_path);
+      source_stream << source;
+      Info(__func__, "Generated %zu kernels to '%s'", kernels_.size(), source_path.c_str());
+    } else {
+      Info(__func__, "Using cached kernels '%s'", source_path.c_str());
+    }
+  }
+
+  gSystem->AddIncludePath(Qn::Analysis::GetJitIncludePath().c_str());
+  if (!gSystem->CompileMacro(source_path.c_str(), "kO", "", cache_dir_.c_str())) {
+    Error(__func__, "Compilation of '%s' failed", source_path.c_str());
+    return false;
+  }
+
+  for (auto &function : functions_) {
+    auto symbol = gSystem->DynFindSymbol("*", function.second.c_str());
+    if (!symbol) {
+      Error(__func__, "Symbol '%s' is not found in the compiled kernels", function.second.c_str());
+      compiled_.clear();
+      return false;
+    }
+    compiled_.emplace(function.first, reinterpret_cast<JitKernelFunction>(symbol));
+  }
+  Info(__func__, "%zu kernels are compiled", compiled_.size());
+  return true;
+}
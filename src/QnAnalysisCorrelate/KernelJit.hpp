@@ -0,0 +1,137 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_KERNELJIT_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_KERNELJIT_HPP
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CorrelationEngine.hpp"
+
+namespace Qn::Analysis::Correlate::Engine {
+
+/**
+ * @brief Generates C++ source of correlation kernels with components, harmonics and weights
+ * as compile-time constants, compiles it with ACLiC and resolves the compiled functions.
+ *
+ * Compiled library is kept in the cache directory under the name derived from the configuration hash,
+ * next runs with the same configuration only load it.
+ */
+class KernelJit {
+ public:
+  /* bump if the generated code changes */
+  static constexpr int CODEGEN_VERSION = 1;
+
+  KernelJit(std::string cache_dir, std::string config_hash) :
+      cache_dir_(std::move(cache_dir)),
+      config_hash_(std::move(config_hash)) {}
+
+  /**
+   * @brief Registers kernel for compilation, identical kernels share the function
+   */
+  void Add(const CorrelationKernel &kernel) {
+    auto signature = Signature(kernel);
+    if (functions_.count(signature) == 0) {
+      functions_.emplace(signature, FunctionName(functions_.size()));
+      kernels_.emplace_back(kernel);
+    }
+  }
+
+  [[nodiscard]] std::size_t size() const { return kernels_.size(); }
+
+  /**
+   * @brief Compiles registered kernels or loads them from the cache
+   * @return false if compilation failed, kernels are not available then
+   */
+  bool Compile();
+
+  /**
+   * @brief Compiled function of the kernel, nullptr if the kernel was not compiled
+   */
+  [[nodiscard]] JitKernelFunction Find(const CorrelationKernel &kernel) const {
+    auto it = compiled_.find(Signature(kernel));
+    return it == compiled_.end() ? nullptr : it->second;
+  }
+
+  [[nodiscard]] std::string GenerateSource() const {
+    std::stringstream source;
+    source << "// generated by QnAnalysisCorrelate, codegen version " << CODEGEN_VERSION << "\n"
+           << "// configuration hash " << config_hash_ << "\n"
+           << "#include <QVector.hpp>\n\n";
+    for (auto &kernel : kernels_) {
+      source << GenerateFunction(functions_.at(Signature(kernel)), kernel) << "\n";
+    }
+    return source.str();
+  }
+
+  /**
+   * @brief Unique textual description of the kernel
+   */
+  static std::string Signature(const CorrelationKernel &kernel) {
+    std::stringstream signature;
+    signature << kernel.arity << (kernel.use_weights ? "w" : "");
+    for (std::size_t i = 0; i < kernel.arity; ++i) {
+      signature << ":" << int(kernel.components[i].component) << "." << kernel.components[i].harmonic
+                << "." << int(kernel.weights[i].type);
+    }
+    return signature.str();
+  }
+
+  /**
+   * @brief Branch-free function, evaluation order and precision are identical to CorrelationKernel
+   */
+  static std::string GenerateFunction(const std::string &name, const CorrelationKernel &kernel) {
+    std::stringstream code;
+    code << "// " << Signature(kernel) << "\n"
+         << "extern \"C\" bool " << name
+         << "(const Qn::QVector *const *q, double *value, double *weight) {\n";
+    for (std::size_t i = 0; i < kernel.arity; ++i) {
+      code << "  if (!(q[" << i << "]->sumweights() > 0.)) return false;\n";
+    }
+
+    code << "  float v = 1.f;\n";
+    for (std::size_t i = 0; i < kernel.arity; ++i) {
+      const auto h = kernel.components[i].harmonic;
+      const std::string qi = "q[" + std::to_string(i) + "]->";
+      code << "  v *= float(";
+      switch (kernel.components[i].component) {
+        case QVectorComponentFct::kX: code << qi << "x(" << h << ")"; break;
+        case QVectorComponentFct::kY: code << qi << "y(" << h << ")"; break;
+        case QVectorComponentFct::kCos: code << qi << "x(" << h << ") / " << qi << "mag(" << h << ")"; break;
+        case QVectorComponentFct::kSin: code << qi << "y(" << h << ") / " << qi << "mag(" << h << ")"; break;
+      }
+      code << ");\n";
+    }
+
+    code << "  float w = 1.f;\n";
+    if (kernel.use_weights) {
+      for (std::size_t i = 0; i < kernel.arity; ++i) {
+        if (kernel.weights[i].type == QVectorWeightFct::kSumw) {
+          code << "  w *= float(q[" << i << "]->sumweights());\n";
+        }
+      }
+    }
+    code << "  *value = v;\n"
+         << "  *weight = w;\n"
+         << "  return true;\n"
+         << "}\n";
+    return code.str();
+  }
+
+ private:
+  [[nodiscard]] std::string FunctionName(std::size_t index) const {
+    return "qnanalysis_kernel_" + config_hash_ + "_" + std::to_string(index);
+  }
+
+  std::string cache_dir_;
+  std::string config_hash_;
+  /* signature -> function name */
+  std::map<std::string, std::string> functions_;
+  std::vector<CorrelationKernel> kernels_;
+  /* signature -> compiled function */
+  std::map<std::string, JitKernelFunction> compiled_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_KERNELJIT_HPP
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include "KernelJit.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate::Engine;
+
+CorrelationKernel MakeKernel(QVectorComponentFct::EComp c0, QVectorComponentFct::EComp c1, unsigned int harmonic) {
+  CorrelationKernel kernel;
+  kernel.arity = 2;
+  kernel.components[0] = {c0, harmonic};
+  kernel.components[1] = {c1, harmonic};
+  return kernel;
+}
+
+TEST(KernelJit, Deduplication) {
+  KernelJit jit("/tmp", "0123");
+  jit.Add(MakeKernel(QVectorComponentFct::kX, QVectorComponentFct::kX, 1));
+  jit.Add(MakeKernel(QVectorComponentFct::kX, QVectorComponentFct::kX, 1));
+  jit.Add(MakeKernel(QVectorComponentFct::kX, QVectorComponentFct::kY, 1));
+  jit.Add(MakeKernel(QVectorComponentFct::kX, QVectorComponentFct::kX, 2));
+  EXPECT_EQ(jit.size(), 3);
+  /* nothing is compiled yet */
+  EXPECT_EQ(jit.Find(MakeKernel(QVectorComponentFct::kX, QVectorComponentFct::kX, 1)), nullptr);
+}
+
+TEST(KernelJit, GeneratedFunction) {
+  auto kernel = MakeKernel(QVectorComponentFct::kX, QVectorComponentFct::kSin, 3);
+  kernel.use_weights = true;
+  kernel.weights[1].type = QVectorWeightFct::kSumw;
+
+  auto code = KernelJit::GenerateFunction("f", kernel);
+  EXPECT_NE(code.find("extern \"C\" bool f(const Qn::QVector *const *q, double *value, double *weight)"),
+            std::string::npos);
+  EXPECT_NE(code.find("v *= float(q[0]->x(3));"), std::string::npos);
+  EXPECT_NE(code.find("v *= float(q[1]->y(3) / q[1]->mag(3));"), std::string::npos);
+  EXPECT_NE(code.find("w *= float(q[1]->sumweights());"), std::string::npos);
+  EXPECT_EQ(code.find("w *= float(q[0]->sumweights());"), std::string::npos);
+}
+
+}
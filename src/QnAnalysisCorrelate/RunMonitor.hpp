@@ -0,0 +1,253 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_RUNMONITOR_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_RUNMONITOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace Qn::Analysis::Correlate::Monitor {
+
+using Clock = std::chrono::steady_clock;
+
+/* slot counters are checked every N events of the slot */
+constexpr std::uint64_t PROGRESS_CHECK_N_EVENTS = 1000;
+
+inline double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Peak resident set size of the process in bytes
+ */
+inline std::uint64_t PeakRSSBytes() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return std::uint64_t(usage.ru_maxrss);
+#else
+  return std::uint64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/**
+ * @brief Snapshot of the event loop progress
+ */
+struct Progress {
+  double elapsed{0.};
+  std::uint64_t n_events{0};
+  std::uint64_t n_events_total{0};
+  std::uint64_t bytes_read{0};
+  /* events processed by each slot */
+  std::vector<std::uint64_t> slot_events;
+
+  [[nodiscard]] double EventsPerSecond() const { return elapsed > 0. ? n_events / elapsed : 0.; }
+  [[nodiscard]] double MBPerSecond() const { return elapsed > 0. ? bytes_read / 1024. / 1024. / elapsed : 0.; }
+  [[nodiscard]] double Fraction() const {
+    return n_events_total > 0 ? std::min(1., double(n_events) / double(n_events_total)) : 0.;
+  }
+  /**
+   * @brief Estimated time till the end of the loop in seconds, negative if unknown
+   */
+  [[nodiscard]] double ETA() const {
+    if (n_events == 0 || n_events_total == 0) {
+      return -1.;
+    }
+    return elapsed * double(n_events_total - std::min(n_events, n_events_total)) / double(n_events);
+  }
+  /**
+   * @brief Share of events processed by the slot relative to the equal share, 1 - slot is fully busy.
+   * Slots stalled on I/O or starving for tasks fall behind.
+   */
+  [[nodiscard]] std::vector<double> SlotUtilization() const {
+    std::vector<double> result(slot_events.size(), 0.);
+    if (n_events == 0) {
+      return result;
+    }
+    const double equal_share = double(n_events) / double(slot_events.size());
+    for (std::size_t i = 0; i < slot_events.size(); ++i) {
+      result[i] = double(slot_events[i]) / equal_share;
+    }
+    return result;
+  }
+};
+
+inline std::string FormatDuration(double seconds) {
+  if (seconds < 0.) {
+    return "?";
+  }
+  auto s = static_cast<long long>(seconds + 0.5);
+  std::stringstream stream;
+  stream << s / 3600 << ":" << std::setw(2) << std::setfill('0') << (s / 60) % 60
+         << ":" << std::setw(2) << std::setfill('0') << s % 60;
+  return stream.str();
+}
+
+inline std::string FormatProgress(const Progress &p) {
+  std::stringstream stream;
+  stream << std::fixed << std::setprecision(1)
+         << p.n_events << "/" << p.n_events_total << " events (" << 100. * p.Fraction() << "%), "
+         << p.EventsPerSecond() << " ev/s, "
+         << p.MBPerSecond() << " MB/s, "
+         << "ETA " << FormatDuration(p.ETA());
+  if (p.slot_events.size() > 1) {
+    stream << ", slots [" << std::setprecision(2);
+    auto utilization = p.SlotUtilization();
+    for (std::size_t i = 0; i < utilization.size(); ++i) {
+      stream << (i > 0 ? " " : "") << utilization[i];
+    }
+    stream << "]";
+  }
+  return stream.str();
+}
+
+/**
+ * @brief Collects per-slot event counts from the event loop callbacks
+ * and decides when the progress should be reported.
+ * Callbacks of different slots come from different threads.
+ */
+class ProgressMonitor {
+ public:
+  ProgressMonitor(std::size_t n_slots, std::uint64_t n_events_total, double report_interval) :
+      slot_events_(n_slots),
+      n_events_total_(n_events_total),
+      report_interval_(report_interval) {}
+
+  void Start(std::uint64_t bytes_read) {
+    start_ = Clock::now();
+    last_report_ = 0.;
+    bytes_read_start_ = bytes_read;
+  }
+
+  /**
+   * @brief Updates number of events processed by the slot
+   * @return true if the progress should be reported now
+   */
+  bool Update(unsigned int slot, std::uint64_t slot_events) {
+    slot_events_.at(slot).store(slot_events, std::memory_order_relaxed);
+    if (report_interval_ <= 0.) {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(report_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return false;
+    }
+    auto elapsed = SecondsSince(start_);
+    if (elapsed - last_report_ < report_interval_) {
+      return false;
+    }
+    last_report_ = elapsed;
+    return true;
+  }
+
+  [[nodiscard]] Progress GetProgress(std::uint64_t bytes_read) const {
+    Progress p;
+    p.elapsed = SecondsSince(start_);
+    p.n_events_total = n_events_total_;
+    p.bytes_read = bytes_read - std::min(bytes_read, bytes_read_start_);
+    for (auto &slot_events : slot_events_) {
+      p.slot_events.emplace_back(slot_events.load(std::memory_order_relaxed));
+      p.n_events += p.slot_events.back();
+    }
+    return p;
+  }
+
+ private:
+  std::vector<std::atomic<std::uint64_t>> slot_events_;
+  std::uint64_t n_events_total_{0};
+  double report_interval_{0.};
+  Clock::time_point start_{Clock::now()};
+  std::uint64_t bytes_read_start_{0};
+  std::mutex report_mutex_;
+  double last_report_{0.};
+};
+
+/**
+ * @brief Machine-readable summary of the run
+ */
+struct RunSummary {
+  /* wall time of the phases in seconds */
+  std::map<std::string, double> phases;
+  std::uint64_t n_events{0};
+  std::uint64_t bytes_read{0};
+  std::size_t n_slots{1};
+  std::size_t n_correlations{0};
+  std::uint64_t peak_rss_bytes{0};
+
+  [[nodiscard]] double TotalTime() const {
+    double total = 0.;
+    for (auto &phase : phases) {
+      total += phase.second;
+    }
+    return total;
+  }
+
+  [[nodiscard]] std::string ToJSON() const {
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\n";
+    stream << "  \"phases\": {";
+    bool first = true;
+    for (auto &phase : phases) {
+      stream << (first ? "" : ",") << "\n    \"" << phase.first << "\": " << phase.second;
+      first = false;
+    }
+    stream << "\n  },\n";
+    stream << "  \"total_time\": " << TotalTime() << ",\n";
+    stream << "  \"n_events\": " << n_events << ",\n";
+    stream << "  \"bytes_read\": " << bytes_read << ",\n";
+    stream << "  \"n_slots\": " << n_slots << ",\n";
+    stream << "  \"n_correlations\": " << n_correlations << ",\n";
+    stream << "  \"peak_rss_bytes\": " << peak_rss_bytes << "\n";
+    stream << "}\n";
+    return stream.str();
+  }
+};
+
+/**
+ * @brief Adds wall time of the scope to the phase of the summary.
+ * Time of the phases nested in the scope is not counted in this one, so phases add up to the total time.
+ */
+class ScopedPhase {
+ public:
+  ScopedPhase(RunSummary &summary, std::string name) :
+      summary_(summary), name_(std::move(name)), outer_(CurrentRef()) {
+    CurrentRef() = this;
+  }
+  ~ScopedPhase() {
+    const auto elapsed = SecondsSince(start_);
+    summary_.phases[name_] += elapsed - nested_time_;
+    if (outer_) {
+      outer_->nested_time_ += elapsed;
+    }
+    CurrentRef() = outer_;
+  }
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+ private:
+  /* phases are opened and closed by the main thread only */
+  static ScopedPhase *&CurrentRef() {
+    static ScopedPhase *current = nullptr;
+    return current;
+  }
+
+  RunSummary &summary_;
+  std::string name_;
+  ScopedPhase *outer_;
+  double nested_time_{0.};
+  Clock::time_point start_{Clock::now()};
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_RUNMONITOR_HPP
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "RunMonitor.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate::Monitor;
+
+TEST(RunMonitor, Progress) {
+  Progress p;
+  p.elapsed = 10.;
+  p.n_events = 1000;
+  p.n_events_total = 4000;
+  p.bytes_read = 20 * 1024 * 1024;
+  p.slot_events = {600, 400};
+
+  EXPECT_DOUBLE_EQ(p.EventsPerSecond(), 100.);
+  EXPECT_DOUBLE_EQ(p.MBPerSecond(), 2.);
+  EXPECT_DOUBLE_EQ(p.ETA(), 30.);
+  auto utilization = p.SlotUtilization();
+  EXPECT_DOUBLE_EQ(utilization[0], 1.2);
+  EXPECT_DOUBLE_EQ(utilization[1], 0.8);
+  EXPECT_EQ(FormatDuration(3725.), "1:02:05");
+  EXPECT_EQ(FormatDuration(-1.), "?");
+}
+
+TEST(RunMonitor, ProgressMonitor) {
+  ProgressMonitor monitor(2, 100, 0.);
+  monitor.Start(1000);
+  EXPECT_FALSE(monitor.Update(0, 10));
+  EXPECT_FALSE(monitor.Update(1, 5));
+  auto p = monitor.GetProgress(3000);
+  EXPECT_EQ(p.n_events, 15);
+  EXPECT_EQ(p.bytes_read, 2000);
+}
+
+TEST(RunMonitor, SummaryJSON) {
+  RunSummary summary;
+  summary.phases["init"] = 1.;
+  summary.phases["event_loop"] = 2.5;
+  summary.n_events = 42;
+  auto json = summary.ToJSON();
+  EXPECT_NE(json.find("\"event_loop\": 2.500"), std::string::npos);
+  EXPECT_NE(json.find("\"total_time\": 3.500"), std::string::npos);
+  EXPECT_NE(json.find("\"n_events\": 42"), std::string::npos);
+}
+
+TEST(RunMonitor, NestedPhases) {
+  RunSummary summary;
+  {
+    ScopedPhase outer(summary, "initialization");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+      ScopedPhase inner(summary, "pilot");
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+  /* pilot is not counted twice */
+  EXPECT_GE(summary.phases["pilot"], 0.05);
+  EXPECT_LT(summary.phases["initialization"], 0.05);
+  EXPECT_NEAR(summary.TotalTime(), summary.phases["pilot"] + summary.phases["initialization"], 1e-9);
+}
+
+}
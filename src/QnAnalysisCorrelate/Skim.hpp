@@ -0,0 +1,105 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISCORRELATE_SKIM_HPP
+#define QNANALYSIS_SRC_QNANALYSISCORRELATE_SKIM_HPP
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "CorrelationMeta.hpp"
+
+/**
+ * Reduced input for repeated correlation studies: only Q-vectors and event variables
+ * used by the configuration, entries in the same order as in the source chain.
+ */
+namespace Qn::Analysis::Correlate::Skim {
+
+/* Name of the TObjString with skim meta, its presence marks the file as skim */
+constexpr const char *SKIM_META_NAME = "skim_meta";
+constexpr const char *SKIM_TREE_NAME = "skim";
+/* ROOT compression setting (algorithm * 100 + level), LZ4 is the fastest to decompress */
+constexpr int DEFAULT_COMPRESSION = 404;
+
+/**
+ * @brief Name of the float branch of the event variable,
+ * double column with the original name is defined when the skim is read
+ */
+inline std::string VariableBranchName(const std::string &variable) {
+  return "skim_" + variable;
+}
+
+struct SkimMeta {
+  std::string source_tree;
+  /* files of the source chain, entry numbers of the skim are entry numbers in their chain */
+  std::vector<ProcessedFile> source_files;
+  long long n_entries{0};
+  int compression{DEFAULT_COMPRESSION};
+  std::vector<std::string> q_vectors;
+  std::vector<std::string> variables;
+
+  [[nodiscard]] bool HasVariable(const std::string &name) const {
+    return std::find(variables.begin(), variables.end(), name) != variables.end();
+  }
+
+  /**
+   * @brief Columns not available in the skim
+   */
+  [[nodiscard]] std::vector<std::string> Missing(const std::set<std::string> &columns) const {
+    std::vector<std::string> result;
+    for (auto &column : columns) {
+      if (!HasVariable(column) && std::find(q_vectors.begin(), q_vectors.end(), column) == q_vectors.end()) {
+        result.emplace_back(column);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * @brief Names of the skim branches holding the columns
+   */
+  [[nodiscard]] std::set<std::string> ToBranches(const std::set<std::string> &columns) const {
+    std::set<std::string> result;
+    for (auto &column : columns) {
+      result.emplace(HasVariable(column) ? VariableBranchName(column) : column);
+    }
+    return result;
+  }
+};
+
+}
+
+namespace YAML {
+
+template<>
+struct convert<Qn::Analysis::Correlate::Skim::SkimMeta> {
+  static Node encode(const Qn::Analysis::Correlate::Skim::SkimMeta &meta) {
+    Node node;
+    node["source-tree"] = meta.source_tree;
+    node["source-files"] = meta.source_files;
+    node["n-entries"] = meta.n_entries;
+    node["compression"] = meta.compression;
+    node["q-vectors"] = meta.q_vectors;
+    node["variables"] = meta.variables;
+    return node;
+  }
+
+  static bool decode(const Node &node, Qn::Analysis::Correlate::Skim::SkimMeta &meta) {
+    using namespace Qn::Analysis::Correlate;
+    if (!node.IsMap()) {
+      return false;
+    }
+    meta.source_tree = node["source-tree"].as<std::string>("");
+    meta.source_files = node["source-files"].as<std::vector<ProcessedFile>>(std::vector<ProcessedFile>{});
+    meta.n_entries = node["n-entries"].as<long long>(0);
+    meta.compression = node["compression"].as<int>(Skim::DEFAULT_COMPRESSION);
+    meta.q_vectors = node["q-vectors"].as<std::vector<std::string>>(std::vector<std::string>{});
+    meta.variables = node["variables"].as<std::vector<std::string>>(std::vector<std::string>{});
+    return true;
+  }
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISCORRELATE_SKIM_HPP
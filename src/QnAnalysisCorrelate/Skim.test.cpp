@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include "Skim.hpp"
+
+namespace {
+
+using namespace Qn::Analysis::Correlate;
+using namespace Qn::Analysis::Correlate::Skim;
+
+TEST(Skim, MetaRoundTrip) {
+  SkimMeta meta;
+  meta.source_tree = "tree";
+  meta.source_files = {{"a.root", "0123", 100}, {"b.root", "4567", 50}};
+  meta.n_entries = 150;
+  meta.q_vectors = {"psd1_RECENTERED", "tpc_PLAIN"};
+  meta.variables = {"Centrality"};
+
+  YAML::Node node;
+  node = meta;
+  auto read_meta = YAML::Load(YAML::Dump(node)).as<SkimMeta>();
+  EXPECT_EQ(read_meta.source_tree, "tree");
+  ASSERT_EQ(read_meta.source_files.size(), 2);
+  EXPECT_EQ(read_meta.source_files[1].n_entries, 50);
+  EXPECT_EQ(read_meta.n_entries, 150);
+  EXPECT_EQ(read_meta.compression, DEFAULT_COMPRESSION);
+  EXPECT_EQ(read_meta.q_vectors, meta.q_vectors);
+  EXPECT_EQ(read_meta.variables, meta.variables);
+}
+
+TEST(Skim, Columns) {
+  SkimMeta meta;
+  meta.q_vectors = {"psd1_RECENTERED"};
+  meta.variables = {"Centrality"};
+
+  EXPECT_TRUE(meta.Missing({"psd1_RECENTERED", "Centrality"}).empty());
+  EXPECT_EQ(meta.Missing({"psd1_RECENTERED", "psd2_RECENTERED", "Multiplicity"}),
+            (std::vector<std::string>{"Multiplicity", "psd2_RECENTERED"}));
+  EXPECT_EQ(meta.ToBranches({"psd1_RECENTERED", "Centrality"}),
+            (std::set<std::string>{"psd1_RECENTERED", VariableBranchName("Centrality")}));
+}
+
+}
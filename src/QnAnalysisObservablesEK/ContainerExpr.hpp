@@ -0,0 +1,277 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISOBSERVABLES_CONTAINEREXPR_HPP
+#define QNANALYSIS_SRC_QNANALYSISOBSERVABLES_CONTAINEREXPR_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <DataContainer.hpp>
+
+/**
+ * @brief Lazy arithmetic on DataContainer. Operators only build the expression,
+ * Evaluate() computes it bin by bin into a single new container, intermediate containers are not allocated.
+ *
+ * Bins are combined by the operators of the bin type, statistics (bootstrap samples included)
+ * are propagated exactly as by the operators of DataContainer.
+ * Operands having a subset of the axes of the largest operand are broadcast over the remaining axes,
+ * other combinations are evaluated by the operators of DataContainer.
+ *
+ *    auto v1 = Evaluate(2 * Lazy(uQ) / Lazy(resolution));
+ */
+namespace Tools::Expr {
+
+template<typename E>
+struct Expression {
+  const E &Self() const { return static_cast<const E &>(*this); }
+};
+
+/**
+ * @brief Operand of the expression, refers to the container (it must outlive the expression)
+ */
+template<typename Container>
+class Ref : public Expression<Ref<Container>> {
+ public:
+  typedef Container container_type;
+  typedef std::decay_t<decltype(std::declval<const Container &>().GetIndex(std::size_t(0)))> Index;
+
+  explicit Ref(const Container &container) : container_(&container) {}
+
+  template<typename Function>
+  void ForEachContainer(Function &&fct) const { fct(*container_); }
+
+  /**
+   * @brief Maps axes of the container to the axes of @p shape
+   * @return false if the container can't be broadcast to the shape
+   */
+  bool Bind(const Container &shape, bool &needs_index) const {
+    is_aligned_ = true;
+    axis_map_.clear();
+    if (container_ == &shape) {
+      return true;
+    }
+    const auto &axes = container_->GetAxes();
+    const auto &shape_axes = shape.GetAxes();
+    for (const auto &axis : axes) {
+      std::size_t pos = 0;
+      while (pos < shape_axes.size() && shape_axes[pos].Name() != axis.Name()) {
+        ++pos;
+      }
+      if (pos == shape_axes.size() || !IsSameBinning(axis, shape_axes[pos])) {
+        return false;
+      }
+      if (pos != axis_map_.size()) {
+        is_aligned_ = false;
+      }
+      axis_map_.push_back(pos);
+    }
+    if (axes.size() != shape_axes.size()) {
+      is_aligned_ = false;
+    }
+    if (!is_aligned_) {
+      scratch_.resize(axis_map_.size());
+      needs_index = true;
+    }
+    return true;
+  }
+
+  decltype(auto) Bin(std::size_t ibin, const Index &index) const {
+    if (is_aligned_) {
+      return container_->At(ibin);
+    }
+    for (std::size_t i = 0; i < axis_map_.size(); ++i) {
+      scratch_[i] = index[axis_map_[i]];
+    }
+    return container_->At(scratch_);
+  }
+
+  const Container &Materialize() const { return *container_; }
+
+ private:
+  template<typename Axis>
+  static bool IsSameBinning(const Axis &lhs, const Axis &rhs) {
+    if (lhs.GetNBins() != rhs.GetNBins()) {
+      return false;
+    }
+    for (decltype(lhs.GetNBins()) ibin = 0; ibin < lhs.GetNBins(); ++ibin) {
+      if (lhs.GetLowerBinEdge(ibin) != rhs.GetLowerBinEdge(ibin)
+          || lhs.GetUpperBinEdge(ibin) != rhs.GetUpperBinEdge(ibin)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const Container *container_;
+  /// bins of the container and the shape have the same linear indices
+  mutable bool is_aligned_{true};
+  /// axis of the container -> axis of the shape
+  mutable std::vector<std::size_t> axis_map_;
+  mutable Index scratch_;
+};
+
+class Scalar : public Expression<Scalar> {
+ public:
+  explicit Scalar(double value) : value_(value) {}
+
+  template<typename Function>
+  void ForEachContainer(Function &&) const {}
+
+  template<typename Container>
+  bool Bind(const Container &, bool &) const { return true; }
+
+  template<typename Index>
+  double Bin(std::size_t, const Index &) const { return value_; }
+
+  double Materialize() const { return value_; }
+
+ private:
+  double value_;
+};
+
+template<typename E>
+struct ContainerType { typedef typename E::container_type type; };
+
+template<>
+struct ContainerType<Scalar> { typedef void type; };
+
+template<typename Op, typename L, typename R>
+class Binary : public Expression<Binary<Op, L, R>> {
+ public:
+  typedef std::conditional_t<std::is_void_v<typename ContainerType<L>::type>,
+                             typename ContainerType<R>::type,
+                             typename ContainerType<L>::type> container_type;
+
+  Binary(L lhs, R rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+
+  template<typename Function>
+  void ForEachContainer(Function &&fct) const {
+    lhs_.ForEachContainer(fct);
+    rhs_.ForEachContainer(fct);
+  }
+
+  bool Bind(const container_type &shape, bool &needs_index) const {
+    return lhs_.Bind(shape, needs_index) && rhs_.Bind(shape, needs_index);
+  }
+
+  template<typename Index>
+  auto Bin(std::size_t ibin, const Index &index) const {
+    return Op()(lhs_.Bin(ibin, index), rhs_.Bin(ibin, index));
+  }
+
+  container_type Materialize() const {
+    return Op()(lhs_.Materialize(), rhs_.Materialize());
+  }
+
+ private:
+  L lhs_;
+  R rhs_;
+};
+
+template<typename Op, typename A>
+class Unary : public Expression<Unary<Op, A>> {
+ public:
+  typedef typename A::container_type container_type;
+
+  explicit Unary(A arg) : arg_(std::move(arg)) {}
+
+  template<typename Function>
+  void ForEachContainer(Function &&fct) const { arg_.ForEachContainer(fct); }
+
+  bool Bind(const container_type &shape, bool &needs_index) const { return arg_.Bind(shape, needs_index); }
+
+  template<typename Index>
+  auto Bin(std::size_t ibin, const Index &index) const { return Op()(arg_.Bin(ibin, index)); }
+
+  container_type Materialize() const { return Op()(arg_.Materialize()); }
+
+ private:
+  A arg_;
+};
+
+/* operations are the same for bins and for containers (fallback) */
+struct Plus {
+  template<typename L, typename R>
+  auto operator()(const L &lhs, const R &rhs) const { return lhs + rhs; }
+};
+
+struct Minus {
+  template<typename L, typename R>
+  auto operator()(const L &lhs, const R &rhs) const { return lhs - rhs; }
+};
+
+struct Multiplies {
+  template<typename L, typename R>
+  auto operator()(const L &lhs, const R &rhs) const { return lhs * rhs; }
+};
+
+struct Divides {
+  template<typename L, typename R>
+  auto operator()(const L &lhs, const R &rhs) const { return lhs / rhs; }
+};
+
+struct SqrtOp {
+  template<typename A>
+  auto operator()(const A &arg) const { return Qn::Sqrt(arg); }
+};
+
+template<typename Container>
+Ref<Container> Lazy(const Container &container) {
+  return Ref<Container>(container);
+}
+
+#define QNANALYSIS_CONTAINER_EXPR_OPERATOR(OP, FUNCTOR) \
+template<typename L, typename R> \
+Binary<FUNCTOR, L, R> operator OP(const Expression<L> &lhs, const Expression<R> &rhs) { \
+  return {lhs.Self(), rhs.Self()}; \
+} \
+template<typename R> \
+Binary<FUNCTOR, Scalar, R> operator OP(double lhs, const Expression<R> &rhs) { \
+  return {Scalar(lhs), rhs.Self()}; \
+} \
+template<typename L> \
+Binary<FUNCTOR, L, Scalar> operator OP(const Expression<L> &lhs, double rhs) { \
+  return {lhs.Self(), Scalar(rhs)}; \
+}
+
+QNANALYSIS_CONTAINER_EXPR_OPERATOR(+, Plus)
+QNANALYSIS_CONTAINER_EXPR_OPERATOR(-, Minus)
+QNANALYSIS_CONTAINER_EXPR_OPERATOR(*, Multiplies)
+QNANALYSIS_CONTAINER_EXPR_OPERATOR(/, Divides)
+
+#undef QNANALYSIS_CONTAINER_EXPR_OPERATOR
+
+template<typename A>
+Unary<SqrtOp, A> Sqrt(const Expression<A> &arg) {
+  return Unary<SqrtOp, A>(arg.Self());
+}
+
+/**
+ * @brief Computes the expression into a new container with the axes of the largest operand
+ */
+template<typename E>
+typename E::container_type Evaluate(const Expression<E> &expression) {
+  using Container = typename E::container_type;
+  const auto &e = expression.Self();
+  const Container *shape = nullptr;
+  e.ForEachContainer([&shape](const Container &container) {
+    if (!shape || container.GetAxes().size() > shape->GetAxes().size()) {
+      shape = &container;
+    }
+  });
+
+  bool needs_index = false;
+  if (!e.Bind(*shape, needs_index)) {
+    return Container(e.Materialize());
+  }
+  Container result(shape->GetAxes());
+  const typename Ref<Container>::Index no_index;
+  for (std::size_t ibin = 0; ibin < result.size(); ++ibin) {
+    result.At(ibin) = needs_index ? e.Bin(ibin, shape->GetIndex(ibin)) : e.Bin(ibin, no_index);
+  }
+  return result;
+}
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLES_CONTAINEREXPR_HPP
@@ -0,0 +1,404 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISOBSERVABLES_DEFINECACHE_HPP
+#define QNANALYSIS_SRC_QNANALYSISOBSERVABLES_DEFINECACHE_HPP
+
+#include <any>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include <boost/regex.hpp>
+
+#include <TBufferFile.h>
+#include <TClass.h>
+#include <TError.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TObjString.h>
+
+#include "ResourceManager.hpp"
+
+namespace Tools {
+
+/**
+ * @brief Results of Define and DefineLazy kept on disk between runs.
+ *
+ * Entry is identified by the hash of the argument contents, the function, the result type,
+ * the override meta and the cache version, a rerun with unchanged inputs reads the result instead of computing it.
+ * Objects read from ROOT files are identified by their keys, results of Define by their entries,
+ * other arguments by the serialized objects.
+ * Functions are identified by the type and, for function pointers, by the symbol,
+ * the version must be changed when the code of a derivation changes.
+ * Results of type Resource are stored as the object and its meta.
+ * Stateful callables and results without ROOT dictionary are always computed.
+ *
+ * While the cache is alive, Define and DefineLazy read and write it.
+ */
+class DefineCache {
+ public:
+  /// TObjString with "<hash> <resource name>" lines
+  static constexpr const char *INDEX_NAME = "define_cache_index";
+  /// suffix of the entry keeping the meta of the Resource result
+  static constexpr const char *META_SUFFIX = ".meta";
+
+  explicit DefineCache(std::string filename, std::string version = "") :
+      filename_(std::move(filename)), version_(std::move(version)), previous_(CurrentRef()) {
+    file_.reset(TFile::Open(filename_.c_str(), "UPDATE"));
+    if (!file_ || file_->IsZombie()) {
+      throw std::runtime_error("Unable to open define cache '" + filename_ + "'");
+    }
+    ReadIndex();
+    CurrentRef() = this;
+  }
+  DefineCache(const DefineCache &) = delete;
+  DefineCache &operator=(const DefineCache &) = delete;
+  ~DefineCache() {
+    CurrentRef() = previous_;
+    Close();
+  }
+
+  static DefineCache *Current() { return CurrentRef(); }
+
+  /**
+   * @brief Hash identifying the result of @p fct applied to @p arg_names, empty if the result can't be cached
+   * @throws ResourceManager::NoSuchResource if argument is missing or has different type
+   */
+  template<typename Result, typename ArgsTuple, typename Function>
+  std::string Key(const Function &fct,
+                  const std::vector<std::string> &arg_names,
+                  const ResourceManager::MetaType &meta_to_override) {
+    const auto function_id = FunctionId(fct);
+    std::string result_type;
+    if constexpr (std::is_same_v<Result, ResourceManager::Resource>) {
+      /* type of the object is known after the computation, it is checked by Store() */
+      result_type = "Resource";
+    } else if (auto result_class = TClass::GetClass<Result>(); result_class && result_class->HasDictionary()) {
+      result_type = result_class->GetName();
+    }
+    std::stringstream key;
+    bool is_cacheable = !function_id.empty() && !result_type.empty();
+    if (is_cacheable) {
+      key << version_ << "\n" << function_id << "\n" << result_type << "\n";
+      meta_to_override.Print(key);
+      key << "\n";
+      is_cacheable = ArgHashes<ArgsTuple>(arg_names, key, std::make_index_sequence<std::tuple_size_v<ArgsTuple>>());
+    }
+
+    std::lock_guard lock(mutex_);
+    if (!is_cacheable) {
+      ++n_uncacheable_;
+      return {};
+    }
+    return HashString(key.str());
+  }
+
+  /**
+   * @brief Reads the result stored under @p key, nullopt on miss
+   */
+  template<typename Result>
+  std::optional<Result> Load(const std::string &key) {
+    if (key.empty()) {
+      return std::nullopt;
+    }
+    std::lock_guard lock(mutex_);
+    std::optional<Result> result;
+    if (index_.count(key) > 0) {
+      if constexpr (std::is_same_v<Result, ResourceManager::Resource>) {
+        result = LoadResource(key);
+      } else if (auto tkey = file_->GetKey(key.c_str())) {
+        std::unique_ptr<Result> ptr(static_cast<Result *>(tkey->ReadObjectAny(TClass::GetClass<Result>())));
+        if (ptr) {
+          result.emplace(std::move(*ptr));
+        }
+      }
+    }
+    if (result) {
+      ++n_hits_;
+      used_.emplace(key);
+    } else {
+      ++n_misses_;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Writes computed @p result under @p key, result is identified by the key from now on
+   */
+  template<typename Result>
+  void Store(const std::string &key, ResourceManager::Resource &result, const std::string &name) {
+    if (key.empty()) {
+      return;
+    }
+    result.content_hash = key;
+    std::lock_guard lock(mutex_);
+    if constexpr (std::is_same_v<Result, ResourceManager::Resource>) {
+      /* object and meta of the resource, the meta is restored by Load() */
+      auto cls = result.obj.has_value() ? TClass::GetClass(result.obj.type()) : nullptr;
+      if (!cls || !cls->HasDictionary()) {
+        ++n_uncacheable_;
+        return;
+      }
+      std::stringstream meta;
+      result.meta.Print(meta);
+      TObjString meta_object(meta.str().c_str());
+      file_->WriteObjectAny(result.obj.Address(), cls, key.c_str(), "Overwrite");
+      file_->WriteObjectAny(&meta_object, TObjString::Class(), (key + META_SUFFIX).c_str(), "Overwrite");
+    } else {
+      file_->WriteObjectAny(&std::as_const(result).As<Result>(), TClass::GetClass<Result>(), key.c_str(), "Overwrite");
+    }
+    index_[key] = name;
+    used_.emplace(key);
+    ++n_stored_;
+  }
+
+  /**
+   * @brief Removes entries of resources with names matching @p pattern
+   * @return number of removed entries
+   */
+  std::size_t Invalidate(const std::string &pattern) {
+    const boost::regex re(pattern);
+    std::lock_guard lock(mutex_);
+    return RemoveIf([&re](const std::string &, const std::string &name) { return boost::regex_match(name, re); });
+  }
+
+  /**
+   * @brief Removes entries neither read nor written during this run
+   * @return number of removed entries
+   */
+  std::size_t Prune() {
+    std::lock_guard lock(mutex_);
+    return RemoveIf([this](const std::string &hash, const std::string &) { return used_.count(hash) == 0; });
+  }
+
+  void Report(std::ostream &os = std::cout) const {
+    std::lock_guard lock(mutex_);
+    const auto n_lookups = n_hits_ + n_misses_;
+    os << "Define cache '" << filename_ << "'" << (version_.empty() ? "" : " version '" + version_ + "'") << "\n"
+       << "  entries:     " << index_.size() << "\n"
+       << "  hits:        " << n_hits_ << " of " << n_lookups << " lookups";
+    if (n_lookups > 0) {
+      os << " (" << std::fixed << std::setprecision(1) << 100. * n_hits_ / n_lookups << "%)";
+    }
+    os << "\n"
+       << "  stored:      " << n_stored_ << "\n"
+       << "  uncacheable: " << n_uncacheable_ << std::endl;
+  }
+
+  /**
+   * @brief Writes the index and closes the file, called by the destructor
+   */
+  void Close() {
+    std::lock_guard lock(mutex_);
+    if (!file_) {
+      return;
+    }
+    std::stringstream index;
+    for (auto &[hash, name] : index_) {
+      index << hash << " " << name << "\n";
+    }
+    TObjString index_object(index.str().c_str());
+    file_->WriteObjectAny(&index_object, TObjString::Class(), INDEX_NAME, "Overwrite");
+    file_->Close();
+    file_.reset();
+    Info(__func__, "Define cache '%s': %zu hits, %zu misses, %zu stored",
+         filename_.c_str(), n_hits_, n_misses_, n_stored_);
+  }
+
+  static std::string HashString(const std::string &str) {
+    return HashBytes(str.data(), str.size());
+  }
+
+  /**
+   * @brief 128-bit hash: two 64-bit FNV-1a lanes, the second one is rotated after each byte
+   */
+  static std::string HashBytes(const char *data, std::size_t size) {
+    std::uint64_t lanes[2] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+    for (std::size_t i = 0; i < size; ++i) {
+      for (auto &lane : lanes) {
+        lane ^= std::uint64_t(static_cast<unsigned char>(data[i]));
+        lane *= 0x100000001b3ULL;
+      }
+      lanes[1] = (lanes[1] << 1) | (lanes[1] >> 63);
+    }
+    std::stringstream stream;
+    stream << std::hex << std::setfill('0') << std::setw(16) << lanes[0] << std::setw(16) << lanes[1];
+    return stream.str();
+  }
+
+ private:
+  static DefineCache *&CurrentRef() {
+    static DefineCache *current = nullptr;
+    return current;
+  }
+
+  /**
+   * @brief Identity of the function stable between runs of the same executable, empty if unknown
+   */
+  template<typename Function>
+  static std::string FunctionId(const Function &fct) {
+    using F = std::decay_t<Function>;
+    if constexpr (std::is_pointer_v<F> && std::is_function_v<std::remove_pointer_t<F>>) {
+      Dl_info info;
+      if (dladdr(reinterpret_cast<const void *>(fct), &info) == 0 || !info.dli_fname) {
+        return {};
+      }
+      if (info.dli_sname) {
+        return info.dli_sname;
+      }
+      /* not exported, the offset in the object is stable while the object isn't relinked */
+      std::stringstream id;
+      id << std::filesystem::path(info.dli_fname).filename().string() << "+"
+         << reinterpret_cast<std::uintptr_t>(fct) - reinterpret_cast<std::uintptr_t>(info.dli_fbase);
+      return id.str();
+    } else if constexpr (std::is_empty_v<F>) {
+      /* captureless lambdas and stateless functors */
+      return typeid(F).name();
+    } else {
+      return {};
+    }
+  }
+
+  template<typename ArgsTuple, std::size_t... IArg>
+  static bool ArgHashes(const std::vector<std::string> &arg_names, std::ostream &os, std::index_sequence<IArg...>) {
+    bool is_known = true;
+    ((is_known = is_known && ArgHashI<std::tuple_element_t<IArg, ArgsTuple>>(arg_names[IArg], os)), ...);
+    return is_known;
+  }
+
+  template<typename T>
+  static bool ArgHashI(const std::string &arg_name, std::ostream &os) {
+    auto &manager = ResourceManager::Instance();
+    if (!manager.Has(arg_name)) {
+      throw ResourceManager::NoSuchResource(arg_name);
+    }
+    std::string hash;
+    try {
+      hash = ArgHash<T>(manager.Find(arg_name));
+    } catch (std::bad_any_cast &e) {
+      throw ResourceManager::NoSuchResource(arg_name);
+    }
+    os << hash << "\n";
+    return !hash.empty();
+  }
+
+  template<typename T>
+  static std::string ArgHash(const ResourceManager::Resource &resource) {
+    using MetaType = ResourceManager::MetaType;
+    if constexpr (std::is_same_v<T, ResourceManager::Resource>) {
+      /* derivation may read the meta of the argument as well */
+      if (resource.content_hash.empty()) {
+        return {};
+      }
+      std::stringstream content;
+      content << resource.content_hash << "\n";
+      resource.meta.Print(content);
+      return HashString(content.str());
+    } else if constexpr (std::is_same_v<T, ResourceManager::NameTag>) {
+      return HashString("name:" + resource.name);
+    } else if constexpr (std::is_same_v<T, MetaType>) {
+      std::stringstream meta;
+      resource.meta.Print(meta);
+      return HashString(meta.str());
+    } else {
+      resource.CheckLazyType<T>();
+      if (resource.obj.has_value() && resource.obj.type() != typeid(T)) {
+        throw std::bad_any_cast();
+      }
+      if (resource.content_hash.empty()) {
+        auto cls = TClass::GetClass<T>();
+        if (!cls || !cls->HasDictionary()) {
+          return {};
+        }
+        TBufferFile buffer(TBuffer::kWrite);
+        buffer.WriteObjectAny(&resource.As<T>(), cls);
+        resource.content_hash = HashBytes(buffer.Buffer(), buffer.Length());
+      }
+      return resource.content_hash;
+    }
+  }
+
+  /* under the lock */
+  std::optional<ResourceManager::Resource> LoadResource(const std::string &key) {
+    auto tkey = file_->GetKey(key.c_str());
+    std::unique_ptr<TObjString> meta_object(file_->Get<TObjString>((key + META_SUFFIX).c_str()));
+    if (!tkey || !meta_object) {
+      return std::nullopt;
+    }
+    auto cls = TClass::GetClass(tkey->GetClassName());
+    if (!cls || !cls->GetTypeInfo()) {
+      return std::nullopt;
+    }
+    auto ptr = tkey->ReadObjectAny(cls);
+    if (!ptr) {
+      return std::nullopt;
+    }
+    auto obj = Details::SharedObject::Adopt(*cls->GetTypeInfo(), ptr);
+    if (!obj.has_value()) {
+      cls->Destructor(ptr);
+      return std::nullopt;
+    }
+    return ResourceManager::Resource("", std::move(obj),
+                                     ResourceManager::MetaType::FromJson(meta_object->GetString().Data()));
+  }
+
+  void ReadIndex() {
+    std::unique_ptr<TObjString> index_object(file_->Get<TObjString>(INDEX_NAME));
+    if (!index_object) {
+      return;
+    }
+    std::stringstream index(index_object->GetString().Data());
+    std::string hash;
+    std::string name;
+    while (index >> hash && std::getline(index >> std::ws, name)) {
+      index_.emplace(hash, name);
+    }
+  }
+
+  template<typename Predicate>
+  std::size_t RemoveIf(Predicate &&predicate) {
+    std::size_t n_removed = 0;
+    for (auto it = index_.begin(); it != index_.end();) {
+      if (predicate(it->first, it->second)) {
+        file_->Delete((it->first + ";*").c_str());
+        file_->Delete((it->first + META_SUFFIX + ";*").c_str());
+        used_.erase(it->first);
+        it = index_.erase(it);
+        ++n_removed;
+      } else {
+        ++it;
+      }
+    }
+    return n_removed;
+  }
+
+  std::string filename_;
+  std::string version_;
+  DefineCache *previous_;
+  std::unique_ptr<TFile> file_;
+  mutable std::mutex mutex_;
+  /// hash -> name of the resource
+  std::map<std::string, std::string> index_;
+  std::set<std::string> used_;
+  std::size_t n_hits_{0};
+  std::size_t n_misses_{0};
+  std::size_t n_stored_{0};
+  std::size_t n_uncacheable_{0};
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLES_DEFINECACHE_HPP
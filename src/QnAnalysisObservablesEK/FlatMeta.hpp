@@ -0,0 +1,339 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISOBSERVABLES_FLATMETA_HPP
+#define QNANALYSIS_SRC_QNANALYSISOBSERVABLES_FLATMETA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace Details {
+
+/**
+ * @brief Process-wide pool of strings, equal strings share one instance.
+ * Strings are never released, pointers to them stay valid until the end of the program.
+ */
+class StringPool {
+ public:
+  static const std::string *Intern(const std::string &str) {
+    auto &pool = Instance();
+    {
+      std::shared_lock lock(pool.mutex_);
+      auto it = pool.strings_.find(str);
+      if (it != pool.strings_.end()) {
+        return &*it;
+      }
+    }
+    std::unique_lock lock(pool.mutex_);
+    return &*pool.strings_.emplace(str).first;
+  }
+
+  static std::size_t Size() {
+    auto &pool = Instance();
+    std::shared_lock lock(pool.mutex_);
+    return pool.strings_.size();
+  }
+
+ private:
+  static StringPool &Instance() {
+    static StringPool pool;
+    return pool;
+  }
+
+  std::shared_mutex mutex_;
+  /// rehashing does not move the nodes
+  std::unordered_set<std::string> strings_;
+};
+
+/**
+ * @brief Meta information of the resource: (path, value) pairs of interned strings, sorted by path.
+ *
+ * Paths are dot-separated, the subset of boost::property_tree interface used by the analysis
+ * (put, get, get_child, put_child) is kept, so are META[...] predicates.
+ * Unlike property_tree, intermediate nodes of the paths have no value.
+ * Copies share the strings, lookups are binary searches.
+ */
+class FlatMeta {
+ public:
+  struct Entry {
+    const std::string *path;
+    const std::string *value;
+  };
+  typedef std::vector<Entry>::const_iterator const_iterator;
+
+  template<typename T>
+  void put(const std::string &path, const T &value) {
+    const auto interned_value = StringPool::Intern(ToString(value));
+    auto it = LowerBound(path);
+    if (it != entries_.end() && *it->path == path) {
+      it->value = interned_value;
+    } else {
+      entries_.insert(it, Entry{StringPool::Intern(path), interned_value});
+    }
+  }
+
+  /**
+   * @brief Value at @p path, nullptr if there is no such path
+   */
+  [[nodiscard]] const std::string *Find(const std::string &path) const {
+    auto it = LowerBound(path);
+    return it != entries_.end() && *it->path == path ? it->value : nullptr;
+  }
+
+  template<typename T>
+  T get(const std::string &path) const {
+    auto value = Find(path);
+    if (!value) {
+      throw std::out_of_range("No meta path '" + path + "'");
+    }
+    return FromString<T>(*value, path);
+  }
+
+  template<typename T>
+  T get(const std::string &path, const T &default_value) const {
+    auto value = Find(path);
+    return value ? FromString<T>(*value, path) : default_value;
+  }
+
+  std::string get(const std::string &path, const char *default_value) const {
+    return get<std::string>(path, default_value);
+  }
+
+  /**
+   * @brief Entries under @p path with the prefix removed
+   */
+  [[nodiscard]] FlatMeta get_child(const std::string &path) const {
+    auto [begin, end] = SubtreeRange(path);
+    if (begin == end) {
+      throw std::out_of_range("No meta path '" + path + "'");
+    }
+    return MakeChild(path, begin, end);
+  }
+
+  [[nodiscard]] FlatMeta get_child(const std::string &path, const FlatMeta &default_value) const {
+    auto [begin, end] = SubtreeRange(path);
+    return begin == end ? default_value : MakeChild(path, begin, end);
+  }
+
+  /**
+   * @brief Replaces value and entries under @p path with entries of @p child
+   */
+  void put_child(const std::string &path, const FlatMeta &child) {
+    auto begin = LowerBound(path);
+    auto end = begin;
+    while (end != entries_.end() && (*end->path == path || IsInSubtree(*end->path, path))) {
+      ++end;
+    }
+    std::vector<Entry> prefixed;
+    prefixed.reserve(child.size());
+    for (auto &entry : child) {
+      prefixed.push_back({StringPool::Intern(path + "." + *entry.path), entry.value});
+    }
+    /* prefixed entries keep the order and fill the place of the replaced subtree */
+    auto it = entries_.erase(begin, end);
+    entries_.insert(it, prefixed.begin(), prefixed.end());
+  }
+
+  /**
+   * @brief @p rhs over @p lhs: values of @p rhs win,
+   * entries of @p lhs under the leaves of @p rhs are dropped (as put_child of the leaves would do)
+   */
+  static FlatMeta Merge(const FlatMeta &lhs, const FlatMeta &rhs) {
+    FlatMeta result;
+    result.entries_.reserve(lhs.size() + rhs.size());
+    auto l = lhs.begin();
+    auto r = rhs.begin();
+    while (l != lhs.end() || r != rhs.end()) {
+      if (r == rhs.end() || (l != lhs.end() && l->path != r->path && PathLess(*l->path, *r->path))) {
+        result.entries_.push_back(*l++);
+        continue;
+      }
+      if (l != lhs.end() && l->path == r->path) {
+        ++l;
+      }
+      result.entries_.push_back(*r);
+      const bool is_leaf = std::next(r) == rhs.end() || !IsInSubtree(*std::next(r)->path, *r->path);
+      while (is_leaf && l != lhs.end() && IsInSubtree(*l->path, *r->path)) {
+        ++l;
+      }
+      ++r;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Flat JSON object, keys in path order
+   */
+  void Print(std::ostream &os) const {
+    os << "{";
+    for (auto it = begin(); it != end(); ++it) {
+      os << (it == begin() ? "" : ",");
+      PrintJsonString(os, *it->path);
+      os << ":";
+      PrintJsonString(os, *it->value);
+    }
+    os << "}";
+  }
+
+  /**
+   * @brief Reads meta written by Print()
+   * @throws std::invalid_argument if @p json is not a flat object of strings
+   */
+  static FlatMeta FromJson(const std::string &json) {
+    FlatMeta result;
+    std::size_t pos = 0;
+    auto expect = [&json, &pos](char c) {
+      if (pos >= json.size() || json[pos] != c) {
+        throw std::invalid_argument("Malformed meta '" + json + "'");
+      }
+      ++pos;
+    };
+    expect('{');
+    while (pos < json.size() && json[pos] != '}') {
+      if (!result.empty()) {
+        expect(',');
+      }
+      auto path = ReadJsonString(json, pos);
+      expect(':');
+      result.put(path, ReadJsonString(json, pos));
+    }
+    expect('}');
+    return result;
+  }
+
+  [[nodiscard]] const_iterator begin() const { return entries_.begin(); }
+  [[nodiscard]] const_iterator end() const { return entries_.end(); }
+  [[nodiscard]] std::size_t size() const { return entries_.size(); }
+  [[nodiscard]] bool empty() const { return entries_.empty(); }
+
+  bool operator==(const FlatMeta &other) const {
+    return std::equal(begin(), end(), other.begin(), other.end(), [](const Entry &lhs, const Entry &rhs) {
+      return lhs.path == rhs.path && lhs.value == rhs.value;
+    });
+  }
+  bool operator!=(const FlatMeta &other) const { return !(*this == other); }
+
+ private:
+  /* '.' precedes any other character, entries under the path follow the path itself */
+  static bool PathLess(const std::string &lhs, const std::string &rhs) {
+    auto rank = [](char c) { return c == '.' ? 0u : static_cast<unsigned char>(c) + 1u; };
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                                        [&rank](char l, char r) { return rank(l) < rank(r); });
+  }
+
+  static bool IsInSubtree(const std::string &path, const std::string &parent) {
+    return path.size() > parent.size() && path[parent.size()] == '.' && path.compare(0, parent.size(), parent) == 0;
+  }
+
+  std::vector<Entry>::iterator LowerBound(const std::string &path) {
+    return std::lower_bound(entries_.begin(), entries_.end(), path, [](const Entry &entry, const std::string &p) {
+      return PathLess(*entry.path, p);
+    });
+  }
+
+  [[nodiscard]] const_iterator LowerBound(const std::string &path) const {
+    return std::lower_bound(entries_.begin(), entries_.end(), path, [](const Entry &entry, const std::string &p) {
+      return PathLess(*entry.path, p);
+    });
+  }
+
+  [[nodiscard]] std::pair<const_iterator, const_iterator> SubtreeRange(const std::string &path) const {
+    auto begin = LowerBound(path + ".");
+    auto end = begin;
+    while (end != entries_.end() && IsInSubtree(*end->path, path)) {
+      ++end;
+    }
+    return {begin, end};
+  }
+
+  static FlatMeta MakeChild(const std::string &path, const_iterator begin, const_iterator end) {
+    FlatMeta child;
+    child.entries_.reserve(std::distance(begin, end));
+    for (auto it = begin; it != end; ++it) {
+      child.entries_.push_back({StringPool::Intern(it->path->substr(path.size() + 1)), it->value});
+    }
+    return child;
+  }
+
+  template<typename T>
+  static std::string ToString(const T &value) {
+    if constexpr (std::is_convertible_v<T, std::string>) {
+      return std::string(value);
+    } else {
+      std::ostringstream stream;
+      if constexpr (std::is_floating_point_v<T>) {
+        /* same precision as the property_tree translator, more digits if the value doesn't survive the round trip */
+        stream.precision(std::numeric_limits<T>::digits10 + 1);
+        stream << value;
+        T parsed{};
+        std::istringstream parse_stream(stream.str());
+        if ((!(parse_stream >> parsed) || parsed != value) && value == value) {
+          stream.str("");
+          stream.precision(std::numeric_limits<T>::max_digits10);
+          stream << value;
+        }
+        return stream.str();
+      }
+      stream << value;
+      return stream.str();
+    }
+  }
+
+  template<typename T>
+  static T FromString(const std::string &value, const std::string &path) {
+    if constexpr (std::is_same_v<T, std::string>) {
+      return value;
+    } else {
+      std::istringstream stream(value);
+      T result{};
+      stream >> result;
+      if (stream.fail() || !(stream >> std::ws).eof()) {
+        throw std::invalid_argument("Meta value '" + value + "' at '" + path + "' can't be converted");
+      }
+      return result;
+    }
+  }
+
+  static void PrintJsonString(std::ostream &os, const std::string &str) {
+    os << '"';
+    for (auto c : str) {
+      if (c == '"' || c == '\\') {
+        os << '\\';
+      }
+      os << c;
+    }
+    os << '"';
+  }
+
+  static std::string ReadJsonString(const std::string &json, std::size_t &pos) {
+    if (pos >= json.size() || json[pos] != '"') {
+      throw std::invalid_argument("Malformed meta '" + json + "'");
+    }
+    std::string result;
+    for (++pos; pos < json.size() && json[pos] != '"'; ++pos) {
+      if (json[pos] == '\\' && pos + 1 < json.size()) {
+        ++pos;
+      }
+      result.push_back(json[pos]);
+    }
+    if (pos == json.size()) {
+      throw std::invalid_argument("Malformed meta '" + json + "'");
+    }
+    ++pos;
+    return result;
+  }
+
+  std::vector<Entry> entries_;
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLES_FLATMETA_HPP
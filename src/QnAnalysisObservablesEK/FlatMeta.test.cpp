@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/property_tree/ptree.hpp>
+#include "FlatMeta.hpp"
+
+namespace {
+
+using Details::FlatMeta;
+using Fields = std::vector<std::pair<std::string, std::string>>;
+using boost::property_tree::ptree;
+
+FlatMeta MakeFlat(const Fields &fields) {
+  FlatMeta meta;
+  for (auto &[path, value] : fields) {
+    meta.put(path, value);
+  }
+  return meta;
+}
+
+ptree MakeTree(const Fields &fields) {
+  ptree tree;
+  for (auto &[path, value] : fields) {
+    tree.put(path, value);
+  }
+  return tree;
+}
+
+/* MergeMeta of the property_tree meta */
+ptree MergeTree(const ptree &lhs, const ptree &rhs) {
+  ptree result = lhs;
+  for (auto &element : rhs) {
+    auto element_name = element.first;
+
+    if (element.second.empty()) { /// element is value
+      result.put_child(element_name, element.second);
+    } else { /// element is node
+      auto lhs_child = lhs.get_child(element_name, ptree());
+      result.put_child(element_name, MergeTree(lhs_child, element.second));
+    }
+  }
+  return result;
+}
+
+/* (path, value) of the leaves and of the nodes with value */
+void Flatten(const ptree &tree, const std::string &prefix, Fields &fields) {
+  for (auto &element : tree) {
+    auto path = prefix.empty() ? element.first : prefix + "." + element.first;
+    if (element.second.empty() || !element.second.data().empty()) {
+      fields.emplace_back(path, element.second.data());
+    }
+    Flatten(element.second, path, fields);
+  }
+}
+
+FlatMeta ToFlat(const ptree &tree) {
+  Fields fields;
+  Flatten(tree, "", fields);
+  return MakeFlat(fields);
+}
+
+Fields ToFields(const FlatMeta &meta) {
+  Fields fields;
+  for (auto &entry : meta) {
+    fields.emplace_back(*entry.path, *entry.value);
+  }
+  return fields;
+}
+
+TEST(FlatMeta, MergeMatchesPropertyTree) {
+  const std::vector<std::pair<Fields, Fields>> cases{
+      {{}, {}},
+      {{{"a", "1"}}, {}},
+      {{}, {{"a", "1"}}},
+      /* disjoint and overlapping leaves */
+      {{{"a", "1"}, {"b", "2"}}, {{"b", "3"}, {"c", "4"}}},
+      /* nested paths, right values win, other left leaves of the subtree are kept */
+      {{{"v1.src", "reco"}, {"v1.particle", "protons"}, {"v1.ref", "psd1"}},
+       {{"v1.ref", "psd2"}, {"v1.component", "x1x1"}}},
+      {{{"a.b.c", "1"}, {"a.b.d", "2"}, {"a.e", "3"}}, {{"a.b.c", "4"}, {"a.f.g", "5"}}},
+      /* leaf on the right replaces the subtree on the left */
+      {{{"resolution.title", "R1"}, {"resolution.ref", "psd1"}, {"type", "resolution"}},
+       {{"resolution", "none"}}},
+      {{{"a.b.c", "1"}, {"a.b.d", "2"}, {"a.c", "3"}}, {{"a.b", "4"}}},
+      /* names sharing the prefix are not in the subtree */
+      {{{"a.b", "1"}, {"ab", "2"}, {"a-b", "3"}}, {{"a", "4"}}},
+      {{{"a", "1"}, {"a-b", "2"}}, {{"a.b", "3"}, {"ab", "4"}}},
+  };
+  for (auto &[lhs, rhs] : cases) {
+    auto expected = ToFlat(MergeTree(MakeTree(lhs), MakeTree(rhs)));
+    auto merged = FlatMeta::Merge(MakeFlat(lhs), MakeFlat(rhs));
+    EXPECT_EQ(ToFields(merged), ToFields(expected));
+  }
+}
+
+TEST(FlatMeta, MergeLeafReplacesSubtree) {
+  auto merged = FlatMeta::Merge(MakeFlat({{"a.b", "1"}, {"a.c", "2"}, {"d", "3"}}), MakeFlat({{"a", "4"}}));
+  EXPECT_EQ(ToFields(merged), (Fields{{"a", "4"}, {"d", "3"}}));
+  /* and a subtree on the right keeps the other leaves on the left */
+  merged = FlatMeta::Merge(MakeFlat({{"a.b", "1"}, {"a.c", "2"}}), MakeFlat({{"a.b", "5"}}));
+  EXPECT_EQ(ToFields(merged), (Fields{{"a.b", "5"}, {"a.c", "2"}}));
+}
+
+TEST(FlatMeta, PathOrder) {
+  auto meta = MakeFlat({{"ab", "1"}, {"a-b", "2"}, {"a.b", "3"}, {"a", "4"}, {"a.a", "5"}});
+  /* '.' precedes any other character, the subtree follows the path */
+  EXPECT_EQ(ToFields(meta), (Fields{{"a", "4"}, {"a.a", "5"}, {"a.b", "3"}, {"a-b", "2"}, {"ab", "1"}}));
+  EXPECT_EQ(*meta.Find("a-b"), "2");
+  EXPECT_EQ(meta.Find("a.c"), nullptr);
+}
+
+TEST(FlatMeta, Children) {
+  auto meta = MakeFlat({{"v1.src", "reco"}, {"v1.ref.name", "psd1"}, {"v1-other", "x"}, {"type", "v1"}});
+  auto child = meta.get_child("v1");
+  EXPECT_EQ(ToFields(child), (Fields{{"ref.name", "psd1"}, {"src", "reco"}}));
+  EXPECT_THROW(meta.get_child("v2"), std::out_of_range);
+  EXPECT_TRUE(meta.get_child("v2", FlatMeta()).empty());
+  /* leaf has no children */
+  EXPECT_THROW(meta.get_child("type"), std::out_of_range);
+
+  meta.put_child("v1", MakeFlat({{"src", "mc"}}));
+  EXPECT_EQ(ToFields(meta), (Fields{{"type", "v1"}, {"v1.src", "mc"}, {"v1-other", "x"}}));
+  meta.put_child("type", MakeFlat({{"name", "v1"}}));
+  EXPECT_EQ(meta.get<std::string>("type.name"), "v1");
+  EXPECT_EQ(meta.Find("type"), nullptr);
+}
+
+TEST(FlatMeta, Values) {
+  FlatMeta meta;
+  meta.put("i", 42);
+  meta.put("d", 0.1);
+  meta.put("s", "text");
+  EXPECT_EQ(meta.get<int>("i"), 42);
+  EXPECT_EQ(meta.get<std::string>("d"), "0.1");
+  EXPECT_EQ(meta.get("missing", "default"), "default");
+  EXPECT_THROW(meta.get<int>("s"), std::invalid_argument);
+  EXPECT_THROW(meta.get<int>("missing"), std::out_of_range);
+
+  /* floating point values survive the round trip */
+  for (double value : {0.1, 0.1 + 0.2, 1. / 3., 1e-300, 123456.789, std::numeric_limits<double>::max()}) {
+    meta.put("d", value);
+    EXPECT_EQ(meta.get<double>("d"), value);
+  }
+  for (float value : {0.1f, 1.f / 3.f, 2.5e-10f}) {
+    meta.put("f", value);
+    EXPECT_EQ(meta.get<float>("f"), value);
+  }
+}
+
+TEST(FlatMeta, Json) {
+  auto meta = MakeFlat({{"a.b", "quote\" and \\"}, {"c", ""}});
+  std::stringstream json;
+  meta.Print(json);
+  EXPECT_EQ(FlatMeta::FromJson(json.str()), meta);
+  EXPECT_TRUE(FlatMeta::FromJson("{}").empty());
+  EXPECT_THROW(FlatMeta::FromJson("{\"a\":"), std::invalid_argument);
+}
+
+}
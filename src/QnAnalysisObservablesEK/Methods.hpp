@@ -7,66 +7,75 @@
 
 #include <QnTools/DataContainer.hpp>
 
+#include "ContainerExpr.hpp"
+
 namespace Methods {
 
 using Resource = ResourceManager::Resource;
 using ResourceMeta = ResourceManager::MetaType;
+using ::Tools::Expr::Evaluate;
+using ::Tools::Expr::Lazy;
 
 
 /*************** RESOLUTION *****************/
 
 inline
 Resource
-Resolution3S(Resource nom1, Resource nom2, Resource denom) {
-  auto nom = nom1.As<Qn::DataContainerStatCalculate>() * nom2.As<Qn::DataContainerStatCalculate>();
-  nom = 2 * nom;
-
+Resolution3S(const Resource &nom1, const Resource &nom2, const Resource &denom) {
   /* populating meta information */
   auto meta = ResourceMeta();
   meta.put("type", "resolution");
   meta.put("resolution.method", "3sub");
   meta.put("source", __func__);
 
-  auto result = Qn::Sqrt(nom / denom.As<Qn::DataContainerStatCalculate>());
+  /* shared objects are not released by loading the other lazy arguments */
+  auto nom1_obj = nom1.Share<Qn::DataContainerStatCalculate>();
+  auto nom2_obj = nom2.Share<Qn::DataContainerStatCalculate>();
+  auto denom_obj = denom.Share<Qn::DataContainerStatCalculate>();
+  /* sqrt(2 * nom1 * nom2 / denom) in a single pass over the bins */
+  auto nom = 2 * (Lazy(*nom1_obj) * Lazy(*nom2_obj));
+  auto result = Evaluate(::Tools::Expr::Sqrt(nom / Lazy(*denom_obj)));
   result.SetErrors(Qn::StatCalculate::ErrorType::BOOTSTRAP);
 
-  return {result, meta};
+  return {std::move(result), meta};
 }
 
 inline
 Resource
-Resolution4S(Qn::DataContainerStatCalculate QQ,
-             Qn::DataContainerStatCalculate RT,
-             Qn::DataContainerStatCalculate uQ) {
-  auto result = QQ * RT / uQ;
+Resolution4S(const Qn::DataContainerStatCalculate &QQ,
+             const Qn::DataContainerStatCalculate &RT,
+             const Qn::DataContainerStatCalculate &uQ) {
+  auto result = Evaluate(Lazy(QQ) * Lazy(RT) / Lazy(uQ));
   result.SetErrors(Qn::StatCalculate::ErrorType::BOOTSTRAP);
 
   auto meta = ResourceMeta();
   meta.put("type", "resolution");
   meta.put("resolution.method", "4sub");
   meta.put("source", __func__);
-  return {result, meta};
+  return {std::move(result), meta};
 }
 
 inline
 Resource
-Resolution4S_1(Qn::DataContainerStatCalculate Qu,
-             Qn::DataContainerStatCalculate RT) {
-  auto result = 2* Qu / RT;
+Resolution4S_1(const Qn::DataContainerStatCalculate &Qu,
+               const Qn::DataContainerStatCalculate &RT) {
+  auto result = Evaluate(2 * Lazy(Qu) / Lazy(RT));
   result.SetErrors(Qn::StatCalculate::ErrorType::BOOTSTRAP);
 
   auto meta = ResourceMeta();
   meta.put("type", "resolution");
   meta.put("resolution.method", "4sub");
   meta.put("source", __func__);
-  return {result, meta};
+  return {std::move(result), meta};
 }
 /*************** v1 *****************/
 
 inline
 Resource
-v1(Resource &uQ, Resource & resolution) {
-  auto result = 2 * uQ.As<Qn::DataContainerStatCalculate>() / resolution.As<Qn::DataContainerStatCalculate>();
+v1(const Resource &uQ, const Resource &resolution) {
+  auto uQ_obj = uQ.Share<Qn::DataContainerStatCalculate>();
+  auto resolution_obj = resolution.Share<Qn::DataContainerStatCalculate>();
+  auto result = Evaluate(2 * Lazy(*uQ_obj) / Lazy(*resolution_obj));
   result.SetErrors(Qn::StatCalculate::ErrorType::BOOTSTRAP);
 
   ResourceMeta meta;
@@ -76,7 +85,7 @@ v1(Resource &uQ, Resource & resolution) {
   meta.put("v1.particle", uQ.meta.get("u.particle","unknown"));
   meta.put("v1.axis", uQ.meta.get("u.axis","unknown"));
   meta.put("v1.set", uQ.meta.get("u.set","unknown"));
-  return {result, meta};
+  return {std::move(result), meta};
 }
 
 
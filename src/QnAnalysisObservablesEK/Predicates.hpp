@@ -7,6 +7,9 @@
 
 #include <string>
 #include <regex>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <boost/proto/proto.hpp>
 #include <utility>
 #include <boost/regex.hpp>
@@ -21,27 +24,46 @@ struct ResourceExprDomain : boost::proto::domain<boost::proto::generator<Resourc
 
 namespace Impl {
 
+/**
+ * @brief Process-wide cache of compiled patterns.
+ * Predicates are often constructed inside per-resource lambdas, the pattern is compiled only once.
+ */
+template<typename Regex>
+std::shared_ptr<const Regex> CompileRegex(const std::string &pattern) {
+  static std::mutex cache_mutex;
+  static std::unordered_map<std::string, std::shared_ptr<const Regex>> cache;
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = cache.find(pattern);
+  if (it == cache.end()) {
+    it = cache.emplace(pattern, std::make_shared<const Regex>(pattern)).first;
+  }
+  return it->second;
+}
+
 struct RegexMatchImpl {
-  explicit RegexMatchImpl(std::string regex_str) : re_expr(regex_str) {}
+  explicit RegexMatchImpl(const std::string &regex_str) : re_expr(CompileRegex<boost::regex>(regex_str)) {}
 
   typedef bool result_type;
 
   result_type operator()(const std::string &str) const {
-    return boost::regex_match(str, re_expr);
+    return boost::regex_match(str, *re_expr);
   }
 
-  const boost::regex re_expr;
+  const std::shared_ptr<const boost::regex> re_expr;
 };
 
 struct MatchGroupImpl {
-  MatchGroupImpl(const size_t group_id, std::regex re_expr) : group_id(group_id), re_expr(std::move(re_expr)) {}
-  MatchGroupImpl(const size_t group_id, const std::string &re_expr) : group_id(group_id), re_expr(re_expr) {}
+  MatchGroupImpl(const size_t group_id, std::regex re_expr) :
+      group_id(group_id), re_expr(std::make_shared<const std::regex>(std::move(re_expr))) {}
+  MatchGroupImpl(const size_t group_id, const std::string &re_expr) :
+      group_id(group_id), re_expr(CompileRegex<std::regex>(re_expr)) {}
 
   typedef std::string result_type;
 
   result_type operator()(const std::string &str) const {
     std::smatch match_result;
-    auto is_matched = std::regex_search(str, match_result, re_expr);
+    auto is_matched = std::regex_search(str, match_result, *re_expr);
     if (is_matched && group_id < match_result.size()) {
       return match_result.str(group_id);
     }
@@ -50,7 +72,7 @@ struct MatchGroupImpl {
   }
 
   const size_t group_id;
-  const std::regex re_expr;
+  const std::shared_ptr<const std::regex> re_expr;
 };
 
 struct BaseOfImpl {
@@ -111,8 +133,8 @@ struct ResourceContext {
 
     result_type operator()(Expr &e, const ResourceContext &ctx) const {
       auto path = std::string(boost::proto::value(boost::proto::right(e)));
-      auto result = ctx.res_.meta.get<result_type>(path, path + "-NOT-FOUND");
-      return result;
+      auto value = ctx.res_.meta.Find(path);
+      return value ? *value : path + "-NOT-FOUND";
     }
   };
 
@@ -235,29 +257,34 @@ struct MetaTemplateGenerator {
 
   typedef std::string result_type;
 
-  explicit MetaTemplateGenerator(std::string template_str) : template_str(std::move(template_str)) {}
-
-  result_type operator()(const ResourceManager::Resource &r) const {
-    const std::regex re_meta_token{R"(\{\{([\w\.-]+)\}\})"};
+  explicit MetaTemplateGenerator(std::string template_str) : template_str(std::move(template_str)) {
+    /* template is split into literals and meta paths once, evaluation does not touch regex */
+    const auto re_meta_token = Impl::CompileRegex<std::regex>(R"(\{\{([\w\.-]+)\}\})");
     using std::sregex_iterator;
-    using std::smatch;
-    using Resource::META;
-
-    auto result = template_str;
-    std::string::difference_type offset = 0;
 
+    std::string::size_type literal_start = 0;
     for (
-        auto it = sregex_iterator(template_str.begin(), template_str.end(), re_meta_token);
+        auto it = sregex_iterator(this->template_str.begin(), this->template_str.end(), *re_meta_token);
         it != sregex_iterator();
         ++it) {
-      smatch match = *it;
-      auto meta_path = match.str(1);
-      auto meta_value = META[meta_path](r);
-
-      auto replace_start = match.position(0) + offset;
-      auto replace_length = match.length();
-      result.replace(replace_start, replace_length, meta_value);
-      offset += meta_value.length() - replace_length;
+      const auto &match = *it;
+      tokens_.push_back({false, this->template_str.substr(literal_start, match.position(0) - literal_start)});
+      tokens_.push_back({true, match.str(1)});
+      literal_start = match.position(0) + match.length();
+    }
+    tokens_.push_back({false, this->template_str.substr(literal_start)});
+  }
+
+  result_type operator()(const ResourceManager::Resource &r) const {
+    using Resource::META;
+
+    std::string result;
+    for (auto &token : tokens_) {
+      if (token.is_meta_path) {
+        result.append(META[token.value](r));
+      } else {
+        result.append(token.value);
+      }
     }
     return result;
   }
@@ -268,8 +295,66 @@ struct MetaTemplateGenerator {
   }
 
   std::string template_str;
+
+ private:
+  struct Token {
+    bool is_meta_path;
+    /* literal text or meta path */
+    std::string value;
+  };
+
+  std::vector<Token> tokens_;
 };
 
+namespace Impl {
+
+namespace proto = boost::proto;
+
+/* other nodes do not restrict the set of resources */
+template<typename Expr, typename Tag>
+void CollectEqualities(const Expr &, Details::MetaEqualities &, Tag) {}
+
+/**
+ * @brief META["path"] == "value" with the value known at the moment of the query
+ */
+template<typename Expr>
+void CollectEqualities(const Expr &expr, Details::MetaEqualities &equalities, proto::tag::equal_to) {
+  using Left = std::decay_t<decltype(proto::left(expr))>;
+  using Right = std::decay_t<decltype(proto::right(expr))>;
+  if constexpr (std::is_same_v<typename proto::tag_of<Left>::type, proto::tag::subscript> &&
+      std::is_same_v<typename proto::tag_of<Right>::type, proto::tag::terminal>) {
+    using Subscripted = std::decay_t<decltype(proto::left(proto::left(expr)))>;
+    using Value = std::decay_t<typename proto::result_of::value<Right>::type>;
+    if constexpr (std::is_same_v<std::decay_t<typename proto::result_of::value<Subscripted>::type>, Resource::MetaTag> &&
+        std::is_constructible_v<std::string, const Value &>) {
+      equalities.emplace_back(std::string(proto::value(proto::right(proto::left(expr)))),
+                              std::string(proto::value(proto::right(expr))));
+    }
+  }
+}
+
+/* conjunction: equalities of both operands hold */
+template<typename Expr>
+void CollectEqualities(const Expr &expr, Details::MetaEqualities &equalities, proto::tag::logical_and) {
+  using Left = std::decay_t<decltype(proto::left(expr))>;
+  using Right = std::decay_t<decltype(proto::right(expr))>;
+  CollectEqualities(proto::left(expr), equalities, typename proto::tag_of<Left>::type());
+  CollectEqualities(proto::right(expr), equalities, typename proto::tag_of<Right>::type());
+}
+
+} // namespace Impl
+
 } /// namespace Predicates
 
+namespace Details {
+
+template<typename Expr>
+struct QueryPlan<Predicates::ResourceQueryExpr<Expr>> {
+  static void CollectEqualities(const Predicates::ResourceQueryExpr<Expr> &predicate, MetaEqualities &equalities) {
+    Predicates::Impl::CollectEqualities(predicate, equalities, typename boost::proto::tag_of<Expr>::type());
+  }
+};
+
+}
+
 #endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLES_PREDICATES_HPP
@@ -5,10 +5,17 @@
 #ifndef QNANALYSIS_SRC_QNANALYSISOBSERVABLES_RESOURCEMANAGER_HPP
 #define QNANALYSIS_SRC_QNANALYSISOBSERVABLES_RESOURCEMANAGER_HPP
 
+#include <algorithm>
 #include <iostream>
+#include <list>
 #include <map>
 #include <set>
 #include <tuple>
+#include <stdexcept>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
 #include <functional>
 #include <string>
 #include <utility>
@@ -17,11 +24,10 @@
 #include <memory>
 #include <filesystem>
 
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-
 #include <TError.h>
 
+#include "FlatMeta.hpp"
+
 namespace Details {
 
 template<typename T>
@@ -37,6 +43,121 @@ class Singleton {
 
 };
 
+/**
+ * @brief Type-erased immutable object shared between copies.
+ * Mutable access to the object shared with other copies copies it first (copy-on-write),
+ * move-only types can be stored but not shared and mutated at the same time.
+ * Type mismatch throws std::bad_any_cast as std::any_cast does.
+ */
+class SharedObject {
+ public:
+  SharedObject() = default;
+  template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, SharedObject>>>
+  SharedObject(T &&obj) : holder_(std::make_shared<Holder<std::decay_t<T>>>(std::forward<T>(obj))) {}
+
+  [[nodiscard]] bool has_value() const { return bool(holder_); }
+  [[nodiscard]] const std::type_info &type() const { return holder_ ? holder_->Type() : typeid(void); }
+  void reset() { holder_.reset(); }
+
+  template<typename T>
+  const T &Get() const {
+    if (type() != typeid(T)) {
+      throw std::bad_any_cast();
+    }
+    return static_cast<const Holder<T> &>(*holder_).value;
+  }
+
+  /**
+   * @brief Reference to the object not shared with other copies
+   */
+  template<typename T>
+  T &GetMutable() {
+    if (type() != typeid(T)) {
+      throw std::bad_any_cast();
+    }
+    if (holder_.use_count() > 1) {
+      holder_ = holder_->Clone();
+    }
+    return static_cast<Holder<T> &>(*holder_).value;
+  }
+
+  /**
+   * @brief Object shared with this one, stays alive after this one is reset or modified
+   */
+  template<typename T>
+  std::shared_ptr<const T> Share() const {
+    return std::shared_ptr<const T>(holder_, &Get<T>());
+  }
+
+  /**
+   * @brief Address of the object of type type(), nullptr if empty
+   */
+  [[nodiscard]] const void *Address() const { return holder_ ? holder_->Address() : nullptr; }
+
+  /**
+   * @brief Takes ownership of the object of @p type allocated with new (e.g. read from a ROOT file).
+   * Types of all objects stored in SharedObject anywhere in the program are known.
+   * @return empty object if the type is unknown, @p ptr is not released then
+   */
+  static SharedObject Adopt(const std::type_info &type, void *ptr) {
+    auto &adopters = Adopters();
+    auto it = adopters.find(std::type_index(type));
+    return it == adopters.end() ? SharedObject() : it->second(ptr);
+  }
+
+ private:
+  typedef SharedObject (*AdoptFunction)(void *);
+
+  /* filled before main() by Holder<T>::is_registered */
+  static std::unordered_map<std::type_index, AdoptFunction> &Adopters() {
+    static std::unordered_map<std::type_index, AdoptFunction> adopters;
+    return adopters;
+  }
+
+  struct HolderBase {
+    virtual ~HolderBase() = default;
+    [[nodiscard]] virtual const std::type_info &Type() const = 0;
+    [[nodiscard]] virtual const void *Address() const = 0;
+    [[nodiscard]] virtual std::shared_ptr<HolderBase> Clone() const = 0;
+  };
+
+  template<typename T>
+  struct Holder : public HolderBase {
+    template<typename U>
+    explicit Holder(U &&v) : value(std::forward<U>(v)) {
+      (void) is_registered;
+    }
+
+    static SharedObject AdoptPointer(void *ptr) {
+      std::unique_ptr<T> owned(static_cast<T *>(ptr));
+      return SharedObject(std::move(*owned));
+    }
+
+    static bool Register() {
+      if constexpr (std::is_move_constructible_v<T>) {
+        Adopters().emplace(std::type_index(typeid(T)), &AdoptPointer);
+      }
+      return true;
+    }
+    static inline const bool is_registered = Register();
+
+    [[nodiscard]] const std::type_info &Type() const override { return typeid(T); }
+    [[nodiscard]] const void *Address() const override { return &value; }
+    [[nodiscard]] std::shared_ptr<HolderBase> Clone() const override {
+      if constexpr (std::is_copy_constructible_v<T>) {
+        return std::make_shared<Holder<T>>(value);
+      } else {
+        throw std::logic_error(std::string("Shared object of move-only type '") + typeid(T).name()
+                                   + "' can't be modified");
+      }
+    }
+
+    T value;
+  };
+
+  std::shared_ptr<HolderBase> holder_;
+};
+
 template<typename T>
 struct FunctionTraits {};
 
@@ -83,6 +204,19 @@ struct Convert<std::vector<std::string>> {
   }
 };
 
+/// (meta path, value) pairs
+typedef std::vector<std::pair<std::string, std::string>> MetaEqualities;
+
+/**
+ * @brief Extension point of the query planner.
+ * Specializations append equalities of meta fields implied by the predicate,
+ * resources not satisfying them are not tested. Default: nothing is known, full scan.
+ */
+template<typename Predicate, typename = void>
+struct QueryPlan {
+  static void CollectEqualities(const Predicate &, MetaEqualities &) {}
+};
+
 }
 
 typedef std::string StringKey;
@@ -92,38 +226,91 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
  public:
 
   struct Resource; /// fwd
-  typedef boost::property_tree::ptree MetaType;
+  typedef Details::FlatMeta MetaType;
+
+  /**
+   * @brief Source of the object deserialized on first access (e.g. from a ROOT file)
+   */
+  struct LazyObject {
+    std::function<Details::SharedObject()> load;
+    const std::type_info *type{&typeid(void)};
+    /// approximate size of the object in memory
+    std::size_t size{0};
+  };
   typedef std::shared_ptr<Resource> ResourcePtr;
   typedef std::string KeyType;
 
   struct Resource {
     Resource() = default;
-    Resource(std::string n, std::any &&o, const MetaType &m) : name(std::move(n)), obj(o), meta(m) {}
+    Resource(std::string n, Details::SharedObject o, MetaType m) :
+        name(std::move(n)), obj(std::move(o)), meta(std::move(m)) {}
     template <typename T>
-    Resource(T&& typed_obj, const MetaType &Meta) : obj(typed_obj), meta(Meta) {}
+    Resource(T&& typed_obj, const MetaType &Meta) : obj(std::forward<T>(typed_obj)), meta(Meta) {}
 
     std::string name;
-    std::any obj;
+    /// for lazy resources empty until the first access, may be released and read again
+    mutable Details::SharedObject obj;
     MetaType meta;
+    /// Number of resources added before this one, resources added during iteration are not visited
+    std::size_t generation{0};
+    std::shared_ptr<const LazyObject> lazy;
+    /// identifies the content of the object (see Tools::DefineCache), empty if unknown, reset by mutable access
+    mutable std::string content_hash;
 
+    /// object not shared with other resources, copied if it was
     template<typename T>
     T &As() {
-      return std::any_cast<T &>(obj);
+      CheckLazyType<T>();
+      return Object().GetMutable<T>();
     }
 
+    /**
+     * @brief Object of the resource, lazy object stays evictable.
+     * The reference is valid while the resource is pinned (callbacks of ForEach, GroupBy and SelectUniq)
+     * or until another lazy object is loaded through the const access, which may release this one.
+     * Take Share() to use the object together with objects of other resources.
+     */
     template<typename T>
     const T &As() const {
-      return std::any_cast<const T &>(obj);
+      CheckLazyType<T>();
+      ResourceManager::Instance().Materialize(*this, false);
+      return obj.Get<T>();
+    }
+
+    /// object kept alive independently of the resource, not copied
+    template<typename T>
+    std::shared_ptr<const T> Share() const {
+      CheckLazyType<T>();
+      ResourceManager::Instance().Materialize(*this, false);
+      return obj.Share<T>();
     }
 
     template<typename T>
     T *Ptr() {
-      return std::any_cast<T>(&obj);
+      if ((lazy && !obj.has_value() && *lazy->type != typeid(T)) || (obj.has_value() && obj.type() != typeid(T))) {
+        return nullptr;
+      }
+      return &Object().GetMutable<T>();
+    }
+
+    /// type of the lazy object is known without reading it
+    template<typename T>
+    void CheckLazyType() const {
+      if (lazy && !obj.has_value() && *lazy->type != typeid(T)) {
+        throw std::bad_any_cast();
+      }
+    }
+
+    /// object, deserialized if the resource is lazy
+    Details::SharedObject &Object() {
+      ResourceManager::Instance().Materialize(*this, true);
+      return obj;
     }
 
     void Print(std::ostream &os = std::cout) const {
       os << "name:" << name << "\t" << "meta:";
-      boost::property_tree::write_json(os, meta, false);
+      meta.Print(os);
+      os << std::endl;
     }
   };
 
@@ -141,7 +328,7 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
   struct ResTag {};
 
   struct AlwaysTrue {
-    bool operator()(const Resource &) {
+    bool operator()(const Resource &) const {
       return true;
     }
   };
@@ -171,17 +358,22 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
 
   ResourcePtr Add(Resource resource) {
     auto key = resource.name;
-    auto emplace_result = resources_.emplace(key, std::make_shared<Resource>(resource));
+    resource.generation = generation_;
+    auto emplace_result = resources_.emplace(key, std::make_shared<Resource>(std::move(resource)));
     if (!emplace_result.second) {
       throw ResourceAlreadyExists(key);
     }
+    ++generation_;
+    for (auto &[path, index] : meta_indexes_) {
+      auto &element = *emplace_result.first;
+      index[GetMetaValue(*element.second, path)].push_back(&element);
+    }
     return (emplace_result.first)->second;
   }
 
   template<typename KeyRepr, typename T>
   auto Add(const KeyRepr &key, T &&obj, MetaType m = MetaType()) {
-    static_assert(std::is_copy_constructible_v<T>, "T must be copy-constructable to be stored in ResourceManager");
-    return Add(Resource(Details::Convert<KeyRepr>::ToString(key), std::forward<T>(obj), std::move(m)));
+    return Add(Resource(Details::Convert<KeyRepr>::ToString(key), Details::SharedObject(std::forward<T>(obj)), std::move(m)));
   }
 
   template<typename KeyRepr, typename T>
@@ -192,6 +384,65 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
     return Add(key, *ptr, std::move(m));
   }
 
+  /**
+   * @brief Adds resource deserialized by @p load on the first access.
+   * Objects accessed only by const references count towards the lazy memory limit,
+   * the least recently used of them are released and read again when needed.
+   */
+  template<typename T, typename KeyRepr>
+  ResourcePtr AddLazy(const KeyRepr &key, std::function<T()> load, std::size_t size, MetaType m = MetaType()) {
+    Resource resource;
+    resource.name = Details::Convert<KeyRepr>::ToString(key);
+    resource.meta = std::move(m);
+    resource.lazy = std::make_shared<const LazyObject>(
+        LazyObject{[load = std::move(load)]() { return Details::SharedObject(load()); }, &typeid(T), size});
+    return Add(std::move(resource));
+  }
+
+  /**
+   * @brief Limit of memory taken by lazy objects loaded with const access, 0 - no limit
+   */
+  void SetLazyMemoryLimit(std::size_t bytes) {
+    lazy_memory_limit_ = bytes;
+    EvictLazy(nullptr);
+  }
+
+  [[nodiscard]] std::size_t GetLazyMemoryUsed() const { return lazy_memory_used_; }
+
+  /**
+   * @brief Loads the object of lazy resource if it is not in memory.
+   * After mutable access the object is never released, otherwise changes would be lost.
+   */
+  void Materialize(const Resource &resource, bool is_mutable) {
+    if (is_mutable) {
+      resource.content_hash.clear();
+    }
+    if (!resource.lazy) {
+      return;
+    }
+    const bool is_managed = IsManaged(resource);
+    if (!resource.obj.has_value()) {
+      resource.obj = resource.lazy->load();
+      if (is_managed) {
+        lazy_lru_.push_front(&resource);
+        lazy_lru_index_.emplace(&resource, lazy_lru_.begin());
+        lazy_memory_used_ += resource.lazy->size;
+      }
+    }
+    auto lru_it = lazy_lru_index_.find(&resource);
+    if (lru_it == lazy_lru_index_.end()) {
+      return;
+    }
+    if (is_mutable) {
+      lazy_memory_used_ -= resource.lazy->size;
+      lazy_lru_.erase(lru_it->second);
+      lazy_lru_index_.erase(lru_it);
+      return;
+    }
+    lazy_lru_.splice(lazy_lru_.begin(), lazy_lru_, lru_it->second);
+    EvictLazy(&resource);
+  }
+
   template<typename KeyRepr>
   bool Has(const KeyRepr &key) const {
     auto it = resources_.find(Details::Convert<KeyRepr>::ToString(key));
@@ -205,34 +456,42 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
     }
   }
 
-  template<typename KeyRepr, typename T>
-  T &Get(const KeyRepr &key, ResTag<T>) {
-    CheckResource(key);
-    return std::any_cast<std::add_lvalue_reference_t<T>>(
-        (resources_[Details::Convert<KeyRepr>::ToString(key)]->obj));
-  }
-
+  /**
+   * @brief Read-only access to the resource, does not invalidate meta indexes and keeps lazy objects evictable
+   */
   template<typename KeyRepr>
-  NameTag Get(const KeyRepr &key, ResTag<NameTag>) {
-    CheckResource(key);
-    return NameTag(Details::Convert<KeyRepr>::ToString(key));
+  const Resource &Find(const KeyRepr &key) const {
+    auto it = resources_.find(Details::Convert<KeyRepr>::ToString(key));
+    if (it == resources_.end()) {
+      throw NoSuchResource(Details::Convert<KeyRepr>::ToString(key));
+    }
+    return *it->second;
   }
 
-  template<typename KeyRepr>
-  MetaType &Get(const KeyRepr &key, ResTag<MetaType>) {
-    CheckResource(key);
-    return resources_[Details::Convert<KeyRepr>::ToString(key)]->meta;
+  template<typename KeyRepr, typename T>
+  decltype(auto) Get(const KeyRepr &key, ResTag<T> tag) {
+    auto it = resources_.find(Details::Convert<KeyRepr>::ToString(key));
+    if (it == resources_.end()) {
+      throw NoSuchResource(Details::Convert<KeyRepr>::ToString(key));
+    }
+    if constexpr (std::is_same_v<T, Resource> || std::is_same_v<T, MetaType>) {
+      /* meta may be changed by the caller */
+      InvalidateMetaIndexes();
+    }
+    return GetFrom(*it->second, tag, true);
   }
 
-  template<typename KeyRepr>
-  Resource &Get(const KeyRepr &key, ResTag<Resource>) {
-    CheckResource(key);
-    return *resources_[Details::Convert<KeyRepr>::ToString(key)];
+  template<typename Predicate>
+  bool TestPredicate(Predicate &&predicate, const std::string &key) {
+    auto it = resources_.find(key);
+    if (it == resources_.end()) {
+      throw NoSuchResource(key);
+    }
+    return TestPredicate(std::forward<Predicate>(predicate), *it->second);
   }
 
   template<typename Predicate>
-  bool TestPredicate(Predicate &&predicate, const std::string &key) {
-    const auto &resource = Get(key, ResTag<Resource>());
+  static bool TestPredicate(Predicate &&predicate, const Resource &resource) {
     static_assert(std::is_same_v<decltype(predicate(resource)), bool>);
     return predicate(resource);
   }
@@ -240,10 +499,9 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
   template<typename Predicate = AlwaysTrue>
   std::vector<std::string> GetMatching(Predicate &&predicate = AlwaysTrue()) {
     std::vector<std::string> result;
-    for (auto &element : resources_) {
-      if (TestPredicate(std::forward<Predicate>(predicate), element.first))
-        result.emplace_back(element.first);
-    }
+    IterateMatching(predicate, [&result](const std::string &key, const ResourcePtr &) {
+      result.emplace_back(key);
+    });
     return result;
   }
 
@@ -251,31 +509,38 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
   void ForEach(Function &&fct, Predicate &&predicate = AlwaysTrue(), bool warn_bad_cast = false) {
     using Traits = Details::FunctionTraits<decltype(std::function{fct})>;
 
-    auto resources_copy = resources_;
-    for (auto &element : resources_copy) {
-      if (TestPredicate(std::forward<Predicate>(predicate), element.first)) {
-        try {
-          static_assert(Traits::N_ARGS == 2);
-          using KeyRepr = std::decay_t<typename Traits::template ArgType<0>>;
-          using ArgType = std::decay_t<typename Traits::template ArgType<1>>;
-          fct(Details::Convert<KeyRepr>::FromString(element.first) /* pass by value to prevent from unintentional change */,
-              Get(element.first, ResTag<ArgType>()));
-        } catch (std::bad_any_cast &e) {
-          if (warn_bad_cast)
-            Warning(__func__, "Bad cast for '%s'. Skipping...", element.first.c_str());
-        }
-      } // predicate
-    }
+    static_assert(Traits::N_ARGS == 2);
+    using KeyRepr = std::decay_t<typename Traits::template ArgType<0>>;
+    using ArgType = std::decay_t<typename Traits::template ArgType<1>>;
+    /* only non-const lvalue reference changes the resource, argument taken by value is a copy */
+    constexpr bool is_mutable = std::is_lvalue_reference_v<typename Traits::template ArgType<1>> &&
+        !std::is_const_v<std::remove_reference_t<typename Traits::template ArgType<1>>>;
+    constexpr bool is_meta_mutable = (std::is_same_v<ArgType, Resource> || std::is_same_v<ArgType, MetaType>) && is_mutable;
+
+    IterateMatching(predicate, [&](const std::string &key, const ResourcePtr &resource) {
+      try {
+        auto &&arg = GetFrom(*resource, ResTag<ArgType>(), is_mutable);
+        /* object is not released while the function uses it */
+        PinGuard pin(*this, *resource);
+        fct(Details::Convert<KeyRepr>::FromString(key) /* pass by value to prevent from unintentional change */,
+            std::forward<decltype(arg)>(arg));
+      } catch (std::bad_any_cast &e) {
+        if (warn_bad_cast)
+          Warning(__func__, "Bad cast for '%s'. Skipping...", key.c_str());
+      }
+      if constexpr (is_meta_mutable) {
+        InvalidateMetaIndexes();
+      }
+    });
   }
 
   template<typename MapFunction, typename OIter, typename Predicate = AlwaysTrue>
   void SelectImpl(MapFunction &&fct, OIter &&o, Predicate &&predicate = AlwaysTrue()) {
-    auto resources_copy = resources_;
-    for (auto &element : resources_copy) {
-      if (TestPredicate(std::forward<Predicate>(predicate), element.first)) {
-          *o = fct(Get(element.first, ResTag<Resource>()));
-      } /// predicate
-    } /// resources
+    IterateMatching(predicate, [&](const std::string &, const ResourcePtr &resource) {
+      /* feature function may access objects of other resources while it uses this one */
+      PinGuard pin(*this, *resource);
+      *o = fct(static_cast<const Resource &>(*resource));
+    });
   }
 
   template<typename MapFunction, typename Predicate = AlwaysTrue>
@@ -298,24 +563,37 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
 
     std::unordered_map<FeatureType,std::vector<ResourcePtr>> feature_groups;
     /* collecting features */
-    auto resources_copy = resources_;
-    for (auto &element : resources_copy) {
-      if (TestPredicate(std::forward<Predicate>(predicate), element.first)) {
-        auto feature = feature_fct(Get(element.first, ResTag<Resource>()));
-
-        auto && [emplace_it, emplace_ok] =
-            feature_groups.template emplace(std::move(feature), std::vector<ResourcePtr>({element.second}));
-        if (!emplace_ok) { /* already in the map */
-          emplace_it->second.emplace_back(element.second);
-        }
+    IterateMatching(predicate, [&](const std::string &, const ResourcePtr &resource) {
+      PinGuard pin(*this, *resource);
+      auto feature = feature_fct(static_cast<const Resource &>(*resource));
+
+      auto && [emplace_it, emplace_ok] =
+          feature_groups.template emplace(std::move(feature), std::vector<ResourcePtr>({resource}));
+      if (!emplace_ok) { /* already in the map */
+        emplace_it->second.emplace_back(resource);
       }
-    } // resources
+    }); // resources
 
     for (auto &[feature, elements] : feature_groups) {
+      std::vector<PinGuard> pins;
+      pins.reserve(elements.size());
+      for (auto &element : elements) {
+        pins.emplace_back(*this, *element);
+      }
       funct(feature, elements);
+      /* resources of the group are passed by non-const pointers */
+      InvalidateMetaIndexes();
     }
   }
 
+  /**
+   * @brief Builds the hash index of the meta field upfront.
+   * Indexes of fields used in equality predicates are otherwise built on the first query.
+   */
+  void DeclareMetaIndex(const std::string &path) {
+    GetMetaIndex(path);
+  }
+
   void Print() {
     std::cout << "Keys: " << std::endl;
     for (auto &element : resources_) {
@@ -324,9 +602,168 @@ class ResourceManager : public Details::Singleton<ResourceManager> {
   }
 
  private:
+  template<typename T>
+  T &GetFrom(Resource &resource, ResTag<T>, bool is_mutable) {
+    resource.CheckLazyType<T>();
+    Materialize(resource, is_mutable);
+    if (!is_mutable) {
+      /* callback takes the object by const reference, no need to unshare it */
+      return const_cast<T &>(resource.obj.Get<T>());
+    }
+    return resource.obj.GetMutable<T>();
+  }
+
+  static NameTag GetFrom(Resource &resource, ResTag<NameTag>, bool) {
+    return NameTag(resource.name);
+  }
+
+  static MetaType &GetFrom(Resource &resource, ResTag<MetaType>, bool) {
+    return resource.meta;
+  }
+
+  /* object of the lazy resource is loaded by Resource::As */
+  static Resource &GetFrom(Resource &resource, ResTag<Resource>, bool) {
+    return resource;
+  }
+
+  class PinGuard {
+   public:
+    PinGuard(ResourceManager &manager, const Resource &resource) : manager_(&manager), resource_(&resource) {
+      ++manager_->lazy_pins_[resource_];
+    }
+    PinGuard(PinGuard &&other) noexcept : manager_(other.manager_), resource_(other.resource_) {
+      other.manager_ = nullptr;
+    }
+    PinGuard(const PinGuard &) = delete;
+    ~PinGuard() {
+      if (manager_ && --manager_->lazy_pins_[resource_] == 0) {
+        manager_->lazy_pins_.erase(resource_);
+      }
+    }
+
+   private:
+    ResourceManager *manager_;
+    const Resource *resource_;
+  };
+
+  bool IsManaged(const Resource &resource) const {
+    auto it = resources_.find(resource.name);
+    return it != resources_.end() && it->second.get() == &resource;
+  }
+
+  /**
+   * @brief Releases least recently used lazy objects above the limit, except pinned ones and @p keep
+   */
+  void EvictLazy(const Resource *keep) {
+    if (lazy_memory_limit_ == 0) {
+      return;
+    }
+    for (auto it = lazy_lru_.end(); it != lazy_lru_.begin() && lazy_memory_used_ > lazy_memory_limit_;) {
+      --it;
+      const Resource *resource = *it;
+      if (resource == keep || lazy_pins_.count(resource) > 0) {
+        continue;
+      }
+      resource->obj.reset();
+      lazy_memory_used_ -= resource->lazy->size;
+      lazy_lru_index_.erase(resource);
+      it = lazy_lru_.erase(it);
+    }
+  }
+
+  typedef std::map<KeyType, ResourcePtr> ResourceMap;
+  /// meta value -> resources, map nodes are stable
+  typedef std::unordered_map<std::string, std::vector<const ResourceMap::value_type *>> MetaIndex;
+
+  /* same default as META[path] of the predicates */
+  static std::string GetMetaValue(const Resource &resource, const std::string &path) {
+    auto value = resource.meta.Find(path);
+    return value ? *value : path + "-NOT-FOUND";
+  }
+
+  MetaIndex &GetMetaIndex(const std::string &path) {
+    auto it = meta_indexes_.find(path);
+    if (it == meta_indexes_.end()) {
+      it = meta_indexes_.emplace(path, MetaIndex()).first;
+      for (auto &element : resources_) {
+        it->second[GetMetaValue(*element.second, path)].push_back(&element);
+      }
+    }
+    return it->second;
+  }
+
+  /**
+   * @brief Meta may be changed through mutable references to resources, indexes are rebuilt on the next query
+   */
+  void InvalidateMetaIndexes() {
+    meta_indexes_.clear();
+  }
+
+  /**
+   * @brief Query planner: visits resources satisfying the predicate as IterateGeneration does.
+   * If the predicate implies equalities of meta fields, only resources of the smallest index bucket are tested,
+   * otherwise (regular expressions, disjunctions, arbitrary functions) all resources are scanned.
+   */
+  template<typename Predicate, typename Function>
+  void IterateMatching(Predicate &&predicate, Function &&fct) {
+    Details::MetaEqualities equalities;
+    Details::QueryPlan<std::decay_t<Predicate>>::CollectEqualities(predicate, equalities);
+    if (equalities.empty()) {
+      IterateGeneration([&](const std::string &key, const ResourcePtr &resource) {
+        if (TestPredicate(predicate, *resource)) {
+          fct(key, resource);
+        }
+      });
+      return;
+    }
+
+    const std::vector<const ResourceMap::value_type *> *candidates = nullptr;
+    for (auto &[path, value] : equalities) {
+      auto &index = GetMetaIndex(path);
+      auto bucket_it = index.find(value);
+      if (bucket_it == index.end()) {
+        return;
+      }
+      if (!candidates || bucket_it->second.size() < candidates->size()) {
+        candidates = &bucket_it->second;
+      }
+    }
+    /* copy: callback may add resources or invalidate indexes */
+    auto selected = *candidates;
+    std::sort(selected.begin(), selected.end(), [](auto lhs, auto rhs) { return lhs->first < rhs->first; });
+    const auto generation = generation_;
+    for (auto element : selected) {
+      if (element->second->generation < generation && TestPredicate(predicate, *element->second)) {
+        fct(element->first, element->second);
+      }
+    }
+  }
+
+  /**
+   * @brief Visits resources existing at the moment of the call in the order of keys.
+   * Insertion does not invalidate iterators of std::map, resources added by the callback
+   * are skipped by their generation, so no snapshot of the map is needed.
+   */
+  template<typename Function>
+  void IterateGeneration(Function &&fct) {
+    const auto generation = generation_;
+    for (auto &element : resources_) {
+      if (element.second->generation < generation) {
+        fct(element.first, element.second);
+      }
+    }
+  }
 
-  std::map<KeyType, ResourcePtr>
-      resources_; /// Pointers are used to allow simultaneous iteration and definition new objects
+  ResourceMap resources_; /// Pointers are used to allow simultaneous iteration and definition new objects
+  std::size_t generation_{0};
+  /// meta path -> index
+  std::unordered_map<std::string, MetaIndex> meta_indexes_;
+  /// lazy objects in memory which can be released, most recently used first
+  std::list<const Resource *> lazy_lru_;
+  std::unordered_map<const Resource *, std::list<const Resource *>::iterator> lazy_lru_index_;
+  std::unordered_map<const Resource *, std::size_t> lazy_pins_;
+  std::size_t lazy_memory_used_{0};
+  std::size_t lazy_memory_limit_{0};
 };
 
 #define gResourceManager (ResourceManager::Instance())
@@ -345,7 +782,7 @@ auto AddResource(const KeyRepr &key, ResourceManager::Resource res) {
             name.c_str());
   }
   res.name = name;
-  return ResourceManager::Instance().Add(res);
+  return ResourceManager::Instance().Add(std::move(res));
 }
 
 template<typename T>
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ResourceManager.hpp"
+#include "Predicates.hpp"
+
+namespace {
+
+using Predicates::Resource::KEY;
+using Predicates::Resource::META;
+
+ResourceManager::MetaType MakeMeta(const std::vector<std::pair<std::string, std::string>> &fields) {
+  ResourceManager::MetaType meta;
+  for (auto &[path, value] : fields) {
+    meta.put(path, value);
+  }
+  return meta;
+}
+
+void Fill(ResourceManager &manager) {
+  manager.Add(std::string("/r/1"), 1, MakeMeta({{"a", "x"}, {"b", "1"}}));
+  manager.Add(std::string("/r/2"), 2, MakeMeta({{"a", "x"}, {"b", "2"}}));
+  manager.Add(std::string("/r/3"), 3, MakeMeta({{"a", "y"}, {"b", "1"}}));
+  manager.Add(std::string("/r/4"), 4, MakeMeta({{"a", "x"}}));
+  manager.Add(std::string("/r/5"), 5, MakeMeta({{"a", "y"}, {"c.d", "1"}}));
+}
+
+/* predicate without the query plan, all resources are tested */
+template<typename Predicate>
+std::vector<std::string> FullScan(ResourceManager &manager, const Predicate &predicate) {
+  return manager.GetMatching([&predicate](const ResourceManager::Resource &r) -> bool { return predicate(r); });
+}
+
+TEST(ResourceManager, PlannedQueryMatchesFullScan) {
+  ResourceManager manager;
+  Fill(manager);
+
+  auto check = [&manager](const auto &predicate, const std::vector<std::string> &expected) {
+    EXPECT_EQ(manager.GetMatching(predicate), expected);
+    EXPECT_EQ(FullScan(manager, predicate), expected);
+  };
+  check(META["a"] == "x", {"/r/1", "/r/2", "/r/4"});
+  check(META["a"] == "x" && META["b"] == "1", {"/r/1"});
+  check(META["a"] == "y" && KEY == "/r/5", {"/r/5"});
+  check(META["c.d"] == "1", {"/r/5"});
+  /* missing path: no resource has the value */
+  check(META["e"] == "1", {});
+  /* missing field compares equal to the default value */
+  check(META["b"] == "b-NOT-FOUND", {"/r/4", "/r/5"});
+  check(META["a"] == "x" && META["b"] == "b-NOT-FOUND", {"/r/4"});
+}
+
+TEST(ResourceManager, AddWhileIterating) {
+  ResourceManager manager;
+  Fill(manager);
+  manager.DeclareMetaIndex("a");
+
+  std::vector<std::string> visited;
+  manager.ForEach([&manager, &visited](const std::string &key, const int &value) {
+    visited.push_back(key);
+    manager.Add(key + "/copy", value, MakeMeta({{"a", "x"}}));
+  }, META["a"] == "x");
+  /* resources added by the callback are not visited */
+  EXPECT_EQ(visited, std::vector<std::string>({"/r/1", "/r/2", "/r/4"}));
+  /* and are found by the next query through the updated index */
+  std::vector<std::string> expected{"/r/1", "/r/1/copy", "/r/2", "/r/2/copy", "/r/4", "/r/4/copy"};
+  EXPECT_EQ(manager.GetMatching(META["a"] == "x"), expected);
+  EXPECT_EQ(FullScan(manager, META["a"] == "x"), expected);
+}
+
+TEST(ResourceManager, MetaChangeInvalidatesIndex) {
+  ResourceManager manager;
+  Fill(manager);
+  EXPECT_EQ(manager.GetMatching(META["a"] == "y").size(), 2);
+
+  manager.ForEach([](const std::string &, ResourceManager::MetaType &meta) {
+    meta.put("a", "y");
+  }, META["b"] == "2");
+  EXPECT_EQ(manager.GetMatching(META["a"] == "y"), std::vector<std::string>({"/r/2", "/r/3", "/r/5"}));
+  EXPECT_EQ(FullScan(manager, META["a"] == "y"), std::vector<std::string>({"/r/2", "/r/3", "/r/5"}));
+
+  /* const access keeps the index */
+  const auto &resource = manager.Find(std::string("/r/1"));
+  EXPECT_EQ(resource.meta.get<std::string>("a"), "x");
+  EXPECT_EQ(manager.GetMatching(META["a"] == "x"), std::vector<std::string>({"/r/1", "/r/4"}));
+}
+
+TEST(ResourceManager, ArgumentByValueIsNotMutable) {
+  ResourceManager manager;
+  int n_loads = 0;
+  manager.AddLazy<int>(std::string("/lazy"), std::function<int()>([&n_loads]() { return ++n_loads; }), 100);
+  manager.Find(std::string("/lazy")).content_hash = "hash";
+
+  /* copy of the lazy object, it stays evictable and keeps the content hash */
+  manager.ForEach([](const std::string &, int value) { EXPECT_EQ(value, 1); });
+  EXPECT_EQ(manager.GetLazyMemoryUsed(), 100);
+  EXPECT_EQ(manager.Find(std::string("/lazy")).content_hash, "hash");
+
+  /* mutable reference pins the object in memory */
+  manager.ForEach([](const std::string &, int &value) { value = 10; });
+  EXPECT_EQ(manager.GetLazyMemoryUsed(), 0);
+  EXPECT_TRUE(manager.Find(std::string("/lazy")).content_hash.empty());
+  EXPECT_EQ(n_loads, 1);
+}
+
+TEST(ResourceManager, EvictionKeepsReferencedObjects) {
+  /* const access of Resource goes through the instance */
+  auto &manager = ResourceManager::Instance();
+  std::map<std::string, int> n_loads;
+  for (auto &name : {"a", "b", "c"}) {
+    std::string key = std::string("/evict/") + name;
+    manager.AddLazy<std::vector<int>>(key, std::function<std::vector<int>()>([key, &n_loads]() {
+      ++n_loads[key];
+      return std::vector<int>(1000, int(key.back()));
+    }), 100);
+  }
+  /* a single object fits the limit */
+  manager.SetLazyMemoryLimit(150);
+
+  /* object of the callback is pinned while other objects are loaded */
+  manager.ForEach([&manager](const std::string &, const std::vector<int> &a) {
+    EXPECT_EQ(manager.Find(std::string("/evict/b")).As<std::vector<int>>().front(), 'b');
+    EXPECT_EQ(manager.Find(std::string("/evict/c")).As<std::vector<int>>().front(), 'c');
+    EXPECT_EQ(a.back(), 'a');
+  }, KEY == "/evict/a");
+  /* b is released instead of the pinned one */
+  EXPECT_EQ(manager.GetLazyMemoryUsed(), 200);
+  EXPECT_FALSE(manager.Find(std::string("/evict/b")).obj.has_value());
+
+  /* so is the resource of the feature function */
+  auto features = manager.SelectUniq([&manager](const ResourceManager::Resource &r) {
+    auto &value = r.As<std::vector<int>>();
+    manager.Find(std::string("/evict/c")).As<std::vector<int>>();
+    return value.back();
+  }, KEY == "/evict/a" || KEY == "/evict/b");
+  EXPECT_EQ(features, std::vector<int>({'a', 'b'}));
+
+  /* shared object outlives the eviction */
+  auto a = manager.Find(std::string("/evict/a")).Share<std::vector<int>>();
+  auto b = manager.Find(std::string("/evict/b")).Share<std::vector<int>>();
+  EXPECT_EQ(manager.GetLazyMemoryUsed(), 100);
+  EXPECT_FALSE(manager.Find(std::string("/evict/a")).obj.has_value());
+  EXPECT_EQ(a->back() + b->back(), 'a' + 'b');
+  EXPECT_EQ(n_loads["/evict/a"], 2);
+
+  manager.SetLazyMemoryLimit(0);
+}
+
+}
@@ -0,0 +1,237 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISOBSERVABLES_ROOTWRITER_HPP
+#define QNANALYSIS_SRC_QNANALYSISOBSERVABLES_ROOTWRITER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <TDirectory.h>
+#include <TError.h>
+#include <TFile.h>
+#include <TObject.h>
+#include <TROOT.h>
+
+#include <QnAnalysisTools/BackgroundWriter.hpp>
+
+namespace Tools {
+
+namespace Details {
+
+template<typename T, typename = void>
+struct HasBeginEnd : std::false_type {};
+template<typename T>
+struct HasBeginEnd<T, std::void_t<decltype(std::declval<const T &>().begin()),
+                                  decltype(std::declval<const T &>().end())>> : std::true_type {};
+
+template<typename T, typename = void>
+struct HasGetN : std::false_type {};
+template<typename T>
+struct HasGetN<T, std::void_t<decltype(std::declval<const T &>().GetN())>> : std::true_type {};
+
+template<typename T, typename = void>
+struct HasGetNSamples : std::false_type {};
+template<typename T>
+struct HasGetNSamples<T, std::void_t<decltype(std::declval<const T &>().GetNSamples())>> : std::true_type {};
+
+/**
+ * @brief Heap storage of the container element, e.g. means and weights of bootstrap samples of Qn::StatCalculate
+ */
+template<typename Element>
+std::size_t ElementHeapBytes(const Element &element) {
+  if constexpr (HasGetNSamples<Element>::value) {
+    return std::size_t(std::max<long long>(element.GetNSamples(), 0)) * 2 * sizeof(double);
+  } else {
+    return 0;
+  }
+}
+
+/**
+ * @brief Rough size of the object in memory: elements of containers (with their bootstrap samples),
+ * points of graphs (with errors)
+ */
+template<typename T>
+std::size_t ApproximateBytes(const T &obj) {
+  if constexpr (HasBeginEnd<T>::value) {
+    using Element = std::decay_t<decltype(*obj.begin())>;
+    std::size_t bytes = sizeof(T);
+    for (auto &element : obj) {
+      bytes += sizeof(Element) + ElementHeapBytes(element);
+    }
+    return bytes;
+  } else if constexpr (HasGetN<T>::value) {
+    /* x, y and up to four errors */
+    return sizeof(T) + std::size_t(std::max(obj.GetN(), 0)) * 6 * sizeof(double);
+  } else {
+    return sizeof(T);
+  }
+}
+
+}
+
+/**
+ * @brief Writes objects to the ROOT file on a background thread (Qn::Analysis::Tools::BackgroundWriter).
+ *
+ * Shared objects are kept alive until written, other objects are copied on Write().
+ * They are serialized and compressed by the writer thread in the order of Write() calls.
+ * Directories are looked up (or created) once per path.
+ * The file is opened by the first Write(), Close() (or the destructor) waits for pending objects and closes it.
+ * Objects which can't be written fail the following Flush() or Close().
+ */
+class RootWriter {
+ public:
+  /// Write() blocks while objects of about this size are pending, a single larger object is accepted alone
+  static constexpr std::size_t DEFAULT_MAX_PENDING_BYTES = std::size_t(256) << 20;
+
+  explicit RootWriter(std::string filename, std::string mode = "RECREATE",
+                      std::size_t max_pending_bytes = DEFAULT_MAX_PENDING_BYTES) :
+      filename_(std::move(filename)), mode_(std::move(mode)), max_pending_bytes_(max_pending_bytes) {}
+  RootWriter(const RootWriter &) = delete;
+  RootWriter &operator=(const RootWriter &) = delete;
+  ~RootWriter() {
+    try {
+      Close();
+    } catch (std::exception &e) {
+      Error(__func__, "%s", e.what());
+    }
+  }
+
+  /**
+   * @brief Queues copy of @p obj to be written as @p name in the directory @p dname (relative to the file top)
+   * @throws std::runtime_error if the file can't be opened or the writer is closed
+   */
+  template<typename T>
+  void Write(const std::string &dname, const std::string &name, const T &obj) {
+    /* the copy is made by the caller, the object may change right after Write() returns */
+    std::shared_ptr<const TObject> copy(obj.Clone());
+    Push(dname, name, std::move(copy), Details::ApproximateBytes(obj));
+  }
+
+  /**
+   * @brief Queues @p obj without copying, the object must not be modified by anyone (e.g. shared by the resource)
+   * @throws std::runtime_error if the file can't be opened or the writer is closed
+   */
+  template<typename T>
+  void Write(const std::string &dname, const std::string &name, std::shared_ptr<const T> obj) {
+    const auto bytes = Details::ApproximateBytes(*obj);
+    Push(dname, name, std::shared_ptr<const TObject>(std::move(obj)), bytes);
+  }
+
+  /**
+   * @brief Waits until all queued objects are written and flushes the file
+   * @throws std::runtime_error if an object was not written
+   */
+  void Flush() {
+    std::lock_guard lock(mutex_);
+    if (!file_) {
+      return;
+    }
+    writer_->Flush();
+    file_->Flush();
+  }
+
+  /**
+   * @brief Writes pending objects and closes the file, no objects can be written afterwards
+   * @throws std::runtime_error if an object was not written, the file is closed anyway
+   */
+  void Close() {
+    std::lock_guard lock(mutex_);
+    if (is_closed_) {
+      return;
+    }
+    is_closed_ = true;
+    if (!file_) {
+      return;
+    }
+    std::exception_ptr error;
+    try {
+      writer_->Flush();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    writer_.reset();
+    file_->Close();
+    file_.reset();
+    directories_.clear();
+    std::cout << "Exported to '" << filename_ << "' (" << n_written_ << " objects)" << std::endl;
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  [[nodiscard]] const std::string &GetFilename() const { return filename_; }
+
+ private:
+  void Push(const std::string &dname, const std::string &name, std::shared_ptr<const TObject> obj, std::size_t bytes) {
+    std::lock_guard lock(mutex_);
+    if (is_closed_) {
+      throw std::runtime_error("Write to closed '" + filename_ + "'");
+    }
+    if (!file_) {
+      Open();
+    }
+    writer_->Push([this, dname, name, obj = std::move(obj)]() {
+      auto dir = GetDirectory(dname);
+      if (!dir || dir->WriteTObject(obj.get(), name.c_str()) <= 0) {
+        throw std::runtime_error("Unable to write '" + dname + "/" + name + "' to '" + filename_ + "'");
+      }
+      ++n_written_;
+    }, bytes);
+  }
+
+  /* under the lock */
+  void Open() {
+    ROOT::EnableThreadSafety();
+    {
+      /* TFile::Open makes the file current directory of the caller */
+      TDirectory::TContext context;
+      file_.reset(TFile::Open(filename_.c_str(), mode_.c_str()));
+    }
+    if (!file_ || file_->IsZombie()) {
+      file_.reset();
+      throw std::runtime_error("Unable to open '" + filename_ + "'");
+    }
+    writer_ = std::make_unique<Qn::Analysis::Tools::BackgroundWriter>(true, max_pending_bytes_);
+  }
+
+  /* writer thread only */
+  TDirectory *GetDirectory(const std::string &dname) {
+    auto cached = directories_.find(dname);
+    if (cached != directories_.end()) {
+      return cached->second;
+    }
+    TDirectory *dir = dname.empty() ? file_.get() : file_->GetDirectory(dname.c_str(), true);
+    if (!dir) {
+      std::cout << "mkdir " << file_->GetName() << ":" << dname << std::endl;
+      file_->mkdir(dname.c_str(), "");
+      dir = file_->GetDirectory(dname.c_str(), true);
+    }
+    directories_.emplace(dname, dir);
+    return dir;
+  }
+
+  std::string filename_;
+  std::string mode_;
+  std::size_t max_pending_bytes_;
+
+  std::mutex mutex_;
+  std::unique_ptr<TFile> file_;
+  std::unique_ptr<Qn::Analysis::Tools::BackgroundWriter> writer_;
+  bool is_closed_{false};
+
+  /* writer thread only */
+  std::map<std::string, TDirectory *> directories_;
+  std::size_t n_written_{0};
+};
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLES_ROOTWRITER_HPP
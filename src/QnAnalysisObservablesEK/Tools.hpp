@@ -7,11 +7,21 @@
 
 #include <DataContainer.hpp>
 #include <DataContainerHelper.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <thread>
 #include <utility>
 #include <TClass.h>
 #include <TFile.h>
 #include <TKey.h>
+#include <TROOT.h>
+
+#include "DefineCache.hpp"
+#include "RootWriter.hpp"
 
 namespace Tools {
 
@@ -41,26 +51,54 @@ std::filesystem::path TailPath(const std::filesystem::path &parent_path, const s
   return result;
 };
 
+/**
+ * @brief Exports resources to the ROOT file, objects are written by the RootWriter on a background thread.
+ * Copies share the writer, the file is closed when the last user of the writer is destroyed
+ * or by Close(), which reports objects that could not be written.
+ */
 template<typename T>
 struct ToRoot {
   explicit ToRoot(std::string filename,
                   std::string mode = "RECREATE",
                   std::filesystem::path parent_path = "/")
-      : filename(std::move(filename)), mode(std::move(mode)), parent_path_(std::move(parent_path)) {}
-  ToRoot(const ToRoot<T> &other) {
-    filename = other.filename;
-    mode = other.mode;
-  }
+      : ToRoot(std::make_shared<RootWriter>(std::move(filename), std::move(mode)), std::move(parent_path)) {}
+  /**
+   * @brief Exports to the already existing @p writer, e.g. objects of several types to one file
+   */
+  explicit ToRoot(std::shared_ptr<RootWriter> writer,
+                  std::filesystem::path parent_path = "/")
+      : writer(std::move(writer)), parent_path_(std::move(parent_path)) {}
+  ToRoot(const ToRoot<T> &other) = default;
   ToRoot(ToRoot<T> &&other) noexcept = default;
-  ~ToRoot() {
-    std::cout << "Exported to '" << filename << "'" << std::endl;
+
+  /**
+   * @brief Exports the object of the resource (as ForEach callback), the object is shared, not copied.
+   * Resources of other types are skipped by ForEach.
+   */
+  void operator()(const std::string &fpathstr, const ResourceManager::Resource &resource) {
+    Export(fpathstr, resource.Share<T>());
   }
 
-  void operator()(const std::string &fpathstr, T &obj) {
-    if (!file) {
-      file.reset(TFile::Open(filename.c_str(), mode.c_str()));
-    }
+  /**
+   * @brief Exports copy of @p obj
+   */
+  void Write(const std::string &fpathstr, const T &obj) {
+    Export(fpathstr, obj);
+  }
 
+  /**
+   * @brief Waits until exported objects are written
+   */
+  void Flush() { writer->Flush(); }
+  void Close() { writer->Close(); }
+
+  std::shared_ptr<RootWriter> writer;
+
+  const std::filesystem::path parent_path_;
+
+ private:
+  template<typename Obj>
+  void Export(const std::string &fpathstr, Obj &&obj) {
     using std::filesystem::path;
     path p(TailPath(parent_path_, fpathstr));
     if (p.empty()) {
@@ -70,32 +108,64 @@ struct ToRoot {
 
     auto dname = p.parent_path().relative_path();
     auto bname = p.filename();
-    auto save_dir = file->GetDirectory(dname.c_str(), true);
-
-    if (!save_dir) {
-      std::cout << "mkdir " << file->GetName() << ":" << dname.c_str() << std::endl;
-      file->mkdir(dname.c_str(), "");
-      save_dir = file->GetDirectory(dname.c_str(), true);
-    }
-    save_dir->WriteTObject(&obj, bname.c_str());
+    writer->Write(dname.string(), bname.string(), std::forward<Obj>(obj));
   }
+};
 
-  std::string filename;
-  std::string mode{"RECREATE"};
-  std::unique_ptr<TFile> file{};
 
-  const std::filesystem::path parent_path_;
+namespace Details {
+
+/**
+ * @brief Storage of the argument of the derivation.
+ * Objects taken by const reference or by value are shared with the resource (taken by value are copied by the call),
+ * objects taken by mutable reference are copied, Resource, meta and name are copied as well.
+ * Copied Resource shares the object, lazy objects are loaded before copying.
+ */
+template<typename Arg, typename T = std::decay_t<Arg>>
+using ArgHolder = std::conditional_t<
+    std::is_same_v<T, ResourceManager::Resource> || std::is_same_v<T, ResourceManager::MetaType>
+        || std::is_same_v<T, ResourceManager::NameTag>
+        || (std::is_lvalue_reference_v<Arg> && !std::is_const_v<std::remove_reference_t<Arg>>),
+    T, std::shared_ptr<const T>>;
+
+template<typename StdFunction>
+struct ArgHolders {};
+
+template<typename R, typename... Args>
+struct ArgHolders<std::function<R(Args...)>> {
+  using Tuple = std::tuple<ArgHolder<Args>...>;
 };
 
+template<typename T>
+struct IsSharedArg : std::false_type {};
 
-namespace Details {
+template<typename T>
+struct IsSharedArg<std::shared_ptr<const T>> : std::true_type {};
 
 template<typename Tuple, std::size_t IArg>
 void SetArgI(const std::vector<std::string> &arg_names, Tuple &tuple) {
   using ArgT = std::tuple_element_t<IArg, Tuple>;
   auto &manager = ResourceManager::Instance();
   try {
-    std::get<IArg>(tuple) = manager.Get(arg_names[IArg], ResourceManager::ResTag<ArgT>());
+    if constexpr (IsSharedArg<ArgT>::value) {
+      /* const access keeps the content hash and lazy objects evictable, shared object outlives eviction */
+      std::get<IArg>(tuple) = manager.Find(arg_names[IArg]).template Share<typename ArgT::element_type>();
+    } else if constexpr (std::is_same_v<ArgT, ResourceManager::Resource>) {
+      /* copies are taken through the const access, meta indexes stay valid */
+      const auto &resource = manager.Find(arg_names[IArg]);
+      /* lazy object is read here (on the main thread), the copy shares it and outlives eviction,
+       * so derivations running on worker threads never call the loader */
+      manager.Materialize(resource, false);
+      ResourceManager::Resource copy = resource;
+      copy.lazy.reset();
+      std::get<IArg>(tuple) = std::move(copy);
+    } else if constexpr (std::is_same_v<ArgT, ResourceManager::MetaType>) {
+      std::get<IArg>(tuple) = manager.Find(arg_names[IArg]).meta;
+    } else if constexpr (std::is_same_v<ArgT, ResourceManager::NameTag>) {
+      std::get<IArg>(tuple) = ResourceManager::NameTag(manager.Find(arg_names[IArg]).name);
+    } else {
+      std::get<IArg>(tuple) = manager.Find(arg_names[IArg]).template As<ArgT>();
+    }
   } catch (std::bad_any_cast &e) {
     throw ResourceManager::NoSuchResource(arg_names[IArg]);
   }
@@ -109,23 +179,27 @@ void SetArgTuple(const std::vector<std::string> &arg_names, std::tuple<Args...>
   SetArgTupleImpl(arg_names, tuple, std::make_index_sequence<sizeof...(Args)>());
 }
 
-inline
-ResourceManager::MetaType MergeMeta(const ResourceManager::MetaType &lhs, const ResourceManager::MetaType &rhs) {
-  using Meta = ResourceManager::MetaType;
+template<typename T>
+const T &DerefArg(std::shared_ptr<const T> &arg) {
+  return *arg;
+}
 
-  Meta result = lhs;
-  for (auto &element : rhs) {
-    auto element_name = element.first;
+template<typename T>
+T &DerefArg(T &arg) {
+  return arg;
+}
 
-    if (element.second.empty()) { /// element is value
-      result.put_child(element_name, element.second);
-    } else { /// element is node
-      auto lhs_child = lhs.get_child(element_name, Meta());
-      result.put_child(element_name, MergeMeta(lhs_child, element.second));
-    }
+/**
+ * @brief Calls @p fct with arguments set by SetArgTuple
+ */
+template<typename Function, typename Tuple>
+decltype(auto) ApplyArgs(Function &fct, Tuple &args) {
+  return std::apply([&fct](auto &... arg) -> decltype(auto) { return fct(DerefArg(arg)...); }, args);
+}
 
-  }
-  return result;
+inline
+ResourceManager::MetaType MergeMeta(const ResourceManager::MetaType &lhs, const ResourceManager::MetaType &rhs) {
+  return ResourceManager::MetaType::Merge(lhs, rhs);
 }
 
 template<typename T>
@@ -138,7 +212,7 @@ template<>
 inline
 ResourceManager::Resource MakeResource<ResourceManager::Resource>(ResourceManager::Resource&& r,
                                                                   const ResourceManager::MetaType& meta) {
-  return {r.obj, MergeMeta(r.meta, meta)};
+  return {r.Object(), MergeMeta(r.meta, meta)};
 }
 
 template <typename KeyGenerator>
@@ -178,18 +252,34 @@ auto Define(KeyGenerator &&key_generator,
             std::vector<std::string> arg_names,
             const ResourceManager::MetaType& meta_to_override = ResourceManager::MetaType(),
             EDefineMissingPolicy policy = EDefineMissingPolicy::kSilent) {
-  using ArgsTuple = typename ::Details::FunctionTraits<decltype(std::function{fct})>::ArgumentsTuple;
-  ArgsTuple args;
+  using Traits = ::Details::FunctionTraits<decltype(std::function{fct})>;
+  using ArgsTuple = typename Traits::ArgumentsTuple;
+  using Result = std::decay_t<typename Traits::ReturnType>;
+  using ArgHoldersTuple = typename Details::ArgHolders<decltype(std::function{fct})>::Tuple;
+  ArgHoldersTuple args;
   try {
+    auto cache = DefineCache::Current();
+    std::string cache_key;
+    if (cache) {
+      cache_key = cache->Key<Result, ArgsTuple>(fct, arg_names, meta_to_override);
+      if (auto cached = cache->Load<Result>(cache_key)) {
+        auto result = Details::MakeResource(std::move(*cached), meta_to_override);
+        result.content_hash = cache_key;
+        auto key = Details::EvalKey(std::forward<KeyGenerator>(key_generator), result);
+        return AddResource(std::move(key), std::move(result));
+      }
+    }
     Details::SetArgTuple(arg_names, args);
-    auto result = Details::MakeResource(std::apply(fct, args), meta_to_override);
+    auto result = Details::MakeResource(Details::ApplyArgs(fct, args), meta_to_override);
     auto key = Details::EvalKey(std::forward<KeyGenerator>(key_generator), result);
+    if (cache) {
+      cache->Store<Result>(cache_key, result, ::Details::Convert<decltype(key)>::ToString(key));
+    }
     return AddResource(std::move(key), std::move(result));
   } catch (ResourceManager::NoSuchResource &e) {
     if (policy == EDefineMissingPolicy::kWarn) {
-//      Warning(__func__, "Resource '%s' is required for '%s' is missing, new resource won't be added",
-//              e.what(), ::Details::Convert<KeyGenerator>::ToString(key_generator).c_str());
-//    FIXME
+      /* key may be generated from the result, only the missing argument is known */
+      Warning(__func__, "Resource '%s' is missing, new resource won't be added", e.what());
       return ResourceManager::ResourcePtr();
     } else if (policy == EDefineMissingPolicy::kRethrow) {
       /* this is the right way of rethrowing exceptions
@@ -202,6 +292,209 @@ auto Define(KeyGenerator &&key_generator,
   }
 }
 
+/**
+ * @brief Derivation recorded by DefineLazy
+ */
+struct DefineNode {
+  std::vector<std::string> arg_names;
+  EDefineMissingPolicy policy{kSilent};
+  /// copies arguments from the ResourceManager (main thread), returns computation of the result
+  std::function<std::function<ResourceManager::Resource()>()> prepare;
+  /// evaluates the key and adds the result to the ResourceManager (main thread)
+  std::function<void(ResourceManager::Resource &&)> add;
+};
+
+/**
+ * @brief While the scope is alive, DefineLazy records derivations instead of computing them.
+ * Execute() runs the dependency graph: nodes whose arguments exist are computed in parallel,
+ * their results may unblock further nodes, and so on until no node is ready.
+ * Each node is computed once, nodes with arguments never produced are treated as by Define.
+ *
+ * Queries of the ResourceManager inside the scope do not see the recorded results,
+ * the scope should enclose derivations independent of each other.
+ */
+class LazyDefineScope {
+ public:
+  explicit LazyDefineScope(unsigned int n_threads = std::thread::hardware_concurrency()) :
+      n_threads_(std::max(n_threads, 1u)), previous_(CurrentRef()) {
+    CurrentRef() = this;
+  }
+  LazyDefineScope(const LazyDefineScope &) = delete;
+  LazyDefineScope &operator=(const LazyDefineScope &) = delete;
+  ~LazyDefineScope() {
+    CurrentRef() = previous_;
+    if (!nodes_.empty()) {
+      Warning(__func__, "%zu derivations were not executed", nodes_.size());
+    }
+  }
+
+  static LazyDefineScope *Current() { return CurrentRef(); }
+
+  void Add(DefineNode node) { nodes_.emplace_back(std::move(node)); }
+
+  void Execute() {
+    if (n_threads_ > 1) {
+      ROOT::EnableThreadSafety();
+    }
+    /* nodes are executed with this scope inactive, Define inside derivations is eager */
+    CurrentRef() = previous_;
+    auto pending = std::move(nodes_);
+    nodes_.clear();
+    std::size_t n_executed = 0;
+    try {
+      while (!pending.empty()) {
+        std::vector<DefineNode> ready;
+        std::vector<DefineNode> waiting;
+        for (auto &node : pending) {
+          (IsReady(node) ? ready : waiting).emplace_back(std::move(node));
+        }
+        if (ready.empty()) {
+          pending = std::move(waiting);
+          break;
+        }
+        /* arguments are copied per chunk, not for the whole graph at once */
+        const std::size_t chunk_size = 4 * n_threads_;
+        for (std::size_t chunk_start = 0; chunk_start < ready.size(); chunk_start += chunk_size) {
+          const auto chunk_end = std::min(ready.size(), chunk_start + chunk_size);
+          n_executed += ExecuteChunk(ready.begin() + chunk_start, ready.begin() + chunk_end);
+        }
+        pending = std::move(waiting);
+      }
+      for (auto &node : pending) {
+        HandleMissing(node, *std::find_if(node.arg_names.begin(), node.arg_names.end(), [](const std::string &arg) {
+          return !ResourceManager::Instance().Has(arg);
+        }));
+      }
+    } catch (...) {
+      CurrentRef() = this;
+      throw;
+    }
+    CurrentRef() = this;
+    Info(__func__, "%zu derivations executed on %u threads, %zu skipped", n_executed, n_threads_, pending.size());
+  }
+
+ private:
+  static LazyDefineScope *&CurrentRef() {
+    static LazyDefineScope *current = nullptr;
+    return current;
+  }
+
+  static bool IsReady(const DefineNode &node) {
+    return std::all_of(node.arg_names.begin(), node.arg_names.end(), [](const std::string &arg) {
+      return ResourceManager::Instance().Has(arg);
+    });
+  }
+
+  static void HandleMissing(const DefineNode &node, const std::string &missing_arg) {
+    if (node.policy == kRethrow) {
+      throw ResourceManager::NoSuchResource(missing_arg);
+    } else if (node.policy == kWarn) {
+      Warning(__func__, "Resource '%s' is missing, new resource won't be added", missing_arg.c_str());
+    }
+  }
+
+  template<typename Iter>
+  std::size_t ExecuteChunk(Iter begin, Iter end) {
+    std::vector<Iter> nodes;
+    std::vector<std::function<ResourceManager::Resource()>> computations;
+    for (auto it = begin; it != end; ++it) {
+      try {
+        computations.emplace_back(it->prepare());
+        nodes.emplace_back(it);
+      } catch (ResourceManager::NoSuchResource &e) {
+        HandleMissing(*it, e.what());
+      }
+    }
+
+    std::vector<std::optional<ResourceManager::Resource>> results(computations.size());
+    std::vector<std::exception_ptr> errors(computations.size());
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+      for (std::size_t i; (i = next++) < computations.size();) {
+        try {
+          results[i].emplace(computations[i]());
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < std::min<std::size_t>(n_threads_, computations.size()); ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    /* results are added in the order of definition */
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+      if (errors[i]) {
+        std::rethrow_exception(errors[i]);
+      }
+      nodes[i]->add(std::move(*results[i]));
+    }
+    return nodes.size();
+  }
+
+  unsigned int n_threads_;
+  LazyDefineScope *previous_;
+  std::vector<DefineNode> nodes_;
+};
+
+/**
+ * @brief As Define, but inside LazyDefineScope the derivation is only recorded and computed by Execute().
+ * Without active scope is identical to Define.
+ */
+template<typename KeyGenerator, typename Function>
+void DefineLazy(KeyGenerator &&key_generator,
+                Function &&fct,
+                std::vector<std::string> arg_names,
+                const ResourceManager::MetaType &meta_to_override = ResourceManager::MetaType(),
+                EDefineMissingPolicy policy = EDefineMissingPolicy::kSilent) {
+  auto scope = LazyDefineScope::Current();
+  if (!scope) {
+    Define(std::forward<KeyGenerator>(key_generator), std::forward<Function>(fct),
+           std::move(arg_names), meta_to_override, policy);
+    return;
+  }
+
+  using Traits = ::Details::FunctionTraits<decltype(std::function{fct})>;
+  using ArgsTuple = typename Traits::ArgumentsTuple;
+  using Result = std::decay_t<typename Traits::ReturnType>;
+  using ArgHoldersTuple = typename Details::ArgHolders<decltype(std::function{fct})>::Tuple;
+  /* cache is looked up in prepare and written in add, both on the main thread */
+  auto cache_key = std::make_shared<std::string>();
+  DefineNode node;
+  node.arg_names = arg_names;
+  node.policy = policy;
+  node.prepare = [fct = std::decay_t<Function>(fct), arg_names, meta_to_override, cache_key]() {
+    if (auto cache = DefineCache::Current()) {
+      *cache_key = cache->Key<Result, ArgsTuple>(fct, arg_names, meta_to_override);
+      if (auto cached = cache->Load<Result>(*cache_key)) {
+        auto result = std::make_shared<ResourceManager::Resource>(
+            Details::MakeResource(std::move(*cached), meta_to_override));
+        result->content_hash = *cache_key;
+        cache_key->clear();
+        return std::function<ResourceManager::Resource()>([result]() { return std::move(*result); });
+      }
+    }
+    auto args = std::make_shared<ArgHoldersTuple>();
+    Details::SetArgTuple(arg_names, *args);
+    return std::function<ResourceManager::Resource()>([fct, args, meta_to_override]() {
+      return Details::MakeResource(Details::ApplyArgs(fct, *args), meta_to_override);
+    });
+  };
+  node.add = [key_generator = std::decay_t<KeyGenerator>(key_generator), cache_key](ResourceManager::Resource &&result) {
+    auto key = Details::EvalKey(key_generator, result);
+    if (auto cache = DefineCache::Current()) {
+      cache->Store<Result>(*cache_key, result, ::Details::Convert<decltype(key)>::ToString(key));
+    }
+    AddResource(std::move(key), std::move(result));
+  };
+  scope->Add(std::move(node));
+}
+
 template<typename KeyRepr, typename Function>
 void Define1(const KeyRepr &key,
              Function &&fct,
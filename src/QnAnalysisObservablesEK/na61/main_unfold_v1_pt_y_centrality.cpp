@@ -97,7 +97,7 @@ int main() {
 
         for (auto &centrality_class_data : data) {
           auto centrality_string = KEY.MatchGroup(2, re_string)(*centrality_class_data);
-          boost::regex re_centrality_string(R"(([\d\.]+)-([\d\.]+))");
+          static const boost::regex re_centrality_string(R"(([\d\.]+)-([\d\.]+))");
           boost::smatch match_results;
           assert(boost::regex_search(centrality_string, match_results, re_centrality_string));
 
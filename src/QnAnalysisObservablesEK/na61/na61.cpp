@@ -23,6 +23,7 @@
 
 #include <any>
 #include <filesystem>
+#include <optional>
 #include <tuple>
 #include <utility>
 
@@ -39,6 +40,7 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
 #include <TCanvas.h>
 #include <TLegend.h>
 #include <TFitResult.h>
@@ -107,8 +109,11 @@ ToTMultiGraph(const Qn::DataContainerStatCalculate &data, const std::string &pro
 
 namespace Details {
 
-std::vector<std::string> FindTDirectory(const TDirectory &dir, const std::string &cwd = "") {
-  std::vector<std::string> result;
+/**
+ * @return paths and keys of all objects in the directory and its subdirectories
+ */
+std::vector<std::pair<std::string, TKey *>> FindTDirectory(const TDirectory &dir, const std::string &cwd = "") {
+  std::vector<std::pair<std::string, TKey *>> result;
 
   for (auto o : *dir.GetListOfKeys()) {
     auto key_ptr = dynamic_cast<TKey *>(o);
@@ -117,7 +122,7 @@ std::vector<std::string> FindTDirectory(const TDirectory &dir, const std::string
       auto nested_contents = FindTDirectory(*nested_dir, cwd + "/" + nested_dir->GetName());
       std::move(std::begin(nested_contents), std::end(nested_contents), std::back_inserter(result));
     } else {
-      result.emplace_back(cwd + "/" + key_ptr->GetName());
+      result.emplace_back(cwd + "/" + key_ptr->GetName(), key_ptr);
     }
   }
   return result;
@@ -125,16 +130,33 @@ std::vector<std::string> FindTDirectory(const TDirectory &dir, const std::string
 
 }// namespace Details
 
+/**
+ * @brief Adds lazy resources for objects of type T in the file, objects are read on the first access.
+ * The file is kept open while the resources exist.
+ */
 template<typename T>
 void LoadROOTFile(const std::string &file_name, const std::string &manager_prefix = "") {
-  TFile f(file_name.c_str(), "READ");
+  std::shared_ptr<TFile> f(TFile::Open(file_name.c_str(), "READ"));
+  if (!f || f->IsZombie()) {
+    throw std::runtime_error("Unable to open '" + file_name + "'");
+  }
 
-  for (const auto &path : Details::FindTDirectory(f)) {
-    auto ptr = f.Get<T>(path.c_str());
-    if (ptr) {
+  for (const auto &[path, key] : Details::FindTDirectory(*f)) {
+    auto key_class = TClass::GetClass(key->GetClassName());
+    if (key_class && key_class->InheritsFrom(TClass::GetClass<T>())) {
       auto manager_path = manager_prefix.empty() ? path : "/" + manager_prefix + path;
       std::cout << "Adding path '" << manager_path << "'" << std::endl;
-      AddResource(manager_path, ptr);
+      auto resource = gResourceManager.AddLazy<T>(manager_path, std::function<T()>([f, path = path]() {
+        std::unique_ptr<T> ptr(f->Get<T>(path.c_str()));
+        if (!ptr) {
+          throw std::runtime_error("Unable to read '" + path + "' from '" + f->GetName() + "'");
+        }
+        return T(std::move(*ptr));
+      }), std::size_t(key->GetObjlen()));
+      /* file UUID changes whenever the file is recreated */
+      resource->content_hash = ::Tools::DefineCache::HashString(
+          std::string(f->GetUUID().AsString()) + ":" + path + ";" + std::to_string(key->GetCycle()) + ":"
+              + key->GetDatime().AsSQLString());
     }
   }
 }
@@ -199,7 +221,27 @@ TGraph *CalcSignificance(const TGraphErrors *case_graph, const TGraphErrors *ref
   return signi_graph;
 }
 
-int main() {
+int main(int argc, char **argv) {
+  using namespace boost::program_options;
+
+  options_description desc("Options");
+  desc.add_options()
+      ("help", "Print help message")
+      ("define-cache", value<std::string>(), "ROOT file keeping results of derivations between runs")
+      ("define-cache-version", value<std::string>()->default_value(""),
+       "Version of derivations, change to discard results cached by the previous code")
+      ("define-cache-invalidate", value<std::vector<std::string>>()->composing(),
+       "Remove cached results of resources with names matching the regular expression")
+      ("define-cache-prune", "Remove cached results not used by this run")
+      ("define-cache-report", "Print hit rate of the cache")
+      ;
+  variables_map vm;
+  store(parse_command_line(argc, argv, desc), vm);
+  notify(vm);
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
 
   using std::get;
   using std::string;
@@ -211,17 +253,39 @@ int main() {
 
 
 
-  TFile f("correlation.root", "READ");
-  LoadROOTFile<DTColl>(f.GetName(), "raw");
+  /* raw objects are read on demand, at most this much of them is kept in memory */
+  gResourceManager.SetLazyMemoryLimit(std::size_t(1) << 30);
+  LoadROOTFile<DTColl>("correlation.root", "raw");
 
-  /* Convert everything to Qn::DataContainerStatCalculate */
-  gResourceManager.ForEach([](VectorKey key, DTColl &collect) {
+  /* Convert everything to Qn::DataContainerStatCalculate with remapped axes, on the first access.
+   * Objects are never modified in place, so they stay evictable */
+  for (const auto &raw_name : gResourceManager.GetMatching(KEY.Matches("^/raw/.*$"))) {
+    const auto &raw = gResourceManager.Find(raw_name);
     /* replacing /raw with /calc */
+    auto key = Details::Convert<VectorKey>::FromString(raw_name);
     key[0] = "calc";
-    AddResource(key, Qn::DataContainerStatCalculate(collect));
-  });
+    const auto calc_name = Details::Convert<VectorKey>::ToString(key);
+    auto calc = gResourceManager.AddLazy<DTCalc>(key, std::function<DTCalc()>([raw_name, calc_name]() {
+      DTCalc result(gResourceManager.Find(raw_name).As<DTColl>());
+      remap_axes(result);
+      /* meta is labeled below, before the first access */
+      project_u_axis(result, gResourceManager.Find(calc_name).meta);
+      return result;
+    }), raw.lazy ? raw.lazy->size : 0);
+    if (!raw.content_hash.empty()) {
+      calc->content_hash = ::Tools::DefineCache::HashString("DTCalc:remap:" + raw.content_hash);
+    }
+  }
 
-  remap_axes();
+  std::optional<::Tools::DefineCache> define_cache;
+  if (vm.count("define-cache")) {
+    define_cache.emplace(vm["define-cache"].as<std::string>(), vm["define-cache-version"].as<std::string>());
+    if (vm.count("define-cache-invalidate")) {
+      for (auto &pattern : vm["define-cache-invalidate"].as<std::vector<std::string>>()) {
+        Info(__func__, "%zu cached results matching '%s' removed", define_cache->Invalidate(pattern), pattern.c_str());
+      }
+    }
+  }
 
 
   /* label correlations */
@@ -236,8 +300,8 @@ int main() {
     split(tokens, obj_name, boost::is_any_of("."));
 
     /* args are all tokens but last */
+    static const std::regex arg_re("^(\\w+)_(PLAIN|RECENTERED|RESCALED)$");
     for (size_t iarg = 0; iarg < tokens.size() - 1; ++iarg) {
-      const std::regex arg_re("^(\\w+)_(PLAIN|RECENTERED|RESCALED)$");
       std::smatch match_results;
       std::regex_search(tokens[iarg], match_results, arg_re);
       auto arg_name_raw = match_results.str(0);
@@ -289,16 +353,13 @@ int main() {
   });
 
   {
-    /* Projection _y correlations to pT axis  */
-    gResourceManager.ForEach([](const StringKey &name, DTCalc &calc) {
-                               calc = calc.Projection({"Centrality", "y_cm"});
-                             },
-                             META["u.axis"] == "y");
-    /* Projection _pT correlations to 'y' axis  */
-    gResourceManager.ForEach([](const StringKey &name, DTCalc &calc) {
-                               calc = calc.Projection({"Centrality", "pT"});
-                             },
-                             META["u.axis"] == "pt");
+    /* _y and _pT correlations are projected by the loader of /calc, the content depends on 'u.axis' */
+    for (const auto &name : gResourceManager.GetMatching(KEY.Matches("^/calc/.*$") && META["type"] == "uQ")) {
+      const auto &calc = gResourceManager.Find(name);
+      if (!calc.content_hash.empty()) {
+        calc.content_hash = ::Tools::DefineCache::HashString(calc.content_hash + ":u.axis=" + META["u.axis"](calc));
+      }
+    }
   }
   {
 //    /* Rebin y  */
@@ -323,13 +384,23 @@ int main() {
   /* processing */
 
   /* resolution */
-  resolution_3sub();
-  resolution_mc();
+  {
+    /* independent derivations are computed in parallel */
+    ::Tools::LazyDefineScope lazy_defines;
+    resolution_3sub();
+    resolution_mc();
+    lazy_defines.Execute();
+  }
+  /* uses results of Define and modifies inputs in place */
   resolution_4sub();
 
   /* v1 */
-  v1();
-  v1_mc();
+  {
+    ::Tools::LazyDefineScope lazy_defines;
+    v1();
+    v1_mc();
+    lazy_defines.Execute();
+  }
   v1_centrality();
   v1_combine();
 
@@ -1048,11 +1119,26 @@ int main() {
 
   /***************** SAVING OUTPUT *****************/
   {
+    using ::Tools::RootWriter;
     using ::Tools::ToRoot;
-    gResourceManager.ForEach(ToRoot<Qn::DataContainerStatCalculate>("correlation_proc.root"));
-    gResourceManager.ForEach(ToRoot<TGraphErrors>("prof.root"));
-    gResourceManager.ForEach(ToRoot<TGraph2DErrors>("prof.root", "UPDATE"));
-    gResourceManager.ForEach(ToRoot<TGraphAsymmErrors>("prof.root", "UPDATE"));
+    /* both files are written in the background, Close() waits for them and fails if an object is not written */
+    ToRoot<Qn::DataContainerStatCalculate> correlation_proc_saver("correlation_proc.root");
+    auto prof_writer = std::make_shared<RootWriter>("prof.root", "RECREATE");
+    gResourceManager.ForEach(correlation_proc_saver);
+    gResourceManager.ForEach(ToRoot<TGraphErrors>(prof_writer));
+    gResourceManager.ForEach(ToRoot<TGraph2DErrors>(prof_writer));
+    gResourceManager.ForEach(ToRoot<TGraphAsymmErrors>(prof_writer));
+    correlation_proc_saver.Close();
+    prof_writer->Close();
+  }
+
+  if (define_cache) {
+    if (vm.count("define-cache-prune")) {
+      Info(__func__, "%zu unused cached results removed", define_cache->Prune());
+    }
+    if (vm.count("define-cache-report")) {
+      define_cache->Report();
+    }
   }
   return 0;
 }
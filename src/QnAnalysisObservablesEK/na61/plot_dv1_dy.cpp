@@ -164,9 +164,9 @@ void plot_dv1_dy() {
                    mg_pt_scan.Add((TMultiGraph *) mg_pt_scan_data.Clone(), "lpZ");
                    mg_pt_scan.GetXaxis()->SetTitle("Centrality (%)");
                    mg_pt_scan.GetYaxis()->SetTitle("d v_{1} / d #it{y}_{CM}");
-                   root_saver.operator()(BASE_OF(KEY)(resources) + "/dv1_dy__pt", mg_pt_scan);
-                   root_saver.operator()(BASE_OF(KEY)(resources) + "/dv1_dy__pt_data", mg_pt_scan_data);
-                   root_saver.operator()(BASE_OF(KEY)(resources) + "/dv1_dy__pt_errors", mg_pt_scan_data);
+                   root_saver.Write(BASE_OF(KEY)(resources) + "/dv1_dy__pt", mg_pt_scan);
+                   root_saver.Write(BASE_OF(KEY)(resources) + "/dv1_dy__pt_data", mg_pt_scan_data);
+                   root_saver.Write(BASE_OF(KEY)(resources) + "/dv1_dy__pt_errors", mg_pt_scan_data);
                  }
 
                  /* Centrality scan, STAT + SYSTEMATIC */
@@ -203,7 +203,7 @@ void plot_dv1_dy() {
                    }
                    mg_y_scan.GetXaxis()->SetTitle("p_{T} (GeV/#it{c})");
                    mg_y_scan.GetYaxis()->SetTitle("v_{1}");
-                   root_saver.operator()(BASE_OF(KEY)(resources) + "/dv1_dy__centrality  ", mg_y_scan);
+                   root_saver.Write(BASE_OF(KEY)(resources) + "/dv1_dy__centrality  ", mg_y_scan);
                  }
                },
                META["type"] == "v1" &&
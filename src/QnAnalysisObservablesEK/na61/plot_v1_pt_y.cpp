@@ -148,9 +148,9 @@ void plot_v1_pt_y() {
               mg_pt.Add((TMultiGraph *) mg_pt_scan_data.Clone(), "lpZ");
               mg_pt.GetXaxis()->SetTitle("#it{y}_{CM}");
               mg_pt.GetYaxis()->SetTitle("v_{1}");
-              root_saver.operator()(BASE_OF(KEY)(resource) + "/v1_y", mg_pt);
-              root_saver.operator()(BASE_OF(KEY)(resource) + "/v1_y_data", mg_pt_scan_data);
-              root_saver.operator()(BASE_OF(KEY)(resource) + "/v1_y_sys_errors", mg_pt_scan_errors);
+              root_saver.Write(BASE_OF(KEY)(resource) + "/v1_y", mg_pt);
+              root_saver.Write(BASE_OF(KEY)(resource) + "/v1_y_data", mg_pt_scan_data);
+              root_saver.Write(BASE_OF(KEY)(resource) + "/v1_y_sys_errors", mg_pt_scan_errors);
             }
 
             /* pT scan, different contributions */
@@ -166,7 +166,7 @@ void plot_v1_pt_y() {
                 if (multi) {
                   multi->GetXaxis()->SetTitle("#it{y}_{CM}");
                   multi->GetYaxis()->SetTitle("v_{1}");
-                  root_saver.operator()(BASE_OF(KEY)(resource) + "/" + gse->GetName(), *multi);
+                  root_saver.Write(BASE_OF(KEY)(resource) + "/" + gse->GetName(), *multi);
                 }
               }
             }
@@ -225,9 +225,9 @@ void plot_v1_pt_y() {
               mg_y_scan.Add((TMultiGraph *) mg_y_scan_data.Clone(), "lpZ");
               mg_y_scan.GetXaxis()->SetTitle("p_{T} (GeV/#it{c})");
               mg_y_scan.GetYaxis()->SetTitle("v_{1}");
-              root_saver.operator()(BASE_OF(KEY)(resource) + "/v1_pt  ", mg_y_scan);
-              root_saver.operator()(BASE_OF(KEY)(resource) + "/v1_pt_data", mg_y_scan_data);
-              root_saver.operator()(BASE_OF(KEY)(resource) + "/v1_pt_sys_errors", mg_y_scan_errors);
+              root_saver.Write(BASE_OF(KEY)(resource) + "/v1_pt  ", mg_y_scan);
+              root_saver.Write(BASE_OF(KEY)(resource) + "/v1_pt_data", mg_y_scan_data);
+              root_saver.Write(BASE_OF(KEY)(resource) + "/v1_pt_sys_errors", mg_y_scan_errors);
             }
             /* Y scan, different contributions */
             {
@@ -242,7 +242,7 @@ void plot_v1_pt_y() {
                 if (multi) {
                   multi->GetXaxis()->SetTitle("p_{T} (GeV/#it{c})");
                   multi->GetYaxis()->SetTitle("v_{1}");
-                  root_saver.operator()(BASE_OF(KEY)(resource) + "/" + gse->GetName(), *multi);
+                  root_saver.Write(BASE_OF(KEY)(resource) + "/" + gse->GetName(), *multi);
                 }
               }
             }
@@ -9,28 +9,39 @@
 
 
 
-void remap_axes() {
-/* Remap axis */
-  gResourceManager.ForEach([](const StringKey &, DTCalc &dt) {
-    const std::map<std::string, std::string> axis_name_map{
-        {"RecEventHeaderProc_Centrality_Epsd", "Centrality"},
-        {"Centrality_Centrality_Epsd", "Centrality"},
-        {"SimTracksProc_y_cm", "y_cm"},
-        {"SimTracksProc_pT", "pT"},
-        {"RecParticles_y_cm", "y_cm"},
-        {"RecParticles_pT", "pT"},
-    };
-
-    for (auto &ax : dt.GetAxes()) {
-      auto name = ax.Name();
-
-      auto map_it = axis_name_map.find(name);
-      if (map_it != axis_name_map.end()) {
-        ax.SetName(map_it->second);
-      } else {
-        assert(false);
-      }
-    } // axis
-
-  });
+void remap_axes(DTCalc &dt) {
+  static const std::map<std::string, std::string> axis_name_map{
+      {"RecEventHeaderProc_Centrality_Epsd", "Centrality"},
+      {"Centrality_Centrality_Epsd", "Centrality"},
+      {"SimTracksProc_y_cm", "y_cm"},
+      {"SimTracksProc_pT", "pT"},
+      {"RecParticles_y_cm", "y_cm"},
+      {"RecParticles_pT", "pT"},
+  };
+
+  for (auto &ax : dt.GetAxes()) {
+    auto name = ax.Name();
+
+    auto map_it = axis_name_map.find(name);
+    if (map_it != axis_name_map.end()) {
+      ax.SetName(map_it->second);
+    } else {
+      assert(false);
+    }
+  } // axis
+}
+
+void project_u_axis(DTCalc &dt, const Meta &meta) {
+  auto u_axis = meta.Find("u.axis");
+  if (!u_axis) {
+    return;
+  }
+  /* Projection _y correlations to pT axis  */
+  if (*u_axis == "y") {
+    dt = dt.Projection({"Centrality", "y_cm"});
+  }
+  /* Projection _pT correlations to 'y' axis  */
+  else if (*u_axis == "pt") {
+    dt = dt.Projection({"Centrality", "pT"});
+  }
 }
@@ -5,6 +5,16 @@
 #ifndef QNANALYSIS_SRC_QNANALYSISOBSERVABLESEK_NA61_REMAP_AXIS_HPP_
 #define QNANALYSIS_SRC_QNANALYSISOBSERVABLESEK_NA61_REMAP_AXIS_HPP_
 
-void remap_axes();
+#include "using.hpp"
+
+/**
+ * @brief Renames axes of the correlation to the common names
+ */
+void remap_axes(DTCalc &dt);
+
+/**
+ * @brief Projects u-vector correlation to Centrality and its 'u.axis' (y or pt), no-op for other correlations
+ */
+void project_u_axis(DTCalc &dt, const Meta &meta);
 
 #endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLESEK_NA61_REMAP_AXIS_HPP_
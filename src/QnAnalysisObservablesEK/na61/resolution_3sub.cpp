@@ -59,7 +59,7 @@ void resolution_3sub() {
           % component
           % ref_alias
           % (title.empty() ? meta_key : title)).str());
-      Tools::Define(resolution, Methods::Resolution3S, {arg1_name, arg2_name, arg3_name}, meta);
+      Tools::DefineLazy(resolution, Methods::Resolution3S, {arg1_name, arg2_name, arg3_name}, meta);
     }
   };
   build_3sub_resolution("3sub_standard",{"psd1", "psd2", "psd3"});
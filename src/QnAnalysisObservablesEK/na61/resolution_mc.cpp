@@ -41,7 +41,7 @@ void resolution_mc() {
 
       auto name = (Format("/resolution/%3%/RES_%1%_%2%") % ref_alias % resolution_component % meta_key).str();
       auto arg_name = (Format("/calc/QQ/%1%_RECENTERED.psi_rp_PLAIN.%2%") % base_q_vector % q_component).str();
-      ::Tools::Define(name, [](const DTCalc &calc) { return 2 * calc; }, {arg_name}, meta);
+      ::Tools::DefineLazy(name, [](const DTCalc &calc) { return 2 * calc; }, {arg_name}, meta);
     } // component, base_q_vector
   };
 
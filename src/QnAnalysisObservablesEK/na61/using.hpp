@@ -28,5 +28,6 @@ using Predicates::Resource::KEY;
 using Predicates::Resource::BASE_OF;
 
 using ::Tools::Define;
+using ::Tools::DefineLazy;
 
 #endif //QNANALYSIS_SRC_QNANALYSISOBSERVABLESEK_NA61_USING_HPP_
@@ -48,7 +48,7 @@ void v1() {
       meta.put("v1.ref", META["resolution.ref"](res));
       meta.put("v1.component", correlation_component);
       meta.put("v1.src", "reco");
-      Define(v1_key(), Methods::v1, {uq_key, resolution_key}, meta);
+      DefineLazy(v1_key(), Methods::v1, {uq_key, resolution_key}, meta);
     }, resolution_filter);
   }, uQ_filter);
 
@@ -80,7 +80,7 @@ void v1() {
             meta.put("v1.ref", META["resolution.ref"](res));
             meta.put("v1.component", c1_component);
             meta.put("v1.src", "reco");
-            Define(v1_key(), Methods::v1, {uq_key, resolution_key}, meta);
+            DefineLazy(v1_key(), Methods::v1, {uq_key, resolution_key}, meta);
           }, resolution_filter);
 
         }
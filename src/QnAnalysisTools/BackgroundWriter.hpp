@@ -0,0 +1,169 @@
+#ifndef QNANALYSIS_SRC_QNANALYSISTOOLS_BACKGROUNDWRITER_HPP
+#define QNANALYSIS_SRC_QNANALYSISTOOLS_BACKGROUNDWRITER_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace Qn {
+
+namespace Analysis {
+
+namespace Tools {
+
+/**
+ * @brief Executes write jobs in the order of submission, either immediately
+ * or on a background thread. Each job owns the objects it writes,
+ * they are freed as soon as the job is done.
+ *
+ * In background mode Push blocks while jobs of the total cost max_pending_cost are pending
+ * (a single more expensive job is accepted alone), so that the memory of resident objects stays bounded.
+ * Cost is up to the caller, e.g. 1 per job or the approximate size of the object.
+ *
+ * A job reports failure by throwing. The following jobs are still executed,
+ * the first error is rethrown by Flush, so that the caller fails instead of leaving an incomplete output.
+ * Jobs must be the only users of the output file until Flush returns.
+ */
+class BackgroundWriter {
+ public:
+  using Job = std::function<void()>;
+
+  explicit BackgroundWriter(bool background, std::size_t max_pending_cost = 4) :
+      background_(background),
+      max_pending_cost_(std::max<std::size_t>(max_pending_cost, 1)) {
+    if (background_) {
+      thread_ = std::thread(&BackgroundWriter::Loop, this);
+    }
+  }
+
+  /**
+   * @brief Waits for the pending jobs, errors not taken by Flush are lost
+   */
+  ~BackgroundWriter() {
+    if (background_) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      queue_changed_.notify_all();
+      thread_.join();
+    }
+  }
+
+  BackgroundWriter(const BackgroundWriter &) = delete;
+  BackgroundWriter &operator=(const BackgroundWriter &) = delete;
+
+  void Push(Job job, std::size_t cost = 1) {
+    if (!background_) {
+      Execute(job);
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      /* jobs being executed count until they are done */
+      queue_changed_.wait(lock, [this, cost] {
+        return pending_cost_ == 0 || pending_cost_ + cost <= max_pending_cost_;
+      });
+      pending_cost_ += cost;
+      queue_.emplace_back(std::move(job), cost);
+    }
+    queue_changed_.notify_all();
+  }
+
+  /**
+   * @brief Waits until all submitted jobs are done
+   * @throws the first error of the jobs since the previous Flush
+   */
+  void Flush() {
+    std::exception_ptr error;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_changed_.wait(lock, [this] { return queue_.empty() && !busy_; });
+      std::swap(error, first_error_);
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  [[nodiscard]] std::size_t GetNDone() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return n_done_;
+  }
+
+  [[nodiscard]] std::size_t GetNErrors() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return n_errors_;
+  }
+
+ private:
+  void Execute(Job &job) {
+    std::exception_ptr error;
+    try {
+      job();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    /* releases the objects owned by the job */
+    job = nullptr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++n_done_;
+    if (error) {
+      ++n_errors_;
+      if (!first_error_) {
+        first_error_ = error;
+      }
+    }
+  }
+
+  void Loop() {
+    while (true) {
+      std::pair<Job, std::size_t> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queue_changed_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        job = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+      }
+      Execute(job.first);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        busy_ = false;
+        pending_cost_ -= job.second;
+      }
+      queue_changed_.notify_all();
+    }
+  }
+
+  bool background_{false};
+  std::size_t max_pending_cost_{1};
+  mutable std::mutex mutex_;
+  std::condition_variable queue_changed_;
+  std::deque<std::pair<Job, std::size_t>> queue_;
+  /// queued jobs and the job being executed
+  std::size_t pending_cost_{0};
+  bool busy_{false};
+  bool stop_{false};
+  std::size_t n_done_{0};
+  std::size_t n_errors_{0};
+  std::exception_ptr first_error_;
+  std::thread thread_;
+};
+
+}
+
+}
+
+}
+
+#endif //QNANALYSIS_SRC_QNANALYSISTOOLS_BACKGROUNDWRITER_HPP
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <QnAnalysisTools/BackgroundWriter.hpp>
+
+namespace {
+
+using namespace Qn::Analysis::Tools;
+
+TEST(BackgroundWriter, OrderAndRelease) {
+  for (bool background : {false, true}) {
+    std::vector<int> written;
+    std::weak_ptr<int> first_object;
+    {
+      BackgroundWriter writer(background, 2);
+      for (int i = 0; i < 10; ++i) {
+        auto object = std::make_shared<int>(i);
+        if (i == 0) {
+          first_object = object;
+        }
+        writer.Push([object, &written] { written.push_back(*object); });
+      }
+      writer.Flush();
+      EXPECT_EQ(writer.GetNDone(), 10);
+      /* objects are released by the writer once written */
+      EXPECT_TRUE(first_object.expired());
+    }
+    EXPECT_EQ(written, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+  }
+}
+
+TEST(BackgroundWriter, FirstErrorIsRethrown) {
+  for (bool background : {false, true}) {
+    BackgroundWriter writer(background);
+    int n_written = 0;
+    writer.Push([] { throw std::runtime_error("first"); });
+    writer.Push([&n_written] { ++n_written; });
+    writer.Push([] { throw std::logic_error("second"); });
+    /* the following jobs are executed, the first error fails the flush */
+    try {
+      writer.Flush();
+      FAIL() << "error of the job is lost";
+    } catch (std::runtime_error &e) {
+      EXPECT_STREQ(e.what(), "first");
+    }
+    EXPECT_EQ(n_written, 1);
+    EXPECT_EQ(writer.GetNDone(), 3);
+    EXPECT_EQ(writer.GetNErrors(), 2);
+    /* reported once */
+    EXPECT_NO_THROW(writer.Flush());
+  }
+}
+
+TEST(BackgroundWriter, PendingCost) {
+  BackgroundWriter writer(true, 10);
+  std::size_t pushed = 0;
+  std::atomic<std::size_t> done{0};
+  for (std::size_t cost : {4, 4, 4, 25, 1, 9, 3}) {
+    writer.Push([cost, &done] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      done += cost;
+    }, cost);
+    pushed += cost;
+    /* a single more expensive job is accepted alone */
+    EXPECT_LE(pushed - done, std::max<std::size_t>(cost, 10));
+  }
+  writer.Flush();
+  EXPECT_EQ(done, pushed);
+}
+
+}